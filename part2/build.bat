@@ -10,6 +10,6 @@ setlocal
 set profile_flag=/DPERFAWARE_PROFILE
 
 call cl %profile_flag% -Zi -W4 -EHsc -nologo -std:c++20 ..\%1 -Fe%~n1_dm.exe
-call cl %profile_flag% -arch:AVX2 -O2 -Zi -W4 -EHsc -nologo -std:c++20 ..\%1 -Fe%~n1_rm.exe
+call cl %profile_flag% -O2 -Zi -W4 -EHsc -nologo -std:c++20 ..\%1 -Fe%~n1_rm.exe
 
 popd
\ No newline at end of file
@@ -24,22 +24,29 @@ if [ "$machine" = "Linux" ]; then
 
     echo -n "Compilation Time:"
     time {
-        # g++ ${release_flags} ${common_flags} -o genPoints point_generator.cpp &
-        # g++ ${debug_flags} ${common_flags} -o genPoints_db point_generator.cpp &
-        g++ ${release_flags} ${common_flags} -o haversine haversine_processor.cpp &
-        g++ ${debug_flags} ${common_flags} -o haversine_db haversine_processor.cpp &
-        g++ ${debug_flags} ${common_flags} -o read_test read_repetition_tester.cpp &
-        g++ ${release_flags} ${common_flags} -o read_test read_repetition_tester.cpp &
+        # g++ ${release_flags} ${common_flags} -o genPoints ../point_generator.cpp &
+        # g++ ${debug_flags} ${common_flags} -o genPoints_db ../point_generator.cpp &
+        g++ ${release_flags} ${common_flags} -o haversine ../haversine_processor.cpp &
+        g++ ${debug_flags} ${common_flags} -o haversine_db ../haversine_processor.cpp &
+        g++ ${debug_flags} ${common_flags} -o read_test_db ../read_repetition_tester.cpp &
+        g++ ${release_flags} ${common_flags} -o read_test ../read_repetition_tester.cpp &
+        g++ ${release_flags} ${common_flags} -o float_parser_test ../float_parser_tester.cpp &
+        g++ ${release_flags} ${common_flags} -o math_test ../math_tester.cpp &
+        g++ ${release_flags} ${common_flags} -o json_cursor_test ../json_cursor_tester.cpp &
+        g++ ${release_flags} ${common_flags} -o stage_test ../stage_repetition_tester.cpp &
+        # NOTE(chogan): Unix domain sockets, so Linux only
+        g++ ${release_flags} ${common_flags} -o query_server ../query_server.cpp &
+        g++ ${release_flags} ${common_flags} -o query_client ../query_client.cpp &
         wait
     }
     echo ""
 elif [ "$machine" = "MinGw" ]; then
     profile_flag="-DPERFAWARE_PROFILE"
-    release_flags="-arch:AVX2 -O2 ${profile_flag}"
+    release_flags="-O2 ${profile_flag}"
     debug_flags="${profile_flag}"
     common_flags="-Zi -W4 -EHsc -nologo -std:c++20"
 
-    programs=("point_generator" "haversine_processor" "read_repetition_tester")
+    programs=("point_generator" "haversine_processor" "read_repetition_tester" "float_parser_tester" "math_tester" "json_cursor_tester" "stage_repetition_tester")
 
     echo -n "Compilation Time:"
     time {
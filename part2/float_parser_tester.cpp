@@ -0,0 +1,176 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+
+#define ArrayCount(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef double f64;
+typedef uint32_t b32;
+
+#include "perfaware_timer.h"
+#include "perfaware_timer.cpp"
+#include "perfaware_memory.h"
+#include "perfaware_memory.cpp"
+#include "perfaware_float_parser.h"
+#include "perfaware_float_parser.cpp"
+#include "listing_0103_repetition_tester.cpp"
+
+// NOTE(chogan): Numbers are formatted the same way point_generator writes
+// them, and stored NUL terminated so atof and strtod can read them in place.
+struct NumberParams {
+  char *text;
+  u32 *offsets;
+  u32 *sizes;
+  u64 count;
+  u64 text_size;
+  f64 sink;
+};
+
+void parseViaAtof(repetition_tester *tester, NumberParams *params) {
+  while (IsTesting(tester)) {
+    f64 sum = 0;
+
+    BeginTime(tester);
+    for (u64 i = 0; i < params->count; ++i) {
+      sum += atof(params->text + params->offsets[i]);
+    }
+    EndTime(tester);
+
+    CountBytes(tester, params->text_size);
+    params->sink += sum;
+  }
+}
+
+void parseViaStrtod(repetition_tester *tester, NumberParams *params) {
+  while (IsTesting(tester)) {
+    f64 sum = 0;
+
+    BeginTime(tester);
+    for (u64 i = 0; i < params->count; ++i) {
+      sum += strtod(params->text + params->offsets[i], NULL);
+    }
+    EndTime(tester);
+
+    CountBytes(tester, params->text_size);
+    params->sink += sum;
+  }
+}
+
+void parseViaParseF64(repetition_tester *tester, NumberParams *params) {
+  while (IsTesting(tester)) {
+    f64 sum = 0;
+
+    BeginTime(tester);
+    for (u64 i = 0; i < params->count; ++i) {
+      sum += parseF64(params->text + params->offsets[i], params->sizes[i]);
+    }
+    EndTime(tester);
+
+    CountBytes(tester, params->text_size);
+    params->sink += sum;
+  }
+}
+
+typedef void ParseTestFunc(repetition_tester *tester, NumberParams *params);
+
+struct TestFunction {
+  const char *name;
+  ParseTestFunc *func;
+};
+
+TestFunction test_functions[] {
+  {"atof", parseViaAtof},
+  {"strtod", parseViaStrtod},
+  {"parseF64", parseViaParseF64},
+};
+
+void generateNumbers(Arena *arena, NumberParams *params, u64 count, u64 seed) {
+  const u32 kMaxNumberSize = 32;
+  params->count = count;
+  params->offsets = pushArray<u32>(arena, count);
+  params->sizes = pushArray<u32>(arena, count);
+  params->text = (char *)pushSize(arena, count * kMaxNumberSize);
+
+  std::uniform_real_distribution<f64> unifX(-180, 180);
+  std::default_random_engine re((unsigned int)seed);
+
+  u32 offset = 0;
+  for (u64 i = 0; i < count; ++i) {
+    int size = snprintf(params->text + offset, kMaxNumberSize, "%.16f", unifX(re));
+    params->offsets[i] = offset;
+    params->sizes[i] = (u32)size;
+    offset += size + 1;
+  }
+  params->text_size = offset;
+}
+
+// NOTE(chogan): parseF64 has to agree with strtod bit for bit, otherwise the
+// timings don't mean anything.
+bool verifyParseF64(NumberParams *params) {
+  bool result = true;
+
+  for (u64 i = 0; i < params->count; ++i) {
+    const char *text = params->text + params->offsets[i];
+    f64 expected = strtod(text, NULL);
+    f64 actual = parseF64(text, params->sizes[i]);
+
+    if (memcmp(&expected, &actual, sizeof(f64)) != 0) {
+      fprintf(stderr, "ERROR: parseF64(\"%s\") = %.17g, strtod = %.17g\n", text, actual,
+              expected);
+      result = false;
+      break;
+    }
+  }
+
+  return result;
+}
+
+int main(int argc, char **argv) {
+  u64 count = 1000000;
+  u64 seed = 1234;
+
+  if (argc > 1) {
+    count = atoll(argv[1]);
+  }
+  if (argc > 2) {
+    seed = atoll(argv[2]);
+  }
+
+  if (argc <= 3 && count > 0) {
+    u64 cpu_timer_freq = estimateCPUFrequency();
+    Arena arena = initArenaAndAllocate(count * (32 + 2 * sizeof(u32)));
+
+    NumberParams params = {};
+    generateNumbers(&arena, &params, count, seed);
+
+    if (verifyParseF64(&params)) {
+      repetition_tester testers[ArrayCount(test_functions)] = {};
+
+      for (u32 i = 0; i < ArrayCount(test_functions); ++i) {
+        TestFunction *func = test_functions + i;
+        repetition_tester *tester = testers + i;
+
+        printf("\n--- %s (%llu numbers) ---\n", func->name, (unsigned long long)count);
+        NewTestWave(tester, params.text_size, cpu_timer_freq);
+        func->func(tester, &params);
+      }
+    }
+
+    destroyArena(&arena);
+  } else {
+    fprintf(stderr, "USAGE: %s [number_count] [seed]\n", argv[0]);
+  }
+
+  return 0;
+}
@@ -4,6 +4,7 @@
 #include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 typedef uint8_t u8;
 typedef uint16_t u16;
@@ -20,68 +21,883 @@ typedef double f64;
 #include "perfaware_timer.h"
 #include "perfaware_memory.h"
 #include "perfaware_haversine.h"
+#include "perfaware_math.h"
+#include "perfaware_cpu.h"
+#include "perfaware_float_parser.h"
+#include "perfaware_float_format.h"
+#include "perfaware_thread.h"
+#include "perfaware_file.h"
+#include "perfaware_hash.h"
+#include "perfaware_point_file.h"
+#include "perfaware_json_parser.h"
+#include "perfaware_json_cursor.h"
+#include "perfaware_json_schema.h"
+#include "perfaware_pipeline.h"
+#include "perfaware_fused.h"
+#include "perfaware_answers.h"
+#include "perfaware_checkpoint.h"
+#include "perfaware_roofline.h"
 
 #include "listing_0065_haversine_formula.cpp"
 #include "perfaware_haversine.cpp"
 #include "perfaware_memory.cpp"
+#include "perfaware_cpu.cpp"
+#include "perfaware_math.cpp"
+#include "perfaware_float_parser.cpp"
+#include "perfaware_float_format.cpp"
+#include "perfaware_thread.cpp"
+#include "perfaware_file.cpp"
+#include "perfaware_hash.cpp"
+#include "perfaware_point_file.cpp"
 #include "perfaware_json_parser.cpp"
+#include "perfaware_json_cursor.cpp"
 #include "perfaware_timer.cpp"
+#include "perfaware_pipeline.cpp"
+#include "perfaware_fused.cpp"
+#include "perfaware_answers.cpp"
+#include "perfaware_checkpoint.cpp"
+#include "perfaware_roofline.cpp"
 
 
-PointArray parseJson(Arena *arena, Arena *scratch, const char *file_path) {
+// NOTE(chogan): Points per read when streaming a point file. 8mb of columns.
+const u64 kDefaultWindowSize = KILOBYTES(256);
+
+struct Arguments {
+  const char *json_path;
+  const char *answers_path;
+  u32 thread_count;
+  bool pipeline;
+  u64 buffer_size;
+  bool compare_reads;
+  bool read_backend_given;
+  bool verify_checksum;
+  FileReadOptions read_options;
+  HaversineKernel kernel;
+  bool scaling;
+  bool fused;
+  const char *answers_out_path;
+  f64 tolerance;
+  u64 ulps;
+  u32 max_mismatches;
+  u64 memory_budget;
+  bool stream;
+  u64 window_size;
+  bool incremental;
+  bool roofline;
+};
+
+bool parseArguments(int argc, char **argv, Arguments *args) {
+  bool result = true;
+  u32 positional_count = 0;
+  bool kernel_given = false;
+  bool isa_given = false;
+  CpuIsa isa = CpuIsa_Scalar;
+  args->thread_count = getCoreCount();
+  args->buffer_size = MEGABYTES(16);
+  args->read_options = defaultFileReadOptions();
+  args->tolerance = 0.00000001;
+  args->window_size = kDefaultWindowSize;
+  args->max_mismatches = 10;
+
+  for (int i = 1; i < argc && result; ++i) {
+    const char *arg = argv[i];
+
+    if (strcmp(arg, "--threads") == 0 && i + 1 < argc) {
+      args->thread_count = (u32)atoi(argv[++i]);
+    } else if (strcmp(arg, "--pipeline") == 0) {
+      args->pipeline = true;
+    } else if (strcmp(arg, "--buffer-mb") == 0 && i + 1 < argc) {
+      args->buffer_size = MEGABYTES((u64)atoll(argv[++i]));
+    } else if (strcmp(arg, "--read") == 0 && i + 1 < argc) {
+      if (!parseFileBackend(argv[++i], &args->read_options.backend)) {
+        fprintf(stderr, "ERROR: Unknown read backend %s\n", argv[i]);
+        result = false;
+      }
+      args->read_backend_given = true;
+    } else if (strcmp(arg, "--populate") == 0) {
+      args->read_options.populate = true;
+    } else if (strcmp(arg, "--madvise") == 0 && i + 1 < argc) {
+      if (!parseFileAdvice(argv[++i], &args->read_options.advice)) {
+        fprintf(stderr, "ERROR: Unknown madvise hint %s\n", argv[i]);
+        result = false;
+      }
+    } else if (strcmp(arg, "--queue-depth") == 0 && i + 1 < argc) {
+      args->read_options.queue_depth = (u32)atoi(argv[++i]);
+    } else if (strcmp(arg, "--compare-reads") == 0) {
+      args->compare_reads = true;
+    } else if (strcmp(arg, "--kernel") == 0 && i + 1 < argc) {
+      if (!parseHaversineKernel(argv[++i], &args->kernel)) {
+        fprintf(stderr, "ERROR: Unknown haversine kernel %s\n", argv[i]);
+        result = false;
+      }
+      kernel_given = true;
+    } else if (strcmp(arg, "--isa") == 0 && i + 1 < argc) {
+      if (!parseCpuIsa(argv[++i], &isa)) {
+        fprintf(stderr, "ERROR: Unknown instruction set %s\n", argv[i]);
+        result = false;
+      }
+      isa_given = true;
+    } else if (strcmp(arg, "--fused") == 0) {
+      args->fused = true;
+    } else if (strcmp(arg, "--answers-out") == 0 && i + 1 < argc) {
+      args->answers_out_path = argv[++i];
+    } else if (strcmp(arg, "--tolerance") == 0 && i + 1 < argc) {
+      args->tolerance = atof(argv[++i]);
+    } else if (strcmp(arg, "--ulps") == 0 && i + 1 < argc) {
+      args->ulps = (u64)atoll(argv[++i]);
+    } else if (strcmp(arg, "--max-mismatches") == 0 && i + 1 < argc) {
+      args->max_mismatches = (u32)atoi(argv[++i]);
+    } else if (strcmp(arg, "--memory-mb") == 0 && i + 1 < argc) {
+      args->memory_budget = MEGABYTES((u64)atoll(argv[++i]));
+    } else if (strcmp(arg, "--stream") == 0) {
+      args->stream = true;
+    } else if (strcmp(arg, "--incremental") == 0) {
+      args->incremental = true;
+    } else if (strcmp(arg, "--roofline") == 0) {
+      args->roofline = true;
+    } else if (strcmp(arg, "--scaling") == 0) {
+      args->scaling = true;
+    } else if (strcmp(arg, "--verify-checksum") == 0) {
+      args->verify_checksum = true;
+    } else if (arg[0] == '-' && arg[1] == '-') {
+      fprintf(stderr, "ERROR: Unknown option %s\n", arg);
+      result = false;
+    } else if (positional_count == 0) {
+      args->json_path = arg;
+      positional_count++;
+    } else if (positional_count == 1) {
+      args->answers_path = arg;
+      positional_count++;
+    } else {
+      result = false;
+    }
+  }
+
+  if (isa_given && !forceCpuIsa(isa)) {
+    fprintf(stderr, "ERROR: This CPU doesn't have %s\n", kCpuIsaNames[isa]);
+    result = false;
+  }
+  // NOTE(chogan): The default kernel follows --isa
+  if (!kernel_given) {
+    args->kernel = getBestHaversineKernel();
+  } else if (!isHaversineKernelSupported(args->kernel)) {
+    fprintf(stderr, "ERROR: Can't run the %s kernel on %s\n", kHaversineKernelNames[args->kernel],
+            kCpuIsaNames[getCpuIsa()]);
+    result = false;
+  }
+  if (args->thread_count < 1 || args->thread_count > kMaxThreads) {
+    fprintf(stderr, "ERROR: --threads must be between 1 and %u\n", kMaxThreads);
+    result = false;
+  }
+  if (args->buffer_size == 0) {
+    fprintf(stderr, "ERROR: --buffer-mb must be at least 1\n");
+    result = false;
+  }
+  if (args->read_options.queue_depth < 1 || args->read_options.queue_depth > 4096) {
+    fprintf(stderr, "ERROR: --queue-depth must be between 1 and 4096\n");
+    result = false;
+  }
+  if (!(args->tolerance >= 0)) {
+    fprintf(stderr, "ERROR: --tolerance can't be negative\n");
+    result = false;
+  }
+  if (args->max_mismatches > kMaxReportedMismatches) {
+    fprintf(stderr, "ERROR: --max-mismatches can be at most %u\n", kMaxReportedMismatches);
+    result = false;
+  }
+  if (args->answers_out_path && !args->fused) {
+    fprintf(stderr, "ERROR: --answers-out needs --fused\n");
+    result = false;
+  }
+  result = result && positional_count == 2;
+  if (result && args->incremental && (isPointFile(args->json_path) || args->answers_out_path)) {
+    fprintf(stderr, "ERROR: --incremental only works on JSON input, without --answers-out\n");
+    result = false;
+  }
+  if (args->roofline && (args->fused || args->stream || args->incremental || args->pipeline)) {
+    fprintf(stderr, "ERROR: --roofline only works on an in memory run without --pipeline\n");
+    result = false;
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Reads the input once with each backend so their bandwidth can
+// be compared on the same file. The page cache is warm after the first read,
+// except for O_DIRECT which always goes to the device.
+void compareReadBackends(Arena *scratch, const char *path, FileReadOptions *options) {
+  u64 os_freq = getOsTimerFreq();
+
+  for (u32 i = 0; i < FileBackend_Count; ++i) {
+    ScopedTemporaryMemory scratch_memory(scratch);
+    FileReadOptions backend_options = *options;
+    backend_options.backend = (FileBackend)i;
+
+    u64 start = readOsTimer();
+    EntireFile file = readEntireFile(scratch_memory, path, &backend_options);
+    u64 elapsed = readOsTimer() - start;
+
+    if (file.data) {
+      f64 seconds = (f64)elapsed / (f64)os_freq;
+      f64 gigabytes = (f64)file.size / (f64)GIGABYTES(1);
+      printf("  %-10s %10.3fms %8.3fgb/s\n", kFileBackendNames[i], 1000.0 * seconds,
+             seconds > 0 ? gigabytes / seconds : 0.0);
+    } else {
+      printf("  %-10s failed\n", kFileBackendNames[i]);
+    }
+    releaseEntireFile(&file);
+  }
+}
+
+struct PipelineParseContext {
+  Arena *arena;
+  Arena *scratch;
+  PointArray points;
+  u32 thread_count;
+};
+
+u64 parsePipelineRecords(void *context, EntireFile *records, u32 first_line, bool is_last) {
+  (void)is_last;
+  PipelineParseContext *ctx = (PipelineParseContext *)context;
+  ScopedTemporaryMemory scratch_memory(ctx->scratch);
+  u64 result = 0;
+  LineOrigin origin = {(const char *)records->data, first_line};
+  PointArray parsed = parseRecordChunks(ctx->arena, scratch_memory, records, origin,
+                                        ctx->thread_count, &result);
+
+  // NOTE(chogan): Nothing else is pushed onto `arena` while the pipeline runs,
+  // so each buffer's points land right after the previous buffer's.
+  if (!ctx->points.data) {
+    ctx->points.data = parsed.data;
+  }
+  assert(parsed.data == ctx->points.data + ctx->points.num_points);
+  ctx->points.num_points += parsed.num_points;
+
+  return result;
+}
+
+PointArray parseJsonPipelined(Arena *arena, Arena *scratch, Arguments *args) {
   TimeFunction;
-  ScopedTemporaryMemory scratch_memory(scratch);
-  EntireFile file = readEntireFile(scratch_memory, file_path);
-  TokenArray tokens = tokenize(scratch_memory, &file);
-  PointArray result = parseTokens(arena, &tokens);
+  PipelineParseContext context = {};
+  context.arena = arena;
+  context.scratch = scratch;
+  context.thread_count = args->thread_count;
+
+  ReadPipelineStats stats = {};
+  runReadPipeline(scratch, args->json_path, args->buffer_size, parsePipelineRecords,
+                  &context, &stats);
+  printf("Pipeline: %llu buffers, %.3fmb, parser waited %llu cycles for reads\n",
+         (unsigned long long)stats.buffer_count, stats.bytes_read / (1024.0 * 1024.0),
+         (unsigned long long)stats.parse_wait_cycles);
+
+  return context.points;
+}
+
+// NOTE(chogan): Runs the haversine step with 1, 2, 4, ... up to `max_threads`
+// threads (best of a few runs each) and checks that the average doesn't change.
+void reportHaversineScaling(Arena *arena, PointColumns *points, HaversineKernel kernel,
+                            u32 max_threads) {
+  const u32 kRuns = 3;
+  u64 os_freq = getOsTimerFreq();
+  f64 single_thread_seconds = 0;
+  f64 expected_average = 0;
+
+  printf("Haversine scaling (%s kernel, %llu pairs):\n", kHaversineKernelNames[kernel],
+         (unsigned long long)points->num_points);
+
+  for (u32 thread_count = 1; thread_count <= max_threads;) {
+    f64 best_seconds = 0;
+    f64 average = 0;
+
+    for (u32 run = 0; run < kRuns; ++run) {
+      ScopedTemporaryMemory answer_memory(arena);
+      u64 start = readOsTimer();
+      f64 *answers = calculateHaversine(answer_memory, points, kernel, thread_count);
+      f64 seconds = (f64)(readOsTimer() - start) / (f64)os_freq;
+
+      average = answers[points->num_points];
+      if (run == 0 || seconds < best_seconds) {
+        best_seconds = seconds;
+      }
+    }
+
+    if (thread_count == 1) {
+      single_thread_seconds = best_seconds;
+      expected_average = average;
+    }
+
+    bool identical = memcmp(&average, &expected_average, sizeof(f64)) == 0;
+    printf("  %3u threads %10.3fms %6.2fx %s\n", thread_count, 1000.0 * best_seconds,
+           single_thread_seconds / best_seconds,
+           identical ? "" : "(average differs from 1 thread!)");
+
+    if (thread_count == max_threads) {
+      break;
+    }
+    thread_count = thread_count * 2 < max_threads ? thread_count * 2 : max_threads;
+  }
+}
+
+f64 *calculateAnswers(Arena *arena, Arena *scratch, Arguments *args, u64 *num_points) {
+  f64 *result = NULL;
+
+  if (isPointFile(args->json_path)) {
+    FileReadOptions point_read_options = getInPlaceReadOptions(&args->read_options,
+                                                               args->read_backend_given);
+    PointFile point_file = {};
+    if (openPointFile(scratch, args->json_path, &point_read_options, args->verify_checksum,
+                      &point_file)) {
+      *num_points = point_file.points.num_points;
+      result = calculateHaversine(arena, &point_file.points, args->kernel, args->thread_count);
+      if (args->scaling) {
+        reportHaversineScaling(arena, &point_file.points, args->kernel, args->thread_count);
+      }
+      closePointFile(&point_file);
+    }
+  } else {
+    PointArray points = {};
+    if (args->pipeline) {
+      points = parseJsonPipelined(arena, scratch, args);
+    } else {
+      points = parseJsonFile(arena, scratch, args->json_path, &args->read_options,
+                             args->thread_count);
+    }
+    *num_points = points.num_points;
+    PointColumns columns = toPointColumns(arena, &points);
+    result = calculateHaversine(arena, &columns, args->kernel, args->thread_count);
+    if (args->scaling) {
+      reportHaversineScaling(arena, &columns, args->kernel, args->thread_count);
+    }
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Once the fused sum has stopped there's nothing to carry over
+u64 addFusedPipelineRecords(void *context, EntireFile *records, u32 first_line,
+                            bool is_last) {
+  (void)is_last;
+  FusedHaversine *fused = (FusedHaversine *)context;
+  u64 result = addFusedRecords(fused, records, first_line);
+
+  if (fused->stopped) {
+    result = records->size;
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Streams the input through the read pipeline (JSON) or reads it
+// a window at a time (.pts) and returns only the average. See perfaware_fused.h.
+bool calculateFusedAverage(Arena *scratch, Arguments *args, f64 *average, u64 *num_points) {
+  TimeFunction;
+  FusedHaversine fused = {};
+  bool result = beginFusedHaversine(&fused, scratch, args->kernel, args->answers_out_path);
+
+  if (result) {
+    if (isPointFile(args->json_path)) {
+      PointFileReader reader = {};
+      result = openPointFileReader(scratch, args->json_path, args->window_size,
+                                   args->verify_checksum, &reader);
+      if (result) {
+        while (readPointWindow(&reader)) {
+          addFusedColumns(&fused, &reader.window);
+        }
+        result = closePointFileReader(&reader);
+      }
+    } else {
+      result = runReadPipeline(scratch, args->json_path, args->buffer_size,
+                               addFusedPipelineRecords, &fused);
+    }
+
+    result = endFusedHaversine(&fused, average) && result;
+    *num_points = fused.num_points;
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Written so a NaN average (from no pairs at all) fails
+static bool checkFusedAverage(Arguments *args, u64 num_points, f64 average, f64 expected) {
+  bool result = false;
+
+  if (num_points == 0) {
+    fprintf(stderr, "ERROR: No pairs were parsed from %s\n", args->json_path);
+  } else if (!(fabs(average - expected) <= args->tolerance + 1e-12 * fabs(expected))) {
+    fprintf(stderr, "%.16f != %.16f\n", expected, average);
+  } else {
+    result = true;
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Only the average is kept, so that's all we can check. It gets
+// the usual --tolerance plus 1e-12 relative for the different summation order and
+// the kernel's error.
+bool runFused(Arena *scratch, Arguments *args) {
+  f64 average = 0;
+  f64 expected = 0;
+  u64 num_points = 0;
+  bool result = (calculateFusedAverage(scratch, args, &average, &num_points) &&
+                 readAnswersAverage(args->answers_path, &expected));
+
+  if (result) {
+    printf("Pairs: %llu, average: %.16f\n", (unsigned long long)num_points, average);
+    result = checkFusedAverage(args, num_points, average, expected);
+  }
+
+  return result;
+}
+
+struct IncrementalContext {
+  FusedHaversine *fused;
+  // NOTE(chogan): Where the next run starts in the file
+  u64 run_offset;
+  // NOTE(chogan): Just past the last complete record added so far
+  u64 records_end;
+  u32 records_end_line;
+  bool malformed;
+};
+
+u64 addIncrementalRecords(void *context, EntireFile *records, u32 first_line, bool is_last) {
+  IncrementalContext *ctx = (IncrementalContext *)context;
+  u64 result = records->size;
+
+  // NOTE(chogan): A run picks up where the last one's records ended, so the
+  // pipeline has already counted the lines up to there
+  if (ctx->records_end == ctx->run_offset) {
+    ctx->records_end_line = first_line;
+  }
+
+  if (!ctx->fused->stopped) {
+    u64 end = addFusedRecords(ctx->fused, records, first_line);
+    if (end) {
+      ctx->records_end = ctx->run_offset + end;
+      // NOTE(chogan): Otherwise the next run starts there
+      if (is_last || ctx->fused->stopped) {
+        ctx->records_end_line = first_line + (u32)countNewlines(records->data, end);
+      }
+    }
+    if (!ctx->fused->stopped) {
+      result = end;
+    }
+    // NOTE(chogan): Only the last run can end in something that isn't a record
+    ctx->malformed = ctx->fused->stopped && !is_last;
+  }
+  ctx->run_offset += result;
 
   return result;
 }
 
-bool verifyHaversine(Arena *scratch, f64 *answers, const char *filename, u32 num_points) {
+// NOTE(chogan): Just past the `[` that opens the pairs, and the line it's on
+static bool findRecordsOffset(InputFile *input, u64 input_size, u64 *offset, u32 *line) {
+  u8 header[KILOBYTES(4)];
+  u64 size = input_size < sizeof(header) ? input_size : sizeof(header);
+  bool result = readFileAt(input, 0, header, size);
+  u8 *open_brace = result ? (u8 *)memchr(header, '[', size) : NULL;
+
+  result = open_brace != NULL;
+  if (result) {
+    *offset = open_brace - header + 1;
+    *line = 1 + (u32)countNewlines(header, *offset);
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Resumes from the input's checkpoint (see perfaware_checkpoint.h)
+// if it still matches, parses only the records after it, and moves the
+// checkpoint to the new last record. The whole prefix is only rehashed with
+// --verify-checksum. Like --fused, only the average is checked, and the
+// checkpoint is only saved if it matches.
+bool runIncremental(Arena *scratch, Arguments *args) {
   TimeFunction;
-  ScopedTemporaryMemory file_memory(scratch);
-  EntireFile file = readEntireFile(file_memory, filename);
-  u8 *at = file.data;
+  u64 path_size = strlen(args->json_path) + sizeof(".ckpt");
+  char *checkpoint_path = (char *)pushSize(scratch, path_size);
+  snprintf(checkpoint_path, path_size, "%s.ckpt", args->json_path);
+
+  InputFile input = {};
+  u64 input_size = 0;
+  bool result = (getFileSize(args->json_path, &input_size) &&
+                 openInputFile(args->json_path, &input));
+
+  if (result) {
+    Checkpoint checkpoint = initCheckpoint();
+    if (readCheckpoint(checkpoint_path, &checkpoint)) {
+      if (validateCheckpoint(scratch, &input, input_size, &checkpoint, args->verify_checksum)) {
+        printf("Checkpoint: %llu pairs, resuming at byte %llu of %llu\n",
+               (unsigned long long)checkpoint.num_points,
+               (unsigned long long)checkpoint.input_offset, (unsigned long long)input_size);
+      } else {
+        printf("Checkpoint doesn't match %s, starting over\n", args->json_path);
+        checkpoint = initCheckpoint();
+      }
+    }
+
+    u64 records_offset = checkpoint.input_offset;
+    u32 records_line = (u32)checkpoint.input_line;
+    if (records_offset == 0 &&
+        !findRecordsOffset(&input, input_size, &records_offset, &records_line)) {
+      fprintf(stderr, "ERROR: No pairs in %s\n", args->json_path);
+      result = false;
+    }
+
+    FusedHaversine fused = {};
+    IncrementalContext context = {};
+    result = result && beginFusedHaversine(&fused, scratch, args->kernel, NULL);
+    if (result) {
+      fused.sum = checkpoint.sum;
+      fused.compensation = checkpoint.compensation;
+      fused.num_points = checkpoint.num_points;
+      context.fused = &fused;
+      context.run_offset = records_offset;
+      context.records_end = checkpoint.input_offset;
+      context.records_end_line = records_line;
+      result = runReadPipeline(scratch, args->json_path, args->buffer_size,
+                               addIncrementalRecords, &context, NULL, records_offset,
+                               records_line);
+    }
+    if (context.malformed) {
+      fprintf(stderr, "ERROR: Malformed record after byte %llu of %s\n",
+              (unsigned long long)context.records_end, args->json_path);
+      result = false;
+    }
+
+    f64 expected = 0;
+    f64 average = 0;
+    result = (result && readAnswersAverage(args->answers_path, &expected) &&
+              endFusedHaversine(&fused, &average));
+    if (result) {
+      printf("Pairs: %llu (%llu new), average: %.16f\n", (unsigned long long)fused.num_points,
+             (unsigned long long)(fused.num_points - checkpoint.num_points), average);
+      result = checkFusedAverage(args, fused.num_points, average, expected);
+    }
+
+    if (result) {
+      checkpoint.num_points = fused.num_points;
+      checkpoint.sum = fused.sum;
+      checkpoint.compensation = fused.compensation;
+      checkpoint.input_line = context.records_end_line;
+      result = (advanceCheckpoint(scratch, &input, &checkpoint, context.records_end) &&
+                writeCheckpoint(checkpoint_path, &checkpoint));
+    }
+    closeInputFile(&input);
+  }
+
+  return result;
+}
+
+// NOTE(chogan): The SIMD kernels aren't bit identical to ReferenceHaversine,
+// which produced the answers file, so their documented error bound is added to
+// the tolerance of any answer that's outside it. The average may move by as
+// much as the answers did on average, plus 1e-12 relative for the different
+// summation order.
+bool verifyHaversine(Arena *scratch, f64 *answers, u64 num_points, Arguments *args) {
+  TimeFunction;
+  ScopedTemporaryMemory scratch_memory(scratch);
+  AnswerArray expected = {};
+  FileReadOptions read_options = getInPlaceReadOptions(&args->read_options,
+                                                       args->read_backend_given);
+  bool result = openAnswers(scratch_memory, args->answers_path, &read_options, &expected);
+
+  if (result && expected.num_points != num_points) {
+    fprintf(stderr, "ERROR: %s has %llu answers, computed %llu\n", args->answers_path,
+            (unsigned long long)expected.num_points, (unsigned long long)num_points);
+    result = false;
+  }
+
+  if (result) {
+    AnswerTolerance tolerance = {};
+    tolerance.absolute = args->tolerance;
+    tolerance.ulps = args->ulps;
+    tolerance.kernel = args->kernel;
+
+    AnswerComparison comparison = {};
+    compareAnswers(scratch_memory, expected.values, answers, num_points, &tolerance,
+                   args->max_mismatches, args->thread_count, &comparison);
+
+    for (u32 i = 0; i < comparison.reported_count; ++i) {
+      AnswerMismatch *mismatch = comparison.reported + i;
+      fprintf(stderr, "answer %llu: %.16f != %.16f (%.3g, %llu ulps)\n",
+              (unsigned long long)mismatch->index, mismatch->expected, mismatch->actual,
+              mismatch->actual - mismatch->expected,
+              (unsigned long long)getUlpDistance(mismatch->expected, mismatch->actual));
+    }
+    if (comparison.mismatch_count > comparison.reported_count) {
+      fprintf(stderr, "... and %llu more\n",
+              (unsigned long long)(comparison.mismatch_count - comparison.reported_count));
+    }
+
+    f64 expected_average = expected.values[num_points];
+    f64 average = answers[num_points];
+    f64 average_shift = num_points ? fabs(comparison.difference_sum) / (f64)num_points : 0;
+    f64 average_tolerance = args->tolerance + 1e-12 * fabs(expected_average) + average_shift;
+    bool average_matches = (fabs(average - expected_average) <= average_tolerance ||
+                            getUlpDistance(expected_average, average) <= args->ulps);
+    if (!average_matches) {
+      fprintf(stderr, "average: %.16f != %.16f\n", expected_average, average);
+    }
+
+    result = comparison.mismatch_count == 0 && average_matches;
+  }
+  closeAnswers(&expected);
+
+  return result;
+}
+
+struct MemoryPlan {
+  u64 arena_size;
+  u64 scratch_size;
+};
+
+const u64 kArenaSlack = MEGABYTES(16);
+const u64 kStreamingSlack = MEGABYTES(1);
+const u64 kMinStreamingBufferSize = KILOBYTES(256);
+
+// NOTE(chogan): What a whole read of a file takes out of an arena. Mapped
+// files are page cache, not arena memory.
+static u64 getReadSize(FileReadOptions *options, u64 file_size) {
+  u64 result = 0;
+  if (options->backend != FileBackend_Mmap) {
+    result = file_size + 2 * kDirectAlignment;
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Upper bounds on what reading everything into memory can use,
+// from the input's size (or a point file's count) alone, so the arenas can
+// never run out on well formed input. They're only reserved, so pages that
+// aren't needed cost nothing.
+MemoryPlan planInMemoryRun(Arguments *args) {
+  MemoryPlan result = {};
+  u64 input_size = getFileSizeOrZero(args->json_path);
+  u64 answers_size = getFileSizeOrZero(args->answers_path);
+  FileReadOptions mapped_options = getInPlaceReadOptions(&args->read_options,
+                                                         args->read_backend_given);
+  u64 max_points = 0;
+
+  if (isPointFile(args->json_path)) {
+    PointFileHeader header = {};
+    readPointFileHeader(args->json_path, &header);
+    max_points = header.num_points;
+    result.scratch_size += getReadSize(&mapped_options, input_size);
+    if (args->verify_checksum) {
+      result.scratch_size += (kPointFileColumnCount * getChecksumBlockCount(max_points) *
+                              sizeof(u64));
+    }
+  } else {
+    max_points = getMaxRecordCount(input_size);
+    if (args->pipeline) {
+      u64 run_size = kMaxCarrySize + args->buffer_size;
+      result.scratch_size += (2 * run_size + getMaxTokenBytes(run_size) +
+                              getMaxRecordCount(run_size) * sizeof(Point));
+    } else {
+      result.scratch_size += (getReadSize(&args->read_options, input_size) +
+                              getMaxTokenBytes(input_size) + max_points * sizeof(Point));
+    }
+    // NOTE(chogan): The parsed points and their columns
+    result.arena_size += 2 * max_points * sizeof(Point);
+  }
+
+  u64 answers_bytes = (max_points + 1) * sizeof(f64);
+  u64 block_sums_bytes = (max_points / kHaversineBlockSize + 1) * sizeof(f64);
+  result.arena_size += answers_bytes + block_sums_bytes;
+  if (args->scaling) {
+    result.arena_size += answers_bytes + block_sums_bytes;
+  }
+
+  // NOTE(chogan): Verification. A text answers file is parsed into `scratch`.
+  result.scratch_size += (getReadSize(&mapped_options, answers_size) + answers_size / 2 *
+                          sizeof(f64) + args->thread_count * sizeof(AnswerComparison));
+  if (args->compare_reads) {
+    result.scratch_size += input_size + 2 * kDirectAlignment;
+  }
+  if (args->roofline) {
+    result.scratch_size += getRooflineScratchSize(args->thread_count);
+  }
+
+  result.arena_size += kArenaSlack;
+  result.scratch_size += kArenaSlack + args->thread_count * MEGABYTES(1);
+
+  return result;
+}
+
+MemoryPlan planStreamingRun(Arguments *args) {
+  MemoryPlan result = {};
+  result.arena_size = kStreamingSlack;
+  result.scratch_size = (2 * (kMaxCarrySize + args->buffer_size) + getFusedScratchSize() +
+                         kStreamingSlack);
+  if (args->incremental) {
+    result.scratch_size += kCheckpointHashChunk;
+  }
+
+  if (isPointFile(args->json_path)) {
+    PointFileHeader header = {};
+    readPointFileHeader(args->json_path, &header);
+    result.scratch_size += args->window_size * sizeof(Point);
+    if (args->verify_checksum) {
+      result.scratch_size += (kPointFileColumnCount * getChecksumBlockCount(header.num_points) *
+                              sizeof(u64));
+    }
+  }
+  if (args->compare_reads) {
+    result.scratch_size += getFileSizeOrZero(args->json_path) + 2 * kDirectAlignment;
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Shrinks the read buffers and the point window until a streaming
+// run fits in the budget. Everything else it needs is a fixed size.
+bool fitStreamingBudget(Arguments *args) {
   bool result = true;
 
-  for (u32 i = 0; i < num_points + 1; ++i) {
-    f64 answer = atof((const char *)at);
-    while (*at++ != '\n');
-    if (fabs(answer - answers[i]) > 0.00000001) {
-      fprintf(stderr, "%.16f != %.16f\n", answer, answers[i]);
+  if (args->memory_budget) {
+    MemoryPlan plan = planStreamingRun(args);
+    while (plan.arena_size + plan.scratch_size > args->memory_budget &&
+           (args->buffer_size > kMinStreamingBufferSize ||
+            args->window_size > kPointFileChecksumBlockSize)) {
+      if (args->buffer_size > kMinStreamingBufferSize) {
+        args->buffer_size /= 2;
+        if (args->buffer_size < kMinStreamingBufferSize) {
+          args->buffer_size = kMinStreamingBufferSize;
+        }
+      }
+      if (args->window_size > kPointFileChecksumBlockSize) {
+        args->window_size /= 2;
+      }
+      plan = planStreamingRun(args);
+    }
+
+    if (plan.arena_size + plan.scratch_size > args->memory_budget) {
+      fprintf(stderr, "ERROR: Streaming %s needs at least %.1fmb\n", args->json_path,
+              (plan.arena_size + plan.scratch_size) / (1024.0 * 1024.0));
       result = false;
-      break;
     }
   }
 
   return result;
 }
 
+// NOTE(chogan): The stages an in memory run goes through, each against the
+// roof that limits it. The JSON stages are measured in input bytes.
+void printRunRoofline(Roofline *roofline, Arguments *args, u64 num_points) {
+  // NOTE(chogan): The single threaded JSON path has the most stages
+  RooflineStage stages[5] = {};
+  u32 stage_count = 0;
+  u64 input_size = getFileSizeOrZero(args->json_path);
+  bool all_cores = args->thread_count > 1;
+
+  if (isPointFile(args->json_path)) {
+    stages[stage_count++] = {"openPointFile", RooflineLimit_Read, input_size, 0};
+  } else {
+    stages[stage_count++] = {"readEntireFile", RooflineLimit_Read, input_size, 0};
+    if (all_cores) {
+      stages[stage_count++] = {"parseJsonChunks", RooflineLimit_AllCoreRead, input_size, 0};
+    } else {
+      stages[stage_count++] = {"tokenize", RooflineLimit_Read, input_size, 0};
+      stages[stage_count++] = {"parseTokens", RooflineLimit_Read, input_size, 0};
+    }
+  }
+  stages[stage_count++] = {"calculateHaversine",
+                           all_cores ? RooflineLimit_AllCoreHaversine : RooflineLimit_Haversine,
+                           0, num_points};
+  // NOTE(chogan): The expected answers and the computed ones
+  stages[stage_count++] = {"verifyHaversine", RooflineLimit_Read, 2 * num_points * sizeof(f64), 0};
+  assert(stage_count <= ArrayCount(stages));
+
+  printRooflineReport(roofline, stages, stage_count);
+}
+
 int main(int argc, char **argv) {
 
-  if (argc == 3) {
+  Arguments args = {};
+
+  if (parseArguments(argc, argv, &args)) {
     BeginProfile;
 
-    const char *file_path = argv[1];
-    const char *answers_filename = argv[2];
-    Arena arena = initArenaAndAllocate(GIGABYTES(1));
-    Arena scratch = initArenaAndAllocate(GIGABYTES(6));
+    // NOTE(chogan): Anything that can't be done in memory within the budget is
+    // streamed instead, which only checks the average.
+    MemoryPlan plan = planInMemoryRun(&args);
+    u64 in_memory_size = plan.arena_size + plan.scratch_size;
+    if (!args.fused && (args.stream || (args.memory_budget && in_memory_size > args.memory_budget))) {
+      if (!args.stream) {
+        printf("In memory needs up to %.1fmb, over the %.1fmb budget. Streaming instead.\n",
+               in_memory_size / (1024.0 * 1024.0), args.memory_budget / (1024.0 * 1024.0));
+      }
+      args.fused = true;
+      if (args.roofline) {
+        printf("No roofline for a streaming run.\n");
+        args.roofline = false;
+      }
+    }
+    if (args.fused || args.incremental) {
+      if (!fitStreamingBudget(&args)) {
+        exit(1);
+      }
+      plan = planStreamingRun(&args);
+    }
+
+    Arena arena = initArenaAndAllocate(plan.arena_size);
+    Arena scratch = initArenaAndAllocate(plan.scratch_size);
+
+    if (args.compare_reads) {
+      printf("Read backends (%s):\n", args.json_path);
+      compareReadBackends(&scratch, args.json_path, &args.read_options);
+    }
+
+    printf("Haversine kernel: %s, instruction set: %s", kHaversineKernelNames[args.kernel],
+           kCpuIsaNames[getCpuIsa()]);
+    if (getCpuIsa() != getDetectedCpuIsa()) {
+      printf(" (forced, detected %s)", kCpuIsaNames[getDetectedCpuIsa()]);
+    }
+    printf("\n");
 
-    PointArray points = parseJson(&arena, &scratch, file_path);
+    Roofline roofline = {};
+    if (args.roofline) {
+      roofline = measureRoofline(&scratch, args.kernel, args.thread_count);
+    }
+    u64 num_points = 0;
 
-    f64 *answers = calculateHaversine(&arena, points.data, points.num_points);
+    if (args.incremental) {
+      if (!runIncremental(&scratch, &args)) {
+        fprintf(stderr, "Test failed\n");
+        exit(1);
+      }
+    } else if (args.fused) {
+      if (!runFused(&scratch, &args)) {
+        fprintf(stderr, "Test failed\n");
+        exit(1);
+      }
+    } else {
+      f64 *answers = calculateAnswers(&arena, &scratch, &args, &num_points);
 
-    if (!verifyHaversine(&scratch, answers, answers_filename, points.num_points)) {
-      fprintf(stderr, "Test failed\n");
-      exit(1);
+      if (!answers || !verifyHaversine(&scratch, answers, num_points, &args)) {
+        fprintf(stderr, "Test failed\n");
+        exit(1);
+      }
     }
 
+    destroyArena(&scratch);
     destroyArena(&arena);
 
     EndAndPrintProfile;
+
+    if (args.roofline) {
+      printRunRoofline(&roofline, &args, num_points);
+    }
   } else {
-    fprintf(stderr, "USAGE: %s <JSON_path> <haversine_answers_path>\n", argv[0]);
+    fprintf(stderr, "USAGE: %s [--threads N] [--pipeline [--buffer-mb N]] "
+            "[--read fread|read|pread|mmap|direct|io_uring] [--populate] "
+            "[--madvise none|sequential|willneed|hugepage] [--queue-depth N] "
+            "[--compare-reads] [--verify-checksum] [--kernel reference|avx2|avx512] "
+            "[--isa scalar|sse4.2|avx2|avx512] [--scaling] "
+            "[--fused [--answers-out path]] [--tolerance abs] [--ulps N] [--max-mismatches N] "
+            "[--memory-mb N] [--stream] [--incremental] [--roofline] "
+            "<JSON_or_pts_path> <haversine_answers_path>\n",
+            argv[0]);
   }
 
   return 0;
@@ -0,0 +1,216 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ArrayCount(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef double f64;
+
+#include "perfaware_timer.h"
+#include "perfaware_memory.h"
+#include "perfaware_haversine.h"
+#include "perfaware_math.h"
+#include "perfaware_cpu.h"
+#include "perfaware_float_parser.h"
+#include "perfaware_thread.h"
+#include "perfaware_file.h"
+#include "perfaware_json_parser.h"
+#include "perfaware_json_cursor.h"
+#include "perfaware_json_schema.h"
+
+#include "listing_0065_haversine_formula.cpp"
+#include "perfaware_haversine.cpp"
+#include "perfaware_memory.cpp"
+#include "perfaware_cpu.cpp"
+#include "perfaware_math.cpp"
+#include "perfaware_float_parser.cpp"
+#include "perfaware_thread.cpp"
+#include "perfaware_file.cpp"
+#include "perfaware_json_parser.cpp"
+#include "perfaware_json_cursor.cpp"
+#include "perfaware_timer.cpp"
+
+// NOTE(chogan): Checks the parts of the JSON cursor the haversine schema
+// doesn't exercise (arrays, escapes and true/false/null) against every
+// tokenizer this machine can run, since each one builds its own tape.
+struct Tokenizer {
+  const char *name;
+  ClassifyBlockFunc *classify;
+  bool available;
+};
+
+static u32 failure_count;
+
+static void check(bool condition, const char *tokenizer, const char *what) {
+  if (!condition) {
+    fprintf(stderr, "FAILED (%s): %s\n", tokenizer, what);
+    failure_count++;
+  }
+}
+
+static TokenArray tokenizeText(Arena *arena, Tokenizer *tokenizer, const char *text) {
+  EntireFile file = {};
+  file.data = (u8 *)text;
+  file.size = strlen(text);
+
+  TokenArray result = {};
+  if (tokenizer->classify) {
+    result = tokenizeBlocks(arena, &file, tokenizer->classify, true, NULL);
+  } else {
+    result = tokenizeScalar(arena, &file, true, NULL);
+  }
+
+  return result;
+}
+
+static bool unescapedEquals(Arena *arena, JsonValue value, const char *expected) {
+  JsonString string = {};
+  bool result = getJsonString(value, &string);
+
+  if (result) {
+    char *dest = pushArray<char>(arena, string.size + 1);
+    u32 size = 0;
+    result = (unescapeJsonString(&string, dest, &size) && size == strlen(expected) &&
+              memcmp(dest, expected, size) == 0);
+  }
+
+  return result;
+}
+
+static void testDocument(Arena *arena, Tokenizer *tokenizer) {
+  ScopedTemporaryMemory temp(arena);
+  const char *name = tokenizer->name;
+  // NOTE(chogan): The spaces push "false" across the first 64 byte block
+  const char *text =
+    "{\"s\":\"a\\\"b\\\\\\u00e9\\ud83d\\ude00\",                            \"f\":false,"
+    "\"t\":true,\"n\":null,\"arr\":[1,[2,[3]],{\"k\":[4]},\"x\",true,null],"
+    "\"e\":[],\"last\":-2.5}";
+  TokenArray tokens = tokenizeText(temp, tokenizer, text);
+  check(tokens.error_count == 0, name, "document tokenizes cleanly");
+
+  JsonValue root = getJsonRoot(&tokens);
+  JsonValue value = {};
+  bool flag = false;
+
+  check(findJsonField(root, "s", &value) &&
+        unescapedEquals(temp, value, "a\"b\\\xc3\xa9\xf0\x9f\x98\x80"),
+        name, "escapes and surrogate pairs unescape to UTF-8");
+
+  check(findJsonField(root, "f", &value) && getJsonBool(value, &flag) && !flag,
+        name, "false reads as false");
+  check(findJsonField(root, "t", &value) && getJsonBool(value, &flag) && flag,
+        name, "true reads as true");
+  check(findJsonField(root, "n", &value) && isJsonNull(value) && !getJsonBool(value, &flag),
+        name, "null is null and not a bool");
+
+  JsonValue array = {};
+  check(findJsonField(root, "arr", &array) && getJsonType(array) == JsonType_Array,
+        name, "arr is an array");
+  JsonIterator it = iterateJsonArray(array);
+  JsonType expected_types[] = {JsonType_Number, JsonType_Array, JsonType_Object,
+                               JsonType_String, JsonType_Bool, JsonType_Null};
+  u32 element_count = 0;
+  while (nextJsonElement(&it, &value)) {
+    if (element_count < ArrayCount(expected_types)) {
+      check(getJsonType(value) == expected_types[element_count], name,
+            "array elements have the right types");
+    }
+    if (element_count == 2) {
+      JsonValue inner = {};
+      check(findJsonField(value, "k", &inner) && getJsonType(inner) == JsonType_Array,
+            name, "object inside an array can be searched");
+    }
+    element_count++;
+  }
+  check(!it.failed && element_count == ArrayCount(expected_types), name,
+        "array iteration skips nested values");
+
+  JsonValue empty = {};
+  check(findJsonField(root, "e", &empty), name, "e is found");
+  it = iterateJsonArray(empty);
+  check(!nextJsonElement(&it, &value) && !it.failed, name, "empty array has no elements");
+
+  f64 number = 0;
+  check(findJsonField(root, "last", &value) && getJsonNumber(value, &number) &&
+        number == -2.5, name, "member after nested values is found");
+}
+
+static void testLiterals(Arena *arena, Tokenizer *tokenizer) {
+  const char *name = tokenizer->name;
+  const char *misspelled[] = {
+    "{\"a\":nope}",
+    "{\"a\":truee}",
+    "{\"a\":fals }",
+    "{\"a\":nul,\"b\":1}",
+    "{\"a\":True}",
+  };
+
+  for (u32 i = 0; i < ArrayCount(misspelled); ++i) {
+    ScopedTemporaryMemory temp(arena);
+    TokenArray tokens = tokenizeText(temp, tokenizer, misspelled[i]);
+    check(tokens.error_count > 0, name, misspelled[i]);
+  }
+
+  {
+    // NOTE(chogan): Input can stop partway into a record, so a cut off word is
+    // left for the reader to turn down
+    ScopedTemporaryMemory temp(arena);
+    TokenArray tokens = tokenizeText(temp, tokenizer, "{\"a\":tr");
+    JsonValue value = {};
+    bool flag = false;
+    check(tokens.error_count == 0, name, "a word cut off by the end isn't an error");
+    check(findJsonField(getJsonRoot(&tokens), "a", &value) && !getJsonBool(value, &flag),
+          name, "a word cut off by the end doesn't read as a bool");
+  }
+
+  {
+    ScopedTemporaryMemory temp(arena);
+    TokenArray tokens = tokenizeText(temp, tokenizer, "{\"a\":\"\\x\",\"b\":\"\\ud83d\"}");
+    JsonValue value = {};
+    JsonString string = {};
+    char dest[16];
+    u32 size = 0;
+    check(findJsonField(getJsonRoot(&tokens), "a", &value) && getJsonString(value, &string) &&
+          !unescapeJsonString(&string, dest, &size), name, "an unknown escape fails");
+    check(findJsonField(getJsonRoot(&tokens), "b", &value) && getJsonString(value, &string) &&
+          !unescapeJsonString(&string, dest, &size), name, "a lone surrogate fails");
+  }
+}
+
+int main() {
+  Arena arena = initArenaAndAllocate(MEGABYTES(1));
+  CpuFeatures *cpu = getCpuFeatures();
+  Tokenizer tokenizers[] = {
+    {"scalar", NULL, true},
+    {"avx2", classifyBlockAvx2, cpu->avx2},
+    {"avx512", classifyBlockAvx512, cpu->avx512bw},
+  };
+
+  for (u32 i = 0; i < ArrayCount(tokenizers); ++i) {
+    if (tokenizers[i].available) {
+      testDocument(&arena, tokenizers + i);
+      testLiterals(&arena, tokenizers + i);
+      printf("%s tokenizer checked\n", tokenizers[i].name);
+    }
+  }
+
+  destroyArena(&arena);
+
+  if (failure_count) {
+    fprintf(stderr, "ERROR: %u checks failed\n", failure_count);
+  }
+
+  return failure_count ? 1 : 0;
+}
@@ -0,0 +1,262 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ArrayCount(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef double f64;
+typedef uint32_t b32;
+
+#include "perfaware_timer.h"
+#include "perfaware_timer.cpp"
+#include "perfaware_memory.h"
+#include "perfaware_memory.cpp"
+#include "perfaware_cpu.h"
+#include "perfaware_cpu.cpp"
+#include "perfaware_math.h"
+#include "perfaware_math.cpp"
+#include "listing_0103_repetition_tester.cpp"
+
+typedef f64 ApproxFunc(f64 x, MathAccuracy accuracy);
+typedef f64 LibmFunc(f64 x);
+
+// NOTE(chogan): The domains are what the haversine formula feeds each
+// function, so that's what the sweep covers.
+struct MathFunction {
+  const char *name;
+  ApproxFunc *approx;
+  LibmFunc *reference;
+  f64 min;
+  f64 max;
+};
+
+static f64 libmSin(f64 x) { return sin(x); }
+static f64 libmCos(f64 x) { return cos(x); }
+static f64 libmAsin(f64 x) { return asin(x); }
+static f64 libmSqrt(f64 x) { return sqrt(x); }
+
+MathFunction math_functions[] = {
+  {"sin", sinRanged, libmSin, -3.141592653589793, 3.141592653589793},
+  {"cos", cosRanged, libmCos, -3.141592653589793, 3.141592653589793},
+  {"asin", asinRanged, libmAsin, -1.0, 1.0},
+  {"sqrt", sqrtRanged, libmSqrt, 0.0, 1.0},
+};
+
+// NOTE(chogan): What each tier promises, as a max relative error
+const f64 kTierTargets[MathAccuracy_Count] = {
+  1e-15,
+  1e-12,
+  1e-8,
+};
+
+struct ErrorStats {
+  f64 max_abs;
+  f64 max_rel;
+  f64 max_rel_at;
+  u64 max_ulps;
+};
+
+static u64 ulpDistance(f64 a, f64 b) {
+  s64 ia = 0;
+  s64 ib = 0;
+  memcpy(&ia, &a, sizeof(a));
+  memcpy(&ib, &b, sizeof(b));
+  // NOTE(chogan): Map the sign-magnitude bits onto a monotonic integer line
+  if (ia < 0) {
+    ia = (s64)0x8000000000000000ULL - ia;
+  }
+  if (ib < 0) {
+    ib = (s64)0x8000000000000000ULL - ib;
+  }
+  u64 result = ia > ib ? (u64)(ia - ib) : (u64)(ib - ia);
+
+  return result;
+}
+
+static void accumulateError(ErrorStats *stats, f64 x, f64 approx, f64 expected) {
+  f64 abs_error = fabs(approx - expected);
+  if (abs_error > stats->max_abs) {
+    stats->max_abs = abs_error;
+  }
+
+  if (expected != 0) {
+    f64 rel_error = abs_error / fabs(expected);
+    if (rel_error > stats->max_rel) {
+      stats->max_rel = rel_error;
+      stats->max_rel_at = x;
+    }
+  }
+
+  u64 ulps = ulpDistance(approx, expected);
+  if (ulps > stats->max_ulps) {
+    stats->max_ulps = ulps;
+  }
+}
+
+// NOTE(chogan): Evenly spaced samples across the domain plus the endpoints and
+// a dense sweep near zero, where relative error is hardest to keep.
+static ErrorStats sweepFunction(MathFunction *func, MathAccuracy accuracy, u64 sample_count) {
+  ErrorStats result = {};
+  f64 step = (func->max - func->min) / (f64)(sample_count - 1);
+
+  for (u64 i = 0; i < sample_count; ++i) {
+    f64 x = i == sample_count - 1 ? func->max : func->min + step * (f64)i;
+    accumulateError(&result, x, func->approx(x, accuracy), func->reference(x));
+  }
+
+  for (f64 x = 1e-30; x < 1e-2; x *= 1.01) {
+    accumulateError(&result, x, func->approx(x, accuracy), func->reference(x));
+    if (func->min < 0) {
+      accumulateError(&result, -x, func->approx(-x, accuracy), func->reference(-x));
+    }
+  }
+
+  return result;
+}
+
+static bool reportAccuracy(u64 sample_count) {
+  bool result = true;
+
+  printf("%-6s %-6s %12s %12s %22s %10s\n", "func", "tier", "max abs", "max rel",
+         "(at x)", "max ulps");
+  for (u32 i = 0; i < ArrayCount(math_functions); ++i) {
+    MathFunction *func = math_functions + i;
+    for (u32 tier = 0; tier < MathAccuracy_Count; ++tier) {
+      ErrorStats stats = sweepFunction(func, (MathAccuracy)tier, sample_count);
+      bool ok = stats.max_rel <= kTierTargets[tier];
+      result = result && ok;
+      printf("%-6s %-6s %12.3e %12.3e %22.17g %10llu%s\n", func->name,
+             kMathAccuracyNames[tier], stats.max_abs, stats.max_rel, stats.max_rel_at,
+             (unsigned long long)stats.max_ulps, ok ? "" : "  <-- over target");
+    }
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Small enough to stay in L1, so the benchmarks measure the math
+// and not the loads.
+const u32 kBenchmarkCount = 4096;
+
+struct BenchmarkParams {
+  f64 inputs[kBenchmarkCount];
+  f64 sink;
+};
+
+template<LibmFunc *Func>
+void benchmarkLibm(repetition_tester *tester, BenchmarkParams *params) {
+  while (IsTesting(tester)) {
+    f64 sum = 0;
+
+    BeginTime(tester);
+    for (u32 i = 0; i < kBenchmarkCount; ++i) {
+      sum += Func(params->inputs[i]);
+    }
+    EndTime(tester);
+
+    CountBytes(tester, sizeof(params->inputs));
+    params->sink += sum;
+  }
+}
+
+template<ApproxFunc *Func, MathAccuracy accuracy>
+void benchmarkApprox(repetition_tester *tester, BenchmarkParams *params) {
+  while (IsTesting(tester)) {
+    f64 sum = 0;
+
+    BeginTime(tester);
+    for (u32 i = 0; i < kBenchmarkCount; ++i) {
+      sum += Func(params->inputs[i], accuracy);
+    }
+    EndTime(tester);
+
+    CountBytes(tester, sizeof(params->inputs));
+    params->sink += sum;
+  }
+}
+
+typedef void BenchmarkFunc(repetition_tester *tester, BenchmarkParams *params);
+
+struct Benchmark {
+  const char *name;
+  u32 function_index;
+  BenchmarkFunc *func;
+};
+
+Benchmark benchmarks[] = {
+  {"sin libm", 0, benchmarkLibm<libmSin>},
+  {"sin full", 0, benchmarkApprox<sinRanged, MathAccuracy_Full>},
+  {"sin 1e-12", 0, benchmarkApprox<sinRanged, MathAccuracy_1e12>},
+  {"sin 1e-8", 0, benchmarkApprox<sinRanged, MathAccuracy_1e8>},
+  {"cos libm", 1, benchmarkLibm<libmCos>},
+  {"cos full", 1, benchmarkApprox<cosRanged, MathAccuracy_Full>},
+  {"cos 1e-12", 1, benchmarkApprox<cosRanged, MathAccuracy_1e12>},
+  {"cos 1e-8", 1, benchmarkApprox<cosRanged, MathAccuracy_1e8>},
+  {"asin libm", 2, benchmarkLibm<libmAsin>},
+  {"asin full", 2, benchmarkApprox<asinRanged, MathAccuracy_Full>},
+  {"asin 1e-12", 2, benchmarkApprox<asinRanged, MathAccuracy_1e12>},
+  {"asin 1e-8", 2, benchmarkApprox<asinRanged, MathAccuracy_1e8>},
+  {"sqrt libm", 3, benchmarkLibm<libmSqrt>},
+  {"sqrt full", 3, benchmarkApprox<sqrtRanged, MathAccuracy_Full>},
+  {"sqrt 1e-12", 3, benchmarkApprox<sqrtRanged, MathAccuracy_1e12>},
+  {"sqrt 1e-8", 3, benchmarkApprox<sqrtRanged, MathAccuracy_1e8>},
+};
+
+int main(int argc, char **argv) {
+  u64 sample_count = 10000000;
+  u32 seconds_to_try = 2;
+
+  if (argc > 1) {
+    sample_count = atoll(argv[1]);
+  }
+  if (argc > 2) {
+    seconds_to_try = (u32)atoi(argv[2]);
+  }
+
+  if (argc <= 3 && sample_count > 1) {
+    printf("--- Accuracy against libm (%llu samples per function) ---\n",
+           (unsigned long long)sample_count);
+    bool accurate = reportAccuracy(sample_count);
+
+    u64 cpu_timer_freq = estimateCPUFrequency();
+    BenchmarkParams *params = (BenchmarkParams *)malloc(sizeof(BenchmarkParams));
+
+    for (u32 i = 0; i < ArrayCount(benchmarks); ++i) {
+      Benchmark *benchmark = benchmarks + i;
+      MathFunction *func = math_functions + benchmark->function_index;
+
+      // NOTE(chogan): Spread the inputs over the whole domain in a scrambled
+      // order so branchy implementations can't predict the path.
+      for (u32 j = 0; j < kBenchmarkCount; ++j) {
+        u32 scrambled = (j * 2654435761u) % kBenchmarkCount;
+        params->inputs[j] = func->min + (func->max - func->min) * scrambled / (kBenchmarkCount - 1);
+      }
+
+      repetition_tester tester = {};
+      printf("\n--- %s (%u calls) ---\n", benchmark->name, kBenchmarkCount);
+      NewTestWave(&tester, sizeof(params->inputs), cpu_timer_freq, seconds_to_try);
+      benchmark->func(&tester, params);
+      printf("%.2f cycles/call\n", (f64)tester.Results.MinTime / kBenchmarkCount);
+    }
+
+    free(params);
+
+    if (!accurate) {
+      fprintf(stderr, "ERROR: Some tiers are over their accuracy target\n");
+      return 1;
+    }
+  } else {
+    fprintf(stderr, "USAGE: %s [samples_per_function] [seconds_to_try]\n", argv[0]);
+  }
+
+  return 0;
+}
@@ -0,0 +1,416 @@
+#include <stdio.h>
+
+#include "perfaware_answers.h"
+#include "perfaware_cpu.h"
+#include "perfaware_file.h"
+#include "perfaware_float_parser.h"
+#include "perfaware_haversine.h"
+#include "perfaware_thread.h"
+
+AnswersFileHeader initAnswersFileHeader(u64 num_points) {
+  AnswersFileHeader result = {};
+  result.magic = kAnswersFileMagic;
+  result.version = kAnswersFileVersion;
+  result.num_points = num_points;
+
+  return result;
+}
+
+bool writeAnswersFile(const char *path, f64 *answers, u64 num_points) {
+  TimeBandwidth(__func__, (num_points + 1) * sizeof(f64));
+  bool result = false;
+  FILE *file = fopen(path, "wb");
+
+  if (file) {
+    AnswersFileHeader header = initAnswersFileHeader(num_points);
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(answers, (num_points + 1) * sizeof(f64), 1, file) == 1;
+    result = fclose(file) == 0 && ok;
+
+    if (!result) {
+      fprintf(stderr, "ERROR: Failed writing %s\n", path);
+    }
+  } else {
+    fprintf(stderr, "ERROR: Couldn't open file %s\n", path);
+  }
+
+  return result;
+}
+
+bool isAnswersFile(const char *path) {
+  bool result = false;
+  FILE *file = fopen(path, "rb");
+
+  if (file) {
+    u32 magic = 0;
+    result = fread(&magic, sizeof(magic), 1, file) == 1 && magic == kAnswersFileMagic;
+    fclose(file);
+  }
+
+  return result;
+}
+
+static bool openBinaryAnswers(const char *path, AnswerArray *answers) {
+  bool result = false;
+  AnswersFileHeader *header = (AnswersFileHeader *)answers->file.data;
+  u64 values_size = answers->file.size - sizeof(AnswersFileHeader);
+
+  if (header->version != kAnswersFileVersion) {
+    fprintf(stderr, "ERROR: %s is answers file version %u, expected %u\n", path,
+            header->version, kAnswersFileVersion);
+  } else if (values_size / sizeof(f64) < header->num_points + 1) {
+    fprintf(stderr, "ERROR: %s is truncated\n", path);
+  } else if ((uintptr_t)answers->file.data % sizeof(f64) != 0) {
+    fprintf(stderr, "ERROR: %s was loaded at a misaligned address\n", path);
+  } else {
+    answers->values = (f64 *)(answers->file.data + sizeof(AnswersFileHeader));
+    answers->num_points = header->num_points;
+    result = true;
+  }
+
+  return result;
+}
+
+// NOTE(chogan): One value per line. Blank lines (like a trailing CRLF) are
+// skipped.
+static bool parseTextAnswers(Arena *arena, const char *path, AnswerArray *answers) {
+  TimeBandwidth(__func__, answers->file.size);
+  u8 *begin = answers->file.data;
+  u8 *end = begin + answers->file.size;
+  u64 line_count = 0;
+
+  for (u8 *at = begin; at < end; ++at) {
+    line_count += *at == '\n';
+  }
+  line_count++;
+
+  f64 *values = pushArray<f64>(arena, line_count);
+  u64 count = 0;
+  u8 *at = begin;
+
+  while (at < end) {
+    u8 *line_end = (u8 *)memchr(at, '\n', end - at);
+    if (!line_end) {
+      line_end = end;
+    }
+    u8 *value_end = line_end;
+    while (value_end > at && (value_end[-1] == '\r' || value_end[-1] == ' ')) {
+      value_end--;
+    }
+    if (value_end > at) {
+      values[count++] = parseF64((const char *)at, value_end - at);
+    }
+    at = line_end + 1;
+  }
+
+  bool result = count > 0;
+  if (result) {
+    answers->values = values;
+    answers->num_points = count - 1;
+  } else {
+    fprintf(stderr, "ERROR: %s has no answers\n", path);
+  }
+
+  return result;
+}
+
+bool openAnswers(Arena *arena, const char *path, FileReadOptions *options, AnswerArray *result) {
+  TimeFunction;
+  bool success = false;
+  *result = {};
+  result->file = readEntireFile(arena, path, options);
+
+  if (result->file.data) {
+    u32 magic = 0;
+    if (result->file.size >= sizeof(AnswersFileHeader)) {
+      memcpy(&magic, result->file.data, sizeof(magic));
+    }
+
+    if (magic == kAnswersFileMagic) {
+      success = openBinaryAnswers(path, result);
+    } else {
+      success = parseTextAnswers(arena, path, result);
+      // NOTE(chogan): The parsed values are in `arena`, the text isn't needed
+      releaseEntireFile(&result->file);
+    }
+  }
+
+  if (!success) {
+    closeAnswers(result);
+  }
+
+  return success;
+}
+
+void closeAnswers(AnswerArray *answers) {
+  releaseEntireFile(&answers->file);
+  answers->values = 0;
+  answers->num_points = 0;
+}
+
+// NOTE(chogan): For a text file the average is the last line, so only the tail
+// of the file is read.
+static bool readTextAverage(FILE *file, u64 file_size, f64 *average) {
+  bool result = false;
+  char tail[128] = {};
+  u64 tail_size = file_size < sizeof(tail) - 1 ? file_size : sizeof(tail) - 1;
+
+  if (seekFile(file, file_size - tail_size) &&
+      fread(tail, tail_size, 1, file) == 1) {
+    char *end = tail + tail_size;
+    while (end > tail && (end[-1] == '\n' || end[-1] == '\r')) {
+      end--;
+    }
+    char *line = end;
+    while (line > tail && line[-1] != '\n') {
+      line--;
+    }
+    if (line < end) {
+      *average = parseF64(line, end - line);
+      result = true;
+    }
+  }
+
+  return result;
+}
+
+bool readAnswersAverage(const char *path, f64 *average) {
+  bool result = false;
+  FILE *file = fopen(path, "rb");
+
+  if (file) {
+    AnswersFileHeader header = {};
+    u64 file_size = 0;
+    getFileSize(path, &file_size);
+
+    if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == kAnswersFileMagic) {
+      u64 offset = sizeof(header) + header.num_points * sizeof(f64);
+      result = (header.version == kAnswersFileVersion && seekFile(file, offset) &&
+                fread(average, sizeof(f64), 1, file) == 1);
+    } else {
+      result = readTextAverage(file, file_size, average);
+    }
+    fclose(file);
+  }
+
+  if (!result) {
+    fprintf(stderr, "ERROR: Couldn't read the average from %s\n", path);
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Maps the sign-magnitude bit pattern onto a monotonic integer
+// line, so neighbouring doubles are 1 apart, including across zero.
+u64 getUlpDistance(f64 a, f64 b) {
+  u64 result = ~0ULL;
+
+  if (a == a && b == b) {
+    s64 ia = 0;
+    s64 ib = 0;
+    memcpy(&ia, &a, sizeof(ia));
+    memcpy(&ib, &b, sizeof(ib));
+    if (ia < 0) {
+      ia = INT64_MIN - ia;
+    }
+    if (ib < 0) {
+      ib = INT64_MIN - ib;
+    }
+    result = ia > ib ? (u64)ia - (u64)ib : (u64)ib - (u64)ia;
+  }
+
+  return result;
+}
+
+struct AnswerCompareWork;
+typedef f64 AnswerCompareFunc(AnswerCompareWork *work);
+
+struct AnswerCompareWork {
+  f64 *expected;
+  f64 *actual;
+  u64 first;
+  u64 count;
+  AnswerTolerance *tolerance;
+  u32 max_reported;
+  AnswerCompareFunc *compare;
+  AnswerComparison *comparison;
+};
+
+// NOTE(chogan): The slow path, only taken for values outside the plain
+// absolute tolerance. The kernel's error bound is too expensive to compute for
+// every pair.
+static void checkAnswer(AnswerCompareWork *work, u64 index) {
+  f64 expected = work->expected[index];
+  f64 actual = work->actual[index];
+  AnswerTolerance *tolerance = work->tolerance;
+  f64 bound = getHaversineErrorBound(tolerance->kernel, expected);
+  bool matches = (fabs(actual - expected) <= tolerance->absolute + bound ||
+                  getUlpDistance(expected, actual) <= tolerance->ulps);
+
+  if (!matches) {
+    AnswerComparison *comparison = work->comparison;
+    comparison->mismatch_count++;
+    if (comparison->reported_count < work->max_reported) {
+      AnswerMismatch *mismatch = comparison->reported + comparison->reported_count++;
+      mismatch->index = index;
+      mismatch->expected = expected;
+      mismatch->actual = actual;
+    }
+  }
+}
+
+static f64 compareAnswersScalar(AnswerCompareWork *work, u64 first, u64 end) {
+  f64 result = 0;
+  f64 absolute = work->tolerance->absolute;
+
+  for (u64 i = first; i < end; ++i) {
+    f64 difference = work->actual[i] - work->expected[i];
+    result += difference;
+    if (!(fabs(difference) <= absolute)) {
+      checkAnswer(work, i);
+    }
+  }
+
+  return result;
+}
+
+static f64 compareAnswersReference(AnswerCompareWork *work) {
+  f64 result = compareAnswersScalar(work, work->first, work->first + work->count);
+
+  return result;
+}
+
+PERFAWARE_TARGET("avx2")
+static f64 compareAnswersAvx2(AnswerCompareWork *work) {
+  const u32 kLanes = 4;
+  __m256d sign_bit = _mm256_set1_pd(-0.0);
+  __m256d absolute = _mm256_set1_pd(work->tolerance->absolute);
+  __m256d sum = _mm256_setzero_pd();
+  u64 i = work->first;
+  u64 end = work->first + work->count;
+
+  for (; i + kLanes <= end; i += kLanes) {
+    __m256d expected = _mm256_loadu_pd(work->expected + i);
+    __m256d actual = _mm256_loadu_pd(work->actual + i);
+    __m256d difference = _mm256_sub_pd(actual, expected);
+    sum = _mm256_add_pd(sum, difference);
+
+    __m256d within = _mm256_cmp_pd(_mm256_andnot_pd(sign_bit, difference), absolute,
+                                   _CMP_LE_OQ);
+    u32 outside = ~(u32)_mm256_movemask_pd(within) & 0xf;
+    while (outside) {
+      checkAnswer(work, i + countTrailingZeros(outside));
+      outside &= outside - 1;
+    }
+  }
+
+  f64 lanes[kLanes];
+  _mm256_storeu_pd(lanes, sum);
+  f64 result = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  result += compareAnswersScalar(work, i, end);
+
+  return result;
+}
+
+PERFAWARE_TARGET("avx512f")
+static f64 compareAnswersAvx512(AnswerCompareWork *work) {
+  const u32 kLanes = 8;
+  __m512d absolute = _mm512_set1_pd(work->tolerance->absolute);
+  __m512d sum = _mm512_setzero_pd();
+  u64 i = work->first;
+  u64 end = work->first + work->count;
+
+  for (; i + kLanes <= end; i += kLanes) {
+    __m512d expected = _mm512_loadu_pd(work->expected + i);
+    __m512d actual = _mm512_loadu_pd(work->actual + i);
+    __m512d difference = _mm512_sub_pd(actual, expected);
+    sum = _mm512_add_pd(sum, difference);
+
+    __mmask8 within = _mm512_cmp_pd_mask(_mm512_abs_pd(difference), absolute, _CMP_LE_OQ);
+    u32 outside = ~(u32)within & 0xff;
+    while (outside) {
+      checkAnswer(work, i + countTrailingZeros(outside));
+      outside &= outside - 1;
+    }
+  }
+
+  // NOTE(chogan): Not _mm512_reduce_add_pd, GCC 12 warns about it
+  f64 lanes[kLanes];
+  _mm512_storeu_pd(lanes, sum);
+  f64 result = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) +
+                ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7])));
+  result += compareAnswersScalar(work, i, end);
+
+  return result;
+}
+
+static void compareAnswerRange(AnswerCompareWork *work) {
+  work->comparison->difference_sum = work->compare(work);
+}
+
+static AnswerCompareFunc *getAnswerCompareFunc() {
+  CpuFeatures *features = getCpuFeatures();
+  AnswerCompareFunc *result = compareAnswersReference;
+
+  if (features->avx512f) {
+    result = compareAnswersAvx512;
+  } else if (features->avx2) {
+    result = compareAnswersAvx2;
+  }
+
+  return result;
+}
+
+void compareAnswers(Arena *scratch, f64 *expected, f64 *actual, u64 num_points,
+                    AnswerTolerance *tolerance, u32 max_reported, u32 thread_count,
+                    AnswerComparison *result) {
+  TimeBandwidth(__func__, 2 * num_points * sizeof(f64));
+  assert(thread_count >= 1 && thread_count <= kMaxThreads);
+  ScopedTemporaryMemory scratch_memory(scratch);
+
+  if (max_reported > kMaxReportedMismatches) {
+    max_reported = kMaxReportedMismatches;
+  }
+
+  // NOTE(chogan): Not worth a thread for less than this many answers
+  const u64 kMinAnswersPerThread = KILOBYTES(64);
+  u64 max_threads = num_points / kMinAnswersPerThread;
+  if (thread_count > max_threads) {
+    thread_count = max_threads > 0 ? (u32)max_threads : 1;
+  }
+
+  AnswerComparison *comparisons = pushArray<AnswerComparison>(scratch_memory, thread_count);
+  AnswerCompareWork work[kMaxThreads] = {};
+  AnswerCompareFunc *compare = getAnswerCompareFunc();
+  // NOTE(chogan): Keep each thread's range a whole number of cache lines
+  u64 per_thread = alignForward(num_points / thread_count, 8);
+  u64 next = 0;
+
+  for (u32 i = 0; i < thread_count; ++i) {
+    u64 remaining = num_points - next;
+    comparisons[i] = {};
+    work[i].expected = expected;
+    work[i].actual = actual;
+    work[i].first = next;
+    work[i].count = i == thread_count - 1 || per_thread > remaining ? remaining : per_thread;
+    work[i].tolerance = tolerance;
+    work[i].max_reported = max_reported;
+    work[i].compare = compare;
+    work[i].comparison = comparisons + i;
+    next += work[i].count;
+  }
+  runOnThreads(compareAnswerRange, work, thread_count);
+
+  // NOTE(chogan): Threads cover consecutive ranges, so concatenating their
+  // reports in thread order gives the first mismatches overall.
+  *result = {};
+  for (u32 i = 0; i < thread_count; ++i) {
+    AnswerComparison *comparison = comparisons + i;
+    result->mismatch_count += comparison->mismatch_count;
+    result->difference_sum += comparison->difference_sum;
+    for (u32 j = 0; j < comparison->reported_count && result->reported_count < max_reported;
+         ++j) {
+      result->reported[result->reported_count++] = comparison->reported[j];
+    }
+  }
+}
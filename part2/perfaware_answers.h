@@ -0,0 +1,83 @@
+#ifndef PERFAWARE_ANSWERS_H_
+#define PERFAWARE_ANSWERS_H_
+
+// NOTE(chogan): Binary answers file (.f64). A fixed size header followed by
+// one f64 per pair and then the average, so a mapping of the file can be
+// compared against computed answers directly.
+//
+//   [AnswersFileHeader]
+//   [answer * num_points]
+//   [average]
+//
+// All fields are little endian. The header is a cache line so the answers
+// start cache line aligned in a mapping.
+
+const u32 kAnswersFileMagic = 0x534e4148;  // "HANS"
+const u32 kAnswersFileVersion = 1;
+
+struct AnswersFileHeader {
+  u32 magic;
+  u32 version;
+  u64 num_points;
+  u64 reserved[6];
+};
+
+// NOTE(chogan): `values[num_points]` is the average. Text answer files are
+// parsed into `values` instead of mapped.
+struct AnswerArray {
+  EntireFile file;
+  f64 *values;
+  u64 num_points;
+};
+
+// NOTE(chogan): A value matches if it's within `absolute` (plus the kernel's
+// error bound, see getHaversineErrorBound) or within `ulps` units in the last
+// place of the expected value. `absolute = 0, ulps = 0` asks for bit identical
+// answers.
+struct AnswerTolerance {
+  f64 absolute;
+  u64 ulps;
+  HaversineKernel kernel;
+};
+
+const u32 kMaxReportedMismatches = 64;
+
+struct AnswerMismatch {
+  u64 index;
+  f64 expected;
+  f64 actual;
+};
+
+struct AnswerComparison {
+  u64 mismatch_count;
+  // NOTE(chogan): Sum of (actual - expected) over every pair, used to allow for
+  // the average moving by as much as the answers did.
+  f64 difference_sum;
+  u32 reported_count;
+  AnswerMismatch reported[kMaxReportedMismatches];
+};
+
+// NOTE(chogan): For writing the file in pieces. Answer i goes at
+// sizeof(AnswersFileHeader) + i * sizeof(f64), the average after the last one.
+AnswersFileHeader initAnswersFileHeader(u64 num_points);
+// NOTE(chogan): `answers` holds num_points + 1 values, the last being the
+// average.
+bool writeAnswersFile(const char *path, f64 *answers, u64 num_points);
+bool isAnswersFile(const char *path);
+// NOTE(chogan): Maps (or reads, depending on `options`) a binary answers file,
+// or parses a text one (one "%.16f" per line) into `arena`. Call `closeAnswers`
+// when done.
+bool openAnswers(Arena *arena, const char *path, FileReadOptions *options, AnswerArray *result);
+void closeAnswers(AnswerArray *answers);
+// NOTE(chogan): Reads only the average out of either kind of answers file
+bool readAnswersAverage(const char *path, f64 *average);
+
+// NOTE(chogan): Compares the first `num_points` answers on `thread_count`
+// threads and records the first `max_reported` mismatches (in index order).
+// The average isn't included.
+void compareAnswers(Arena *scratch, f64 *expected, f64 *actual, u64 num_points,
+                    AnswerTolerance *tolerance, u32 max_reported, u32 thread_count,
+                    AnswerComparison *result);
+u64 getUlpDistance(f64 a, f64 b);
+
+#endif  // PERFAWARE_ANSWERS_H_
@@ -0,0 +1,135 @@
+#include <stddef.h>
+#include <stdio.h>
+
+#include "perfaware_checkpoint.h"
+#include "perfaware_file.h"
+#include "perfaware_hash.h"
+
+Checkpoint initCheckpoint() {
+  Checkpoint result = {};
+  result.magic = kCheckpointMagic;
+  result.version = kCheckpointVersion;
+
+  return result;
+}
+
+static u64 hashCheckpoint(Checkpoint *checkpoint) {
+  u64 result = hashBytes(checkpoint, offsetof(Checkpoint, checksum));
+
+  return result;
+}
+
+bool readCheckpoint(const char *path, Checkpoint *checkpoint) {
+  bool result = false;
+  FILE *file = fopen(path, "rb");
+
+  if (file) {
+    Checkpoint stored = {};
+    result = (fread(&stored, sizeof(stored), 1, file) == 1 &&
+              stored.magic == kCheckpointMagic && stored.version == kCheckpointVersion &&
+              stored.checksum == hashCheckpoint(&stored) &&
+              stored.hashed_size <= stored.input_offset);
+    fclose(file);
+
+    if (result) {
+      *checkpoint = stored;
+    } else {
+      fprintf(stderr, "ERROR: Ignoring unreadable checkpoint %s\n", path);
+    }
+  }
+
+  return result;
+}
+
+bool writeCheckpoint(const char *path, Checkpoint *checkpoint) {
+  bool result = false;
+  FILE *file = fopen(path, "wb");
+  checkpoint->checksum = hashCheckpoint(checkpoint);
+
+  if (file) {
+    bool ok = fwrite(checkpoint, sizeof(*checkpoint), 1, file) == 1;
+    result = fclose(file) == 0 && ok;
+
+    if (!result) {
+      fprintf(stderr, "ERROR: Failed writing %s\n", path);
+    }
+  } else {
+    fprintf(stderr, "ERROR: Couldn't open file %s\n", path);
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Continues `*hash` over the chunks from `begin` to `end`, which
+// are both whole chunks into the file
+static bool hashChunks(InputFile *input, u8 *buffer, u64 begin, u64 end, u64 *hash) {
+  TimeBandwidth(__func__, end - begin);
+  bool result = true;
+
+  for (u64 at = begin; at < end && result; at += kCheckpointHashChunk) {
+    result = readFileAt(input, at, buffer, kCheckpointHashChunk);
+    *hash = hashBytes(buffer, kCheckpointHashChunk, *hash);
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Rounds down to a whole chunk, except that a whole chunk right
+// before `offset` is left for the tail, so the quick check always has bytes to
+// compare.
+static u64 getHashedSize(u64 offset) {
+  u64 result = offset > 0 ? (offset - 1) - (offset - 1) % kCheckpointHashChunk : 0;
+
+  return result;
+}
+
+// NOTE(chogan): At most a chunk, starting on a whole chunk
+static bool hashLastChunk(InputFile *input, u8 *buffer, u64 begin, u64 end, u64 *hash) {
+  bool result = readFileAt(input, begin, buffer, end - begin);
+  *hash = hashBytes(buffer, end - begin);
+
+  return result;
+}
+
+bool validateCheckpoint(Arena *scratch, InputFile *input, u64 input_size,
+                        Checkpoint *checkpoint, bool full) {
+  TimeFunction;
+  ScopedTemporaryMemory scratch_memory(scratch);
+  u8 *buffer = pushSize(scratch_memory, kCheckpointHashChunk);
+  bool result = checkpoint->input_offset <= input_size;
+
+  if (result) {
+    u64 tail_hash = 0;
+    result = (hashLastChunk(input, buffer, checkpoint->hashed_size, checkpoint->input_offset,
+                               &tail_hash) &&
+              tail_hash == checkpoint->tail_hash);
+  }
+  if (result && full) {
+    u64 prefix_hash = 0;
+    result = (hashChunks(input, buffer, 0, checkpoint->hashed_size, &prefix_hash) &&
+              prefix_hash == checkpoint->prefix_hash);
+  }
+
+  return result;
+}
+
+bool advanceCheckpoint(Arena *scratch, InputFile *input, Checkpoint *checkpoint, u64 offset) {
+  TimeFunction;
+  ScopedTemporaryMemory scratch_memory(scratch);
+  u8 *buffer = pushSize(scratch_memory, kCheckpointHashChunk);
+  u64 hashed_size = getHashedSize(offset);
+  u64 prefix_hash = checkpoint->prefix_hash;
+  u64 tail_hash = 0;
+
+  bool result = (hashChunks(input, buffer, checkpoint->hashed_size, hashed_size, &prefix_hash) &&
+                 hashLastChunk(input, buffer, hashed_size, offset, &tail_hash));
+
+  if (result) {
+    checkpoint->input_offset = offset;
+    checkpoint->hashed_size = hashed_size;
+    checkpoint->prefix_hash = prefix_hash;
+    checkpoint->tail_hash = tail_hash;
+  }
+
+  return result;
+}
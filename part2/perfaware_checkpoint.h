@@ -0,0 +1,55 @@
+#ifndef PERFAWARE_CHECKPOINT_H_
+#define PERFAWARE_CHECKPOINT_H_
+
+// NOTE(chogan): Sidecar (<input>.ckpt) that lets a pairs file that only ever
+// grows at the end be reprocessed by reading just what was added. It records
+// where the last complete record ended, how many pairs came before that and
+// the fused path's compensated sum, so the sum can pick up where it left off
+// and end up bit identical to a run over the whole file.
+//
+// To tell that the file still starts with what was processed, the prefix is
+// hashed (hashBytes, each call seeded with the last) in kCheckpointHashChunk
+// pieces at fixed offsets. `tail_hash` covers the chunk holding the last
+// byte, which may be partial or whole but is never empty, and `prefix_hash`
+// the whole chunks before it. So moving the checkpoint only hashes new bytes,
+// and the quick check on a rerun always reads something, but at most a chunk.
+// The full check rehashes the prefix at memory bandwidth, which is still far
+// cheaper than parsing it again.
+
+const u32 kCheckpointMagic = 0x504b4348;  // "HCKP"
+const u32 kCheckpointVersion = 3;
+const u64 kCheckpointHashChunk = MEGABYTES(1);
+
+struct Checkpoint {
+  u32 magic;
+  u32 version;
+  // NOTE(chogan): Just past the last complete record's closing brace
+  u64 input_offset;
+  // NOTE(chogan): The line input_offset is on, so errors in what comes after
+  // it can be reported with the file's line numbers
+  u64 input_line;
+  u64 num_points;
+  f64 sum;
+  f64 compensation;
+  // NOTE(chogan): Where the chunk holding the byte before input_offset starts
+  u64 hashed_size;
+  u64 prefix_hash;
+  u64 tail_hash;
+  // NOTE(chogan): Of everything above, to catch a torn write
+  u64 checksum;
+};
+
+Checkpoint initCheckpoint();
+// NOTE(chogan): Fails quietly if there's no checkpoint, but complains about
+// one that's unreadable.
+bool readCheckpoint(const char *path, Checkpoint *checkpoint);
+bool writeCheckpoint(const char *path, Checkpoint *checkpoint);
+// NOTE(chogan): Checks that `input` (`input_size` bytes) still starts with the
+// bytes `checkpoint` covers. Only the last chunk is rehashed unless `full`.
+bool validateCheckpoint(Arena *scratch, InputFile *input, u64 input_size,
+                        Checkpoint *checkpoint, bool full);
+// NOTE(chogan): Moves the checkpoint's hashes forward to `offset`, reading only
+// from the start of its last chunk. The sum and count are up to the caller.
+bool advanceCheckpoint(Arena *scratch, InputFile *input, Checkpoint *checkpoint, u64 offset);
+
+#endif  // PERFAWARE_CHECKPOINT_H_
@@ -0,0 +1,145 @@
+#include <string.h>
+
+#if !_WIN32
+#include <cpuid.h>
+#endif
+
+#include "perfaware_cpu.h"
+
+const char *kCpuIsaNames[CpuIsa_Count] = {
+  "scalar",
+  "sse4.2",
+  "avx2",
+  "avx512",
+};
+
+static void cpuid(u32 leaf, u32 subleaf, u32 *regs) {
+#if _WIN32
+  __cpuidex((int *)regs, (int)leaf, (int)subleaf);
+#else
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static u64 readXcr0() {
+#if _WIN32
+  return _xgetbv(0);
+#else
+  u32 eax = 0;
+  u32 edx = 0;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return ((u64)edx << 32) | eax;
+#endif
+}
+
+static CpuFeatures detectCpuFeatures() {
+  CpuFeatures result = {};
+  u32 regs[4] = {};
+
+  cpuid(0, 0, regs);
+  u32 max_leaf = regs[0];
+
+  if (max_leaf >= 1) {
+    cpuid(1, 0, regs);
+    u32 ecx = regs[2];
+    result.sse42 = ecx & (1 << 20);
+    bool has_fma = ecx & (1 << 12);
+    bool has_osxsave = ecx & (1 << 27);
+
+    // NOTE(chogan): The CPU supporting AVX isn't enough, the OS also has to
+    // save the YMM/ZMM state on context switches.
+    u64 xcr0 = has_osxsave ? readXcr0() : 0;
+    bool os_saves_ymm = (xcr0 & 0x6) == 0x6;
+    bool os_saves_zmm = (xcr0 & 0xe6) == 0xe6;
+
+    if (max_leaf >= 7 && os_saves_ymm) {
+      cpuid(7, 0, regs);
+      u32 ebx = regs[1];
+      result.avx2 = ebx & (1 << 5);
+      result.fma = has_fma;
+
+      if (os_saves_zmm) {
+        result.avx512f = ebx & (1 << 16);
+        result.avx512bw = result.avx512f && (ebx & (1 << 30));
+      }
+    }
+  }
+
+  return result;
+}
+
+static CpuFeatures *getDetectedCpuFeatures() {
+  static CpuFeatures result = detectCpuFeatures();
+
+  return &result;
+}
+
+CpuFeatures *getCpuFeatures() {
+  static CpuFeatures result = *getDetectedCpuFeatures();
+
+  return &result;
+}
+
+bool parseCpuIsa(const char *name, CpuIsa *isa) {
+  bool result = false;
+
+  for (u32 i = 0; i < CpuIsa_Count; ++i) {
+    if (strcmp(name, kCpuIsaNames[i]) == 0) {
+      *isa = (CpuIsa)i;
+      result = true;
+      break;
+    }
+  }
+
+  return result;
+}
+
+static CpuIsa getFeaturesIsa(CpuFeatures *features) {
+  CpuIsa result = CpuIsa_Scalar;
+
+  if (features->sse42) {
+    result = CpuIsa_Sse42;
+    if (features->avx2 && features->fma) {
+      result = CpuIsa_Avx2;
+      if (features->avx512f && features->avx512bw) {
+        result = CpuIsa_Avx512;
+      }
+    }
+  }
+
+  return result;
+}
+
+CpuIsa getCpuIsa() {
+  CpuIsa result = getFeaturesIsa(getCpuFeatures());
+
+  return result;
+}
+
+CpuIsa getDetectedCpuIsa() {
+  CpuIsa result = getFeaturesIsa(getDetectedCpuFeatures());
+
+  return result;
+}
+
+bool forceCpuIsa(CpuIsa isa) {
+  bool result = isa <= getDetectedCpuIsa();
+
+  if (result) {
+    CpuFeatures features = *getDetectedCpuFeatures();
+    if (isa < CpuIsa_Avx512) {
+      features.avx512f = false;
+      features.avx512bw = false;
+    }
+    if (isa < CpuIsa_Avx2) {
+      features.avx2 = false;
+      features.fma = false;
+    }
+    if (isa < CpuIsa_Sse42) {
+      features.sse42 = false;
+    }
+    *getCpuFeatures() = features;
+  }
+
+  return result;
+}
@@ -0,0 +1,69 @@
+#ifndef PERFAWARE_CPU_H_
+#define PERFAWARE_CPU_H_
+
+#if _WIN32
+#include <intrin.h>
+#else
+#include <immintrin.h>
+#endif
+
+// NOTE(chogan): Lets a single translation unit contain AVX2/AVX-512 code
+// without compiling everything with -mavx2. MSVC doesn't need this, it emits
+// whatever intrinsics you use.
+#if defined(__GNUC__) || defined(__clang__)
+#define PERFAWARE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define PERFAWARE_TARGET(isa)
+#endif
+
+struct CpuFeatures {
+  bool sse42;
+  bool avx2;
+  bool fma;
+  bool avx512f;
+  bool avx512bw;
+};
+
+// NOTE(chogan): Every SIMD path picks its variant from getCpuFeatures() when
+// it runs, so capping the features here moves all of them at once. The levels
+// are cumulative: avx2 also needs FMA, and avx512 needs AVX-512F and BW.
+enum CpuIsa {
+  CpuIsa_Scalar,
+  CpuIsa_Sse42,
+  CpuIsa_Avx2,
+  CpuIsa_Avx512,
+
+  CpuIsa_Count
+};
+
+extern const char *kCpuIsaNames[CpuIsa_Count];
+
+CpuFeatures *getCpuFeatures();
+bool parseCpuIsa(const char *name, CpuIsa *isa);
+// NOTE(chogan): The best level of the features in use, and of what the CPU has
+CpuIsa getCpuIsa();
+CpuIsa getDetectedCpuIsa();
+// NOTE(chogan): Caps the features every dispatch sees at `isa`, for comparing
+// variants on one machine. Fails if the CPU doesn't have `isa`. Not thread
+// safe, so call it before starting any threads.
+bool forceCpuIsa(CpuIsa isa);
+
+inline u32 countTrailingZeros(u64 value) {
+#if _WIN32
+  unsigned long result = 0;
+  _BitScanForward64(&result, value);
+  return (u32)result;
+#else
+  return (u32)__builtin_ctzll(value);
+#endif
+}
+
+inline u32 popCount(u64 value) {
+#if _WIN32
+  return (u32)__popcnt64(value);
+#else
+  return (u32)__builtin_popcountll(value);
+#endif
+}
+
+#endif  // PERFAWARE_CPU_H_
@@ -0,0 +1,271 @@
+#include <math.h>
+
+#include "perfaware_cpu.h"
+#include "perfaware_distance.h"
+#include "perfaware_haversine.h"
+#include "perfaware_thread.h"
+
+// NOTE(chogan): Uses the vector asin from perfaware_haversine.cpp, so it has to
+// come after it in the build.
+
+// NOTE(chogan): Writes the distances from point `row` of `from` to points
+// [first, first + count) of `to` into out[0..count)
+typedef void DistanceRowFunc(HaversineTerms *from, u64 row, HaversineTerms *to, u64 first,
+                             u64 count, f64 *out);
+
+void fillHaversineTerms(HaversineTerms *terms, u64 first, f64 *x, f64 *y, u64 count) {
+  for (u64 i = 0; i < count; ++i) {
+    f64 lat = y[i] * kDegreesToRadians;
+    f64 lon = x[i] * kDegreesToRadians;
+    terms->sin_half_lat[first + i] = sin(0.5 * lat);
+    terms->cos_half_lat[first + i] = cos(0.5 * lat);
+    terms->sin_half_lon[first + i] = sin(0.5 * lon);
+    terms->cos_half_lon[first + i] = cos(0.5 * lon);
+    terms->cos_lat[first + i] = cos(lat);
+  }
+}
+
+HaversineTerms pushHaversineTerms(Arena *arena, u64 count) {
+  HaversineTerms result = {};
+  result.sin_half_lat = pushArray<f64>(arena, count);
+  result.cos_half_lat = pushArray<f64>(arena, count);
+  result.sin_half_lon = pushArray<f64>(arena, count);
+  result.cos_half_lon = pushArray<f64>(arena, count);
+  result.cos_lat = pushArray<f64>(arena, count);
+  result.count = count;
+
+  return result;
+}
+
+HaversineTerms prepareHaversineTerms(Arena *arena, f64 *x, f64 *y, u64 count) {
+  TimeBandwidth(__func__, count * 2 * sizeof(f64));
+  HaversineTerms result = pushHaversineTerms(arena, count);
+  fillHaversineTerms(&result, 0, x, y, count);
+
+  return result;
+}
+
+static void distanceRowReference(HaversineTerms *from, u64 row, HaversineTerms *to, u64 first,
+                                 u64 count, f64 *out) {
+  f64 sin_half_lat = from->sin_half_lat[row];
+  f64 cos_half_lat = from->cos_half_lat[row];
+  f64 sin_half_lon = from->sin_half_lon[row];
+  f64 cos_half_lon = from->cos_half_lon[row];
+  f64 cos_lat = from->cos_lat[row];
+
+  for (u64 i = 0; i < count; ++i) {
+    u64 j = first + i;
+    f64 sin_lat = to->sin_half_lat[j] * cos_half_lat - to->cos_half_lat[j] * sin_half_lat;
+    f64 sin_lon = to->sin_half_lon[j] * cos_half_lon - to->cos_half_lon[j] * sin_half_lon;
+    f64 a = sin_lat * sin_lat + (cos_lat * to->cos_lat[j]) * (sin_lon * sin_lon);
+    a = a < 1.0 ? a : 1.0;
+    out[i] = kEarthRadius * 2.0 * asin(sqrt(a));
+  }
+}
+
+PERFAWARE_TARGET("avx2,fma")
+static inline __m256d distanceAvx2(__m256d row_sin_half_lat, __m256d row_cos_half_lat,
+                                   __m256d row_sin_half_lon, __m256d row_cos_half_lon,
+                                   __m256d row_cos_lat, __m256d sin_half_lat,
+                                   __m256d cos_half_lat, __m256d sin_half_lon,
+                                   __m256d cos_half_lon, __m256d cos_lat) {
+  __m256d sin_lat = _mm256_fmsub_pd(sin_half_lat, row_cos_half_lat,
+                                    _mm256_mul_pd(cos_half_lat, row_sin_half_lat));
+  __m256d sin_lon = _mm256_fmsub_pd(sin_half_lon, row_cos_half_lon,
+                                    _mm256_mul_pd(cos_half_lon, row_sin_half_lon));
+  __m256d a = _mm256_fmadd_pd(_mm256_mul_pd(row_cos_lat, cos_lat),
+                              _mm256_mul_pd(sin_lon, sin_lon),
+                              _mm256_mul_pd(sin_lat, sin_lat));
+  a = _mm256_min_pd(a, _mm256_set1_pd(1.0));
+  __m256d result = _mm256_mul_pd(_mm256_set1_pd(2.0 * kEarthRadius),
+                                 asinAvx2(_mm256_sqrt_pd(a)));
+
+  return result;
+}
+
+PERFAWARE_TARGET("avx2,fma")
+static void distanceRowAvx2(HaversineTerms *from, u64 row, HaversineTerms *to, u64 first,
+                            u64 count, f64 *out) {
+  const u32 kLanes = 4;
+  __m256d row_sin_half_lat = _mm256_set1_pd(from->sin_half_lat[row]);
+  __m256d row_cos_half_lat = _mm256_set1_pd(from->cos_half_lat[row]);
+  __m256d row_sin_half_lon = _mm256_set1_pd(from->sin_half_lon[row]);
+  __m256d row_cos_half_lon = _mm256_set1_pd(from->cos_half_lon[row]);
+  __m256d row_cos_lat = _mm256_set1_pd(from->cos_lat[row]);
+  u64 i = 0;
+
+  for (; i + kLanes <= count; i += kLanes) {
+    u64 j = first + i;
+    __m256d distance = distanceAvx2(row_sin_half_lat, row_cos_half_lat, row_sin_half_lon,
+                                    row_cos_half_lon, row_cos_lat,
+                                    _mm256_loadu_pd(to->sin_half_lat + j),
+                                    _mm256_loadu_pd(to->cos_half_lat + j),
+                                    _mm256_loadu_pd(to->sin_half_lon + j),
+                                    _mm256_loadu_pd(to->cos_half_lon + j),
+                                    _mm256_loadu_pd(to->cos_lat + j));
+    _mm256_storeu_pd(out + i, distance);
+  }
+
+  // NOTE(chogan): Zero terms give a = 0, so the padding lanes are harmless
+  if (i < count) {
+    u64 remaining = count - i;
+    u64 j = first + i;
+    f64 terms[5][kLanes] = {};
+    f64 tail[kLanes] = {};
+    memcpy(terms[0], to->sin_half_lat + j, remaining * sizeof(f64));
+    memcpy(terms[1], to->cos_half_lat + j, remaining * sizeof(f64));
+    memcpy(terms[2], to->sin_half_lon + j, remaining * sizeof(f64));
+    memcpy(terms[3], to->cos_half_lon + j, remaining * sizeof(f64));
+    memcpy(terms[4], to->cos_lat + j, remaining * sizeof(f64));
+
+    __m256d distance = distanceAvx2(row_sin_half_lat, row_cos_half_lat, row_sin_half_lon,
+                                    row_cos_half_lon, row_cos_lat, _mm256_loadu_pd(terms[0]),
+                                    _mm256_loadu_pd(terms[1]), _mm256_loadu_pd(terms[2]),
+                                    _mm256_loadu_pd(terms[3]), _mm256_loadu_pd(terms[4]));
+    _mm256_storeu_pd(tail, distance);
+    memcpy(out + i, tail, remaining * sizeof(f64));
+  }
+}
+
+PERFAWARE_TARGET("avx512f")
+static inline __m512d distanceAvx512(__m512d row_sin_half_lat, __m512d row_cos_half_lat,
+                                     __m512d row_sin_half_lon, __m512d row_cos_half_lon,
+                                     __m512d row_cos_lat, __m512d sin_half_lat,
+                                     __m512d cos_half_lat, __m512d sin_half_lon,
+                                     __m512d cos_half_lon, __m512d cos_lat) {
+  __m512d sin_lat = _mm512_fmsub_pd(sin_half_lat, row_cos_half_lat,
+                                    _mm512_mul_pd(cos_half_lat, row_sin_half_lat));
+  __m512d sin_lon = _mm512_fmsub_pd(sin_half_lon, row_cos_half_lon,
+                                    _mm512_mul_pd(cos_half_lon, row_sin_half_lon));
+  __m512d a = _mm512_fmadd_pd(_mm512_mul_pd(row_cos_lat, cos_lat),
+                              _mm512_mul_pd(sin_lon, sin_lon),
+                              _mm512_mul_pd(sin_lat, sin_lat));
+  a = _mm512_maskz_min_pd(kAllLanes, a, _mm512_set1_pd(1.0));
+  __m512d result = _mm512_mul_pd(_mm512_set1_pd(2.0 * kEarthRadius),
+                                 asinAvx512(_mm512_maskz_sqrt_pd(kAllLanes, a)));
+
+  return result;
+}
+
+PERFAWARE_TARGET("avx512f")
+static void distanceRowAvx512(HaversineTerms *from, u64 row, HaversineTerms *to, u64 first,
+                              u64 count, f64 *out) {
+  const u32 kLanes = 8;
+  __m512d row_sin_half_lat = _mm512_set1_pd(from->sin_half_lat[row]);
+  __m512d row_cos_half_lat = _mm512_set1_pd(from->cos_half_lat[row]);
+  __m512d row_sin_half_lon = _mm512_set1_pd(from->sin_half_lon[row]);
+  __m512d row_cos_half_lon = _mm512_set1_pd(from->cos_half_lon[row]);
+  __m512d row_cos_lat = _mm512_set1_pd(from->cos_lat[row]);
+  u64 i = 0;
+
+  for (; i + kLanes <= count; i += kLanes) {
+    u64 j = first + i;
+    __m512d distance = distanceAvx512(row_sin_half_lat, row_cos_half_lat, row_sin_half_lon,
+                                      row_cos_half_lon, row_cos_lat,
+                                      _mm512_loadu_pd(to->sin_half_lat + j),
+                                      _mm512_loadu_pd(to->cos_half_lat + j),
+                                      _mm512_loadu_pd(to->sin_half_lon + j),
+                                      _mm512_loadu_pd(to->cos_half_lon + j),
+                                      _mm512_loadu_pd(to->cos_lat + j));
+    _mm512_storeu_pd(out + i, distance);
+  }
+
+  if (i < count) {
+    __mmask8 mask = (__mmask8)((1u << (count - i)) - 1);
+    u64 j = first + i;
+    __m512d distance = distanceAvx512(row_sin_half_lat, row_cos_half_lat, row_sin_half_lon,
+                                      row_cos_half_lon, row_cos_lat,
+                                      _mm512_maskz_loadu_pd(mask, to->sin_half_lat + j),
+                                      _mm512_maskz_loadu_pd(mask, to->cos_half_lat + j),
+                                      _mm512_maskz_loadu_pd(mask, to->sin_half_lon + j),
+                                      _mm512_maskz_loadu_pd(mask, to->cos_half_lon + j),
+                                      _mm512_maskz_loadu_pd(mask, to->cos_lat + j));
+    _mm512_mask_storeu_pd(out + i, mask, distance);
+  }
+}
+
+static DistanceRowFunc *getDistanceRowFunc(HaversineKernel kernel) {
+  DistanceRowFunc *result = distanceRowReference;
+
+  switch (kernel) {
+    case HaversineKernel_Avx2: {
+      result = distanceRowAvx2;
+      break;
+    }
+    case HaversineKernel_Avx512: {
+      result = distanceRowAvx512;
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+
+  return result;
+}
+
+f64 *calculateDistancesFrom(Arena *arena, f64 x, f64 y, HaversineTerms *to,
+                            HaversineKernel kernel) {
+  TimeBandwidth(__func__, to->count * (5 + 1) * sizeof(f64));
+  assert(isHaversineKernelSupported(kernel));
+  f64 *result = pushArray<f64>(arena, to->count);
+  ScopedTemporaryMemory origin_memory(arena);
+  HaversineTerms origin = prepareHaversineTerms(origin_memory, &x, &y, 1);
+
+  getDistanceRowFunc(kernel)(&origin, 0, to, 0, to->count, result);
+
+  return result;
+}
+
+struct DistanceMatrixWork {
+  HaversineTerms *from;
+  HaversineTerms *to;
+  DistanceRowFunc *row_func;
+  f64 *out;
+  u64 first_row;
+  u64 row_count;
+};
+
+static void calculateDistanceTiles(DistanceMatrixWork *work) {
+  u64 column_count = work->to->count;
+
+  for (u64 column = 0; column < column_count; column += kDistanceTileColumns) {
+    u64 tile_columns = (column_count - column < kDistanceTileColumns ?
+                        column_count - column : kDistanceTileColumns);
+
+    for (u64 row = work->first_row; row < work->first_row + work->row_count; ++row) {
+      work->row_func(work->from, row, work->to, column, tile_columns,
+                     work->out + row * column_count + column);
+    }
+  }
+}
+
+f64 *calculateDistanceMatrix(Arena *arena, HaversineTerms *from, HaversineTerms *to,
+                             HaversineKernel kernel, u32 thread_count) {
+  TimeBandwidth(__func__, from->count * to->count * sizeof(f64));
+  assert(isHaversineKernelSupported(kernel));
+  assert(thread_count >= 1 && thread_count <= kMaxThreads);
+  f64 *result = pushArray<f64>(arena, from->count * to->count);
+
+  if (thread_count > from->count) {
+    thread_count = from->count > 0 ? (u32)from->count : 1;
+  }
+
+  DistanceMatrixWork work[kMaxThreads] = {};
+  u64 rows_per_thread = from->count / thread_count;
+  u64 extra_rows = from->count % thread_count;
+  u64 next_row = 0;
+
+  for (u32 i = 0; i < thread_count; ++i) {
+    work[i].from = from;
+    work[i].to = to;
+    work[i].row_func = getDistanceRowFunc(kernel);
+    work[i].out = result;
+    work[i].first_row = next_row;
+    work[i].row_count = rows_per_thread + (i < extra_rows ? 1 : 0);
+    next_row += work[i].row_count;
+  }
+  runOnThreads(calculateDistanceTiles, work, thread_count);
+
+  return result;
+}
@@ -0,0 +1,46 @@
+#ifndef PERFAWARE_DISTANCE_H_
+#define PERFAWARE_DISTANCE_H_
+
+// NOTE(chogan): Haversine distances between point sets rather than pairs:
+// from one origin to many points, and full matrices between two sets. Points
+// are (x, y) = (longitude, latitude) in degrees, like the pairs file.
+//
+// Everything that only depends on one point is computed once per point. With
+// the half angles' sines and cosines, the per pair sines come from the angle
+// difference identity
+//
+//   sin((b - a) / 2) = sin(b / 2) cos(a / 2) - cos(b / 2) sin(a / 2)
+//
+// so a pair costs a few multiplies, a sqrt and an asin, and no sin or cos.
+// Answers agree with ReferenceHaversine to within getHaversineErrorBound.
+//
+// Matrices are computed a tile of kDistanceTileColumns columns at a time, so a
+// tile's terms stay in L1 while every row runs over them, and threads split
+// the rows. Results go in the caller's arena, row major.
+
+struct HaversineTerms {
+  f64 *sin_half_lat;
+  f64 *cos_half_lat;
+  f64 *sin_half_lon;
+  f64 *cos_half_lon;
+  f64 *cos_lat;
+  u64 count;
+};
+
+// NOTE(chogan): 5 f64s of terms per column, 20kb per tile
+const u64 kDistanceTileColumns = 512;
+
+HaversineTerms prepareHaversineTerms(Arena *arena, f64 *x, f64 *y, u64 count);
+// NOTE(chogan): The same in two steps, so the terms can be filled a slice at a
+// time: room for `count` points, then points [first, first + count) of them
+HaversineTerms pushHaversineTerms(Arena *arena, u64 count);
+void fillHaversineTerms(HaversineTerms *terms, u64 first, f64 *x, f64 *y, u64 count);
+// NOTE(chogan): `to->count` distances from (x, y)
+f64 *calculateDistancesFrom(Arena *arena, f64 x, f64 y, HaversineTerms *to,
+                            HaversineKernel kernel);
+// NOTE(chogan): `from->count` rows of `to->count` distances each, where
+// result[row * to->count + column] is from point `row` to point `column`
+f64 *calculateDistanceMatrix(Arena *arena, HaversineTerms *from, HaversineTerms *to,
+                             HaversineKernel kernel, u32 thread_count);
+
+#endif  // PERFAWARE_DISTANCE_H_
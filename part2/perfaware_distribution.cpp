@@ -0,0 +1,201 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "perfaware_distribution.h"
+
+const char *kDistributionNames[Distribution_Count] = {
+  "uniform",
+  "clustered",
+  "antipodal",
+  "tiny",
+};
+
+const char *kPointOrderNames[PointOrder_Count] = {
+  "shuffled",
+  "sorted",
+};
+
+const f64 kDefaultSpreads[Distribution_Count] = {
+  0.0,
+  10.0,
+  0.01,
+  1e-6,
+};
+
+u64 mixBits(u64 value) {
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+  value = value ^ (value >> 31);
+
+  return value;
+}
+
+f64 randomUnit(u64 key, u64 counter) {
+  u64 bits = mixBits(key + counter * 0x9e3779b97f4a7c15ULL);
+  f64 result = (f64)(bits >> 11) * (1.0 / (f64)(1ULL << 53));
+
+  return result;
+}
+
+static inline f64 wrapLongitude(f64 x) {
+  f64 result = fmod(x, 360.0);
+  if (result > 180.0) {
+    result -= 360.0;
+  } else if (result < -180.0) {
+    result += 360.0;
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Reflects off the poles. The longitude should flip too, to stay
+// on the same great circle, but any valid point will do here.
+static inline f64 foldLatitude(f64 y) {
+  f64 result = fmod(y, 360.0);
+  if (result > 180.0) {
+    result -= 360.0;
+  } else if (result < -180.0) {
+    result += 360.0;
+  }
+  if (result > 90.0) {
+    result = 180.0 - result;
+  } else if (result < -90.0) {
+    result = -180.0 - result;
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Uniform in [-spread, spread)
+static inline f64 jitter(f64 spread, f64 unit) {
+  f64 result = spread * (2.0 * unit - 1.0);
+
+  return result;
+}
+
+static int compareClusterCenters(const void *a, const void *b) {
+  f64 ax = ((const ClusterCenter *)a)->x;
+  f64 bx = ((const ClusterCenter *)b)->x;
+  int result = (ax > bx) - (ax < bx);
+
+  return result;
+}
+
+void initPointDistribution(Arena *arena, PointDistribution *dist, Distribution kind,
+                           PointOrder order, u64 seed, u64 num_points, f64 spread,
+                           u32 cluster_count) {
+  *dist = {};
+  dist->kind = kind;
+  dist->order = order;
+  dist->num_points = num_points;
+  dist->key = mixBits(seed);
+  dist->detail_key = mixBits(seed + 1);
+  dist->spread = spread;
+
+  if (kind == Distribution_Clustered) {
+    u64 cluster_key = mixBits(seed + 2);
+    dist->cluster_count = cluster_count;
+    dist->clusters = pushArray<ClusterCenter>(arena, cluster_count);
+    for (u32 i = 0; i < cluster_count; ++i) {
+      dist->clusters[i].x = -180.0 + 360.0 * randomUnit(cluster_key, 2 * i + 0);
+      dist->clusters[i].y = -90.0 + 180.0 * randomUnit(cluster_key, 2 * i + 1);
+    }
+    if (order == PointOrder_Sorted) {
+      qsort(dist->clusters, cluster_count, sizeof(ClusterCenter), compareClusterCenters);
+    }
+  }
+}
+
+// NOTE(chogan): Counters 4i to 4i + 3 under `key` are the point's main random
+// numbers (and all of them for uniform, so uniform output is the same as it
+// always was). Anything extra comes from `detail_key`.
+Point generatePoint(PointDistribution *dist, u64 index) {
+  u64 counter = 4 * index;
+  f64 first = randomUnit(dist->key, counter + 0);
+  f64 u1 = randomUnit(dist->key, counter + 1);
+  f64 u2 = randomUnit(dist->key, counter + 2);
+  f64 u3 = randomUnit(dist->key, counter + 3);
+  f64 spread = dist->spread;
+
+  if (dist->order == PointOrder_Sorted) {
+    first = ((f64)index + first) / (f64)dist->num_points;
+  }
+
+  Point result = {};
+  switch (dist->kind) {
+    case Distribution_Uniform: {
+      result.x0 = -180.0 + 360.0 * first;
+      result.y0 = -90.0 + 180.0 * u1;
+      result.x1 = -180.0 + 360.0 * u2;
+      result.y1 = -90.0 + 180.0 * u3;
+      break;
+    }
+    case Distribution_Clustered: {
+      // NOTE(chogan): The whole part of first * cluster_count picks the first
+      // endpoint's cluster and the fraction places it across the cluster, so
+      // sorted order walks the clusters in order. The second endpoint's cluster
+      // is independent.
+      u32 count = dist->cluster_count;
+      f64 scaled = first * (f64)count;
+      u32 cluster0 = (u32)scaled < count ? (u32)scaled : count - 1;
+      u32 cluster1 = (u32)(u2 * (f64)count) < count ? (u32)(u2 * (f64)count) : count - 1;
+      ClusterCenter *center0 = dist->clusters + cluster0;
+      ClusterCenter *center1 = dist->clusters + cluster1;
+      f64 u4 = randomUnit(dist->detail_key, counter + 0);
+
+      result.x0 = wrapLongitude(center0->x + jitter(spread, scaled - (f64)cluster0));
+      result.y0 = foldLatitude(center0->y + jitter(spread, u1));
+      result.x1 = wrapLongitude(center1->x + jitter(spread, u4));
+      result.y1 = foldLatitude(center1->y + jitter(spread, u3));
+      break;
+    }
+    case Distribution_Antipodal: {
+      result.x0 = -180.0 + 360.0 * first;
+      result.y0 = -90.0 + 180.0 * u1;
+      result.x1 = wrapLongitude(result.x0 + (result.x0 < 0 ? 180.0 : -180.0) + jitter(spread, u2));
+      result.y1 = foldLatitude(-result.y0 + jitter(spread, u3));
+      break;
+    }
+    case Distribution_Tiny: {
+      result.x0 = -180.0 + 360.0 * first;
+      result.y0 = -90.0 + 180.0 * u1;
+      result.x1 = wrapLongitude(result.x0 + jitter(spread, u2));
+      result.y1 = foldLatitude(result.y0 + jitter(spread, u3));
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+
+  return result;
+}
+
+bool parseDistribution(const char *name, Distribution *kind) {
+  bool result = false;
+
+  for (u32 i = 0; i < Distribution_Count; ++i) {
+    if (strcmp(name, kDistributionNames[i]) == 0) {
+      *kind = (Distribution)i;
+      result = true;
+      break;
+    }
+  }
+
+  return result;
+}
+
+bool parsePointOrder(const char *name, PointOrder *order) {
+  bool result = false;
+
+  for (u32 i = 0; i < PointOrder_Count; ++i) {
+    if (strcmp(name, kPointOrderNames[i]) == 0) {
+      *order = (PointOrder)i;
+      result = true;
+      break;
+    }
+  }
+
+  return result;
+}
@@ -0,0 +1,75 @@
+#ifndef PERFAWARE_DISTRIBUTION_H_
+#define PERFAWARE_DISTRIBUTION_H_
+
+// NOTE(chogan): Where the generator's points come from. Every mode is counter
+// based, so point i only depends on the seed, the parameters and i, and any
+// block of points can be generated on any thread.
+//
+//   uniform    Both endpoints anywhere on the globe
+//   clustered  Endpoints within `spread` degrees of one of `cluster_count`
+//              random centers, so distances are either short or clumped
+//   antipodal  The second endpoint within `spread` degrees of the first one's
+//              antipode, where haversine's asin argument is close to 1
+//   tiny       The second endpoint within `spread` degrees of the first, where
+//              haversine's asin argument is close to 0
+//
+// Sorted order stratifies the first random number over the point index, so x0
+// increases through the file (for clustered, the points are grouped by cluster
+// in order of the clusters' longitudes, then by x0) without a sort.
+enum Distribution {
+  Distribution_Uniform,
+  Distribution_Clustered,
+  Distribution_Antipodal,
+  Distribution_Tiny,
+
+  Distribution_Count
+};
+
+enum PointOrder {
+  PointOrder_Shuffled,
+  PointOrder_Sorted,
+
+  PointOrder_Count
+};
+
+extern const char *kDistributionNames[Distribution_Count];
+extern const char *kPointOrderNames[PointOrder_Count];
+// NOTE(chogan): In degrees
+extern const f64 kDefaultSpreads[Distribution_Count];
+const f64 kMaxSpread = 90.0;
+const u32 kDefaultClusterCount = 64;
+const u32 kMaxClusterCount = 1 << 16;
+
+struct ClusterCenter {
+  f64 x;
+  f64 y;
+};
+
+struct PointDistribution {
+  Distribution kind;
+  PointOrder order;
+  u64 num_points;
+  u64 key;
+  u64 detail_key;
+  f64 spread;
+  u32 cluster_count;
+  ClusterCenter *clusters;
+};
+
+// NOTE(chogan): The SplitMix64 output function. Applied to key + counter * an
+// odd constant it gives independent random numbers for each counter.
+u64 mixBits(u64 value);
+// NOTE(chogan): Uniform in [0, 1)
+f64 randomUnit(u64 key, u64 counter);
+
+// NOTE(chogan): Needs `cluster_count` ClusterCenters from `arena` for the
+// clustered distribution.
+void initPointDistribution(Arena *arena, PointDistribution *dist, Distribution kind,
+                           PointOrder order, u64 seed, u64 num_points, f64 spread,
+                           u32 cluster_count);
+Point generatePoint(PointDistribution *dist, u64 index);
+
+bool parseDistribution(const char *name, Distribution *kind);
+bool parsePointOrder(const char *name, PointOrder *order);
+
+#endif  // PERFAWARE_DISTRIBUTION_H_
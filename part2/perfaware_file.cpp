@@ -0,0 +1,683 @@
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#if _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "perfaware_file.h"
+
+const char *kFileBackendNames[FileBackend_Count] = {
+  "fread",
+  "read",
+  "pread",
+  "mmap",
+  "direct",
+  "io_uring",
+};
+
+const char *kFileAdviceNames[FileAdvice_Count] = {
+  "none",
+  "sequential",
+  "willneed",
+  "hugepage",
+};
+
+// NOTE(chogan): O_DIRECT wants the buffer, offset and length aligned to the
+// logical block size. 4K covers every device we care about.
+const u64 kDirectAlignment = KILOBYTES(4);
+
+FileReadOptions defaultFileReadOptions() {
+  FileReadOptions result = {};
+  result.backend = FileBackend_Fread;
+  result.advice = FileAdvice_None;
+  result.queue_depth = 8;
+  result.block_size = MEGABYTES(1);
+
+  return result;
+}
+
+FileReadOptions getInPlaceReadOptions(FileReadOptions *options, bool backend_given) {
+  FileReadOptions result = *options;
+#if !_WIN32
+  if (!backend_given) {
+    result.backend = FileBackend_Mmap;
+  }
+#else
+  (void)backend_given;
+#endif
+
+  return result;
+}
+
+bool parseFileBackend(const char *name, FileBackend *backend) {
+  bool result = false;
+
+  for (u32 i = 0; i < FileBackend_Count; ++i) {
+    if (strcmp(name, kFileBackendNames[i]) == 0) {
+      *backend = (FileBackend)i;
+      result = true;
+      break;
+    }
+  }
+
+  return result;
+}
+
+bool parseFileAdvice(const char *name, FileAdvice *advice) {
+  bool result = false;
+
+  for (u32 i = 0; i < FileAdvice_Count; ++i) {
+    if (strcmp(name, kFileAdviceNames[i]) == 0) {
+      *advice = (FileAdvice)i;
+      result = true;
+      break;
+    }
+  }
+
+  return result;
+}
+
+bool getFileSize(const char *path, u64 *size) {
+  bool result = false;
+
+#if _WIN32
+  struct __stat64 st = {};
+  if (_stat64(path, &st) == 0) {
+    *size = st.st_size;
+    result = true;
+  }
+#else
+  struct stat st = {};
+  if (stat(path, &st) == 0) {
+    *size = st.st_size;
+    result = true;
+  }
+#endif
+
+  return result;
+}
+
+u64 getFileSizeOrZero(const char *path) {
+  u64 result = 0;
+  getFileSize(path, &result);
+
+  return result;
+}
+
+bool seekFile(FILE *file, u64 offset) {
+#if _WIN32
+  bool result = _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+  bool result = fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+
+  return result;
+}
+
+static bool readViaFread(const char *path, u8 *dest, u64 size) {
+  bool result = false;
+  FILE *fstream = fopen(path, "rb");
+
+  if (fstream) {
+    TimeBandwidth("fread", size);
+    result = fread(dest, size, 1, fstream) == 1;
+    fclose(fstream);
+  }
+
+  return result;
+}
+
+#if !_WIN32
+
+static bool readViaRead(const char *path, u8 *dest, u64 size) {
+  bool result = false;
+  int fd = open(path, O_RDONLY);
+
+  if (fd != -1) {
+    TimeBandwidth("read", size);
+    u64 remaining = size;
+    while (remaining) {
+      ssize_t bytes_read = read(fd, dest, remaining);
+      if (bytes_read <= 0) {
+        break;
+      }
+      dest += bytes_read;
+      remaining -= bytes_read;
+    }
+    result = remaining == 0;
+    close(fd);
+  }
+
+  return result;
+}
+
+static bool readViaPread(const char *path, u8 *dest, u64 size, u64 block_size) {
+  bool result = false;
+  int fd = open(path, O_RDONLY);
+
+  if (fd != -1) {
+    TimeBandwidth("pread", size);
+    u64 offset = 0;
+    while (offset < size) {
+      u64 to_read = size - offset < block_size ? size - offset : block_size;
+      ssize_t bytes_read = pread(fd, dest + offset, to_read, offset);
+      if (bytes_read <= 0) {
+        break;
+      }
+      offset += bytes_read;
+    }
+    result = offset == size;
+    close(fd);
+  }
+
+  return result;
+}
+
+// NOTE(chogan): `dest`, and the capacity behind it, must be rounded up to
+// kDirectAlignment. The final read asks for a whole block and comes back short.
+static bool readViaDirect(const char *path, u8 *dest, u64 size, u64 block_size) {
+  bool result = false;
+  int fd = open(path, O_RDONLY | O_DIRECT);
+
+  if (fd != -1) {
+    TimeBandwidth("direct", size);
+    u64 offset = 0;
+    u64 aligned_block = alignForward(block_size, kDirectAlignment);
+    while (offset < size) {
+      u64 to_read = alignForward(size - offset, kDirectAlignment);
+      to_read = to_read < aligned_block ? to_read : aligned_block;
+      ssize_t bytes_read = pread(fd, dest + offset, to_read, offset);
+      if (bytes_read <= 0) {
+        break;
+      }
+      offset += bytes_read;
+    }
+    result = offset >= size;
+    close(fd);
+  } else {
+    fprintf(stderr, "ERROR: open(O_DIRECT) failed for %s: %s\n", path, strerror(errno));
+  }
+
+  return result;
+}
+
+static int toMadvise(FileAdvice advice) {
+  int result = MADV_NORMAL;
+
+  switch (advice) {
+    case FileAdvice_Sequential: {
+      result = MADV_SEQUENTIAL;
+      break;
+    }
+    case FileAdvice_WillNeed: {
+      result = MADV_WILLNEED;
+      break;
+    }
+    case FileAdvice_HugePage: {
+      result = MADV_HUGEPAGE;
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+
+  return result;
+}
+
+static u8 *mapFile(const char *path, u64 size, FileReadOptions *options) {
+  u8 *result = NULL;
+  int fd = open(path, O_RDONLY);
+
+  if (fd != -1) {
+    TimeBandwidth("mmap", options->populate ? size : 0);
+    int flags = MAP_PRIVATE | (options->populate ? MAP_POPULATE : 0);
+    void *mapping = mmap(NULL, size, PROT_READ, flags, fd, 0);
+
+    if (mapping != MAP_FAILED) {
+      result = (u8 *)mapping;
+      if (options->advice != FileAdvice_None &&
+          madvise(mapping, size, toMadvise(options->advice)) != 0) {
+        fprintf(stderr, "WARNING: madvise(%s) failed: %s\n",
+                kFileAdviceNames[options->advice], strerror(errno));
+      }
+    } else {
+      fprintf(stderr, "ERROR: mmap failed for %s: %s\n", path, strerror(errno));
+    }
+    close(fd);
+  }
+
+  return result;
+}
+
+struct IoUring {
+  int fd;
+  u32 *sq_tail;
+  u32 *sq_mask;
+  u32 *sq_array;
+  u32 *cq_head;
+  u32 *cq_tail;
+  u32 *cq_mask;
+  io_uring_sqe *sqes;
+  io_uring_cqe *cqes;
+  void *sq_ring;
+  size_t sq_ring_size;
+  void *cq_ring;
+  size_t cq_ring_size;
+  size_t sqes_size;
+};
+
+// NOTE(chogan): Talks to the kernel directly rather than through liburing so
+// there's nothing extra to install.
+static bool initIoUring(IoUring *ring, u32 entries) {
+  bool result = false;
+  io_uring_params params = {};
+  ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+
+  if (ring->fd >= 0) {
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+      if (ring->cq_ring_size > ring->sq_ring_size) {
+        ring->sq_ring_size = ring->cq_ring_size;
+      }
+      ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = ring->sq_ring;
+    if (!single_mmap && ring->sq_ring != MAP_FAILED) {
+      ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    }
+    ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+    if (ring->sq_ring != MAP_FAILED && ring->cq_ring != MAP_FAILED && sqes != MAP_FAILED) {
+      u8 *sq = (u8 *)ring->sq_ring;
+      u8 *cq = (u8 *)ring->cq_ring;
+      ring->sq_tail = (u32 *)(sq + params.sq_off.tail);
+      ring->sq_mask = (u32 *)(sq + params.sq_off.ring_mask);
+      ring->sq_array = (u32 *)(sq + params.sq_off.array);
+      ring->cq_head = (u32 *)(cq + params.cq_off.head);
+      ring->cq_tail = (u32 *)(cq + params.cq_off.tail);
+      ring->cq_mask = (u32 *)(cq + params.cq_off.ring_mask);
+      ring->cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+      ring->sqes = (io_uring_sqe *)sqes;
+      result = true;
+    } else {
+      fprintf(stderr, "ERROR: Failed to map io_uring rings: %s\n", strerror(errno));
+      // NOTE(chogan): Undo whichever of the maps succeeded
+      if (sqes != MAP_FAILED) {
+        munmap(sqes, ring->sqes_size);
+      }
+      if (ring->cq_ring != ring->sq_ring && ring->cq_ring != MAP_FAILED) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+      }
+      if (ring->sq_ring != MAP_FAILED) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+      }
+      close(ring->fd);
+      ring->fd = -1;
+    }
+  } else {
+    fprintf(stderr, "ERROR: io_uring_setup failed: %s\n", strerror(errno));
+  }
+
+  return result;
+}
+
+static void destroyIoUring(IoUring *ring) {
+  munmap(ring->sqes, ring->sqes_size);
+  if (ring->cq_ring != ring->sq_ring) {
+    munmap(ring->cq_ring, ring->cq_ring_size);
+  }
+  munmap(ring->sq_ring, ring->sq_ring_size);
+  close(ring->fd);
+}
+
+static void queueRead(IoUring *ring, int fd, u8 *dest, u32 size, u64 offset) {
+  u32 tail = *ring->sq_tail;
+  u32 index = tail & *ring->sq_mask;
+  io_uring_sqe *sqe = ring->sqes + index;
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = (u64)dest;
+  sqe->len = size;
+  sqe->off = offset;
+  sqe->user_data = offset;
+  ring->sq_array[index] = index;
+
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// NOTE(chogan): Splits the file into `block_size` reads and keeps up to
+// `queue_depth` of them in flight. Short reads are resubmitted for the rest of
+// their block.
+static bool readViaIoUring(const char *path, u8 *dest, u64 size, FileReadOptions *options) {
+  bool result = false;
+  int fd = open(path, O_RDONLY);
+  IoUring ring = {};
+
+  if (fd != -1 && initIoUring(&ring, options->queue_depth)) {
+    TimeBandwidth("io_uring", size);
+    u64 block_size = options->block_size;
+    u64 next_offset = 0;
+    u64 bytes_done = 0;
+    u32 in_flight = 0;
+    u32 to_submit = 0;
+    bool failed = false;
+
+    while (bytes_done < size && !failed) {
+      while (in_flight < options->queue_depth && next_offset < size) {
+        u64 to_read = size - next_offset < block_size ? size - next_offset : block_size;
+        queueRead(&ring, fd, dest + next_offset, (u32)to_read, next_offset);
+        next_offset += to_read;
+        in_flight++;
+        to_submit++;
+      }
+
+      int entered = (int)syscall(__NR_io_uring_enter, ring.fd, to_submit, 1,
+                                 IORING_ENTER_GETEVENTS, NULL, 0);
+      if (entered < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        fprintf(stderr, "ERROR: io_uring_enter failed: %s\n", strerror(errno));
+        break;
+      }
+      to_submit -= entered;
+
+      u32 head = *ring.cq_head;
+      u32 tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+      while (head != tail) {
+        io_uring_cqe *cqe = ring.cqes + (head & *ring.cq_mask);
+        u64 offset = cqe->user_data;
+        s32 res = cqe->res;
+        head++;
+        in_flight--;
+
+        if (res <= 0) {
+          fprintf(stderr, "ERROR: io_uring read at %llu failed: %s\n",
+                  (unsigned long long)offset, strerror(-res));
+          failed = true;
+          continue;
+        }
+
+        bytes_done += res;
+        u64 block_end = offset + block_size < size ? offset + block_size : size;
+        u64 read_end = offset + res;
+        if (read_end < block_end) {
+          queueRead(&ring, fd, dest + read_end, (u32)(block_end - read_end), read_end);
+          in_flight++;
+          to_submit++;
+        }
+      }
+      __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    // NOTE(chogan): Don't give the buffer back while the kernel might still
+    // be writing into it.
+    while (in_flight && failed) {
+      if (syscall(__NR_io_uring_enter, ring.fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+          errno != EINTR) {
+        break;
+      }
+      u32 head = *ring.cq_head;
+      u32 tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+      in_flight -= tail - head;
+      __atomic_store_n(ring.cq_head, tail, __ATOMIC_RELEASE);
+    }
+
+    result = !failed && bytes_done == size;
+    destroyIoUring(&ring);
+  }
+
+  if (fd != -1) {
+    close(fd);
+  }
+
+  return result;
+}
+
+#endif  // !_WIN32
+
+EntireFile readEntireFile(Arena *arena, const char *path, FileReadOptions *options) {
+  TimeFunction;
+  EntireFile result = {};
+  u64 file_size = 0;
+
+  if (!getFileSize(path, &file_size)) {
+    fprintf(stderr, "ERROR: Couldn't stat %s\n", path);
+    return result;
+  }
+
+  if (file_size == 0) {
+    return result;
+  }
+
+#if _WIN32
+  if (options->backend != FileBackend_Fread) {
+    fprintf(stderr, "ERROR: The %s backend isn't supported on Windows\n",
+            kFileBackendNames[options->backend]);
+    return result;
+  }
+#else
+  if (options->backend == FileBackend_Mmap) {
+    result.data = mapFile(path, file_size, options);
+    result.size = result.data ? file_size : 0;
+    result.mapped = result.data != NULL;
+    return result;
+  }
+#endif
+
+  bool is_direct = options->backend == FileBackend_Direct;
+  u64 capacity = is_direct ? file_size + 2 * kDirectAlignment : file_size;
+
+  if (capacity > getRemainingCapacity(arena)) {
+    fprintf(stderr, "ERROR: Arena capacity (%zu) too small to read %s (%llu bytes)\n",
+            getRemainingCapacity(arena), path, (unsigned long long)file_size);
+    return result;
+  }
+
+  u8 *dest = pushArray<u8>(arena, capacity);
+  if (is_direct) {
+    dest = (u8 *)alignForward((uintptr_t)dest, kDirectAlignment);
+  }
+
+  bool success = false;
+  switch (options->backend) {
+    case FileBackend_Fread: {
+      success = readViaFread(path, dest, file_size);
+      break;
+    }
+#if !_WIN32
+    case FileBackend_Read: {
+      success = readViaRead(path, dest, file_size);
+      break;
+    }
+    case FileBackend_Pread: {
+      success = readViaPread(path, dest, file_size, options->block_size);
+      break;
+    }
+    case FileBackend_Direct: {
+      success = readViaDirect(path, dest, file_size, options->block_size);
+      break;
+    }
+    case FileBackend_IoUring: {
+      success = readViaIoUring(path, dest, file_size, options);
+      break;
+    }
+#endif
+    default: {
+      break;
+    }
+  }
+
+  if (success) {
+    result.data = dest;
+    result.size = file_size;
+  } else {
+    fprintf(stderr, "ERROR: %s failed to read %s\n", kFileBackendNames[options->backend],
+            path);
+  }
+
+  return result;
+}
+
+EntireFile readEntireFile(Arena *arena, const char *path) {
+  FileReadOptions options = defaultFileReadOptions();
+  EntireFile result = readEntireFile(arena, path, &options);
+
+  return result;
+}
+
+void releaseEntireFile(EntireFile *file) {
+#if !_WIN32
+  if (file->mapped && file->data) {
+    munmap(file->data, file->size);
+  }
+#endif
+  file->data = NULL;
+  file->size = 0;
+  file->mapped = false;
+}
+
+bool openOutputFile(const char *path, OutputFile *file) {
+  bool result = false;
+
+#if _WIN32
+  HANDLE handle = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+  file->handle = handle;
+  result = handle != INVALID_HANDLE_VALUE;
+#else
+  file->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  result = file->fd != -1;
+#endif
+
+  if (!result) {
+    fprintf(stderr, "ERROR: Couldn't open file %s\n", path);
+  }
+
+  return result;
+}
+
+bool writeFileAt(OutputFile *file, u64 offset, const void *data, u64 size) {
+  TimeBandwidth(__func__, size);
+  const u8 *at = (const u8 *)data;
+  bool result = true;
+
+  while (size > 0 && result) {
+#if _WIN32
+    // NOTE(chogan): WriteFile takes a 32-bit size
+    DWORD to_write = size < GIGABYTES(1) ? (DWORD)size : (DWORD)GIGABYTES(1);
+    DWORD written = 0;
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = (DWORD)offset;
+    overlapped.OffsetHigh = (DWORD)(offset >> 32);
+    result = WriteFile((HANDLE)file->handle, at, to_write, &written, &overlapped) && written > 0;
+#else
+    ssize_t written = pwrite(file->fd, at, size, (off_t)offset);
+    if (written == -1 && errno == EINTR) {
+      continue;
+    }
+    result = written > 0;
+#endif
+    if (result) {
+      at += written;
+      offset += written;
+      size -= written;
+    }
+  }
+
+  return result;
+}
+
+bool closeOutputFile(OutputFile *file) {
+#if _WIN32
+  bool result = CloseHandle((HANDLE)file->handle) != 0;
+  file->handle = INVALID_HANDLE_VALUE;
+#else
+  bool result = close(file->fd) == 0;
+  file->fd = -1;
+#endif
+
+  return result;
+}
+
+bool openInputFile(const char *path, InputFile *file) {
+  bool result = false;
+
+#if _WIN32
+  HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+  file->handle = handle;
+  result = handle != INVALID_HANDLE_VALUE;
+#else
+  file->fd = open(path, O_RDONLY);
+  result = file->fd != -1;
+#endif
+
+  if (!result) {
+    fprintf(stderr, "ERROR: Couldn't open file %s\n", path);
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Fails if the file ends before `size` bytes were read
+bool readFileAt(InputFile *file, u64 offset, void *dest, u64 size) {
+  TimeBandwidth(__func__, size);
+  u8 *at = (u8 *)dest;
+  bool result = true;
+
+  while (size > 0 && result) {
+#if _WIN32
+    DWORD to_read = size < GIGABYTES(1) ? (DWORD)size : (DWORD)GIGABYTES(1);
+    DWORD bytes_read = 0;
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = (DWORD)offset;
+    overlapped.OffsetHigh = (DWORD)(offset >> 32);
+    result = ReadFile((HANDLE)file->handle, at, to_read, &bytes_read, &overlapped) &&
+             bytes_read > 0;
+#else
+    ssize_t bytes_read = pread(file->fd, at, size, (off_t)offset);
+    if (bytes_read == -1 && errno == EINTR) {
+      continue;
+    }
+    result = bytes_read > 0;
+#endif
+    if (result) {
+      at += bytes_read;
+      offset += bytes_read;
+      size -= bytes_read;
+    }
+  }
+
+  return result;
+}
+
+void closeInputFile(InputFile *file) {
+#if _WIN32
+  CloseHandle((HANDLE)file->handle);
+  file->handle = INVALID_HANDLE_VALUE;
+#else
+  close(file->fd);
+  file->fd = -1;
+#endif
+}
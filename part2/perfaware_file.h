@@ -0,0 +1,94 @@
+#ifndef PERFAWARE_FILE_H_
+#define PERFAWARE_FILE_H_
+
+#include <stdio.h>
+
+enum FileBackend {
+  FileBackend_Fread,
+  FileBackend_Read,
+  FileBackend_Pread,
+  FileBackend_Mmap,
+  FileBackend_Direct,
+  FileBackend_IoUring,
+
+  FileBackend_Count
+};
+
+enum FileAdvice {
+  FileAdvice_None,
+  FileAdvice_Sequential,
+  FileAdvice_WillNeed,
+  FileAdvice_HugePage,
+
+  FileAdvice_Count
+};
+
+struct FileReadOptions {
+  FileBackend backend;
+  // NOTE(chogan): mmap only. `populate` faults every page in up front with
+  // MAP_POPULATE instead of on first touch.
+  bool populate;
+  FileAdvice advice;
+  // NOTE(chogan): io_uring only. Number of `block_size` reads kept in flight.
+  u32 queue_depth;
+  u64 block_size;
+};
+
+struct EntireFile {
+  u8 *data;
+  u64 size;
+  // NOTE(chogan): Set when `data` is a mapping rather than arena memory.
+  bool mapped;
+};
+
+extern const char *kFileBackendNames[FileBackend_Count];
+extern const char *kFileAdviceNames[FileAdvice_Count];
+
+FileReadOptions defaultFileReadOptions();
+// NOTE(chogan): Binary inputs (point files and answers) are used in place, so
+// they're mapped unless `backend_given` says a read backend was asked for.
+FileReadOptions getInPlaceReadOptions(FileReadOptions *options, bool backend_given);
+bool parseFileBackend(const char *name, FileBackend *backend);
+bool parseFileAdvice(const char *name, FileAdvice *advice);
+bool getFileSize(const char *path, u64 *size);
+// NOTE(chogan): For planning memory, where a missing file just needs nothing
+u64 getFileSizeOrZero(const char *path);
+// NOTE(chogan): fseek with a 64-bit offset, since long is 32 bits on Windows
+bool seekFile(FILE *file, u64 offset);
+
+// NOTE(chogan): Reads all of `path` into `arena` (or maps it, for
+// FileBackend_Mmap). Returns an empty EntireFile on failure. Call
+// `releaseEntireFile` when done so mappings get unmapped; arena memory is
+// still owned by the arena.
+EntireFile readEntireFile(Arena *arena, const char *path, FileReadOptions *options);
+EntireFile readEntireFile(Arena *arena, const char *path);
+void releaseEntireFile(EntireFile *file);
+
+// NOTE(chogan): A file several threads can fill in at once. Each writes its own
+// byte ranges with writeFileAt, in any order.
+struct OutputFile {
+#if _WIN32
+  void *handle;
+#else
+  int fd;
+#endif
+};
+
+bool openOutputFile(const char *path, OutputFile *file);
+bool writeFileAt(OutputFile *file, u64 offset, const void *data, u64 size);
+bool closeOutputFile(OutputFile *file);
+
+// NOTE(chogan): Positional reads of a file too big to read (or map) whole
+struct InputFile {
+#if _WIN32
+  void *handle;
+#else
+  int fd;
+#endif
+};
+
+bool openInputFile(const char *path, InputFile *file);
+bool readFileAt(InputFile *file, u64 offset, void *dest, u64 size);
+void closeInputFile(InputFile *file);
+
+#endif  // PERFAWARE_FILE_H_
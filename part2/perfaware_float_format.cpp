@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "perfaware_float_format.h"
+
+const u64 kTenToThe8 = 100000000ULL;
+const u64 kTenToThe16 = kTenToThe8 * kTenToThe8;
+
+static const char kDigitPairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+// NOTE(chogan): Exactly 8 digits, zero padded
+static inline void writeEightDigits(char *dest, u32 value) {
+  for (s32 i = 3; i >= 0; --i) {
+    u32 pair = value % 100;
+    value /= 100;
+    memcpy(dest + 2 * i, kDigitPairs + 2 * pair, 2);
+  }
+}
+
+static inline u32 writeInteger(char *dest, u64 value) {
+  char digits[20];
+  u32 count = 0;
+
+  do {
+    digits[sizeof(digits) - ++count] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value);
+  memcpy(dest, digits + sizeof(digits) - count, count);
+
+  return count;
+}
+
+static u32 formatF64Fallback(char *dest, f64 value) {
+  char buffer[64];
+  int size = snprintf(buffer, sizeof(buffer), "%.17g", value);
+  u32 result = size > 0 && (u32)size <= kMaxFormattedF64Size ? (u32)size : 0;
+  memcpy(dest, buffer, result);
+
+  return result;
+}
+
+// NOTE(chogan): With value = m * 2^e, the output is round(m * 10^16 * 2^e)
+// split at the 16th digit. m * 10^16 needs at most 107 bits, so it's exact in a
+// 128-bit integer, and the rounding shift can look at every bit that's dropped.
+u32 formatF64Fixed16(char *dest, f64 value) {
+#if _WIN32
+  // NOTE(chogan): MSVC has no 128-bit integer type
+  char buffer[512];
+  int size = snprintf(buffer, sizeof(buffer), "%.16f", value);
+  if (size <= 0 || (u32)size > kMaxFormattedF64Size) {
+    return formatF64Fallback(dest, value);
+  }
+  memcpy(dest, buffer, size);
+
+  return (u32)size;
+#else
+  u64 bits = 0;
+  memcpy(&bits, &value, sizeof(bits));
+  bool negative = (bits >> 63) != 0;
+  u32 biased_exponent = (u32)(bits >> 52) & 0x7ff;
+  u64 mantissa = bits & ((1ULL << 52) - 1);
+  s32 exponent = -1074;
+
+  if (biased_exponent == 0x7ff) {
+    return formatF64Fallback(dest, value);
+  }
+  if (biased_exponent != 0) {
+    mantissa |= 1ULL << 52;
+    exponent = (s32)biased_exponent - 1075;
+  }
+  if (exponent > 11) {
+    return formatF64Fallback(dest, value);
+  }
+
+  unsigned __int128 scaled = (unsigned __int128)mantissa * kTenToThe16;
+  unsigned __int128 rounded = 0;
+
+  if (exponent >= 0) {
+    rounded = scaled << exponent;
+  } else if (exponent > -110) {
+    u32 shift = (u32)-exponent;
+    unsigned __int128 one = 1;
+    unsigned __int128 remainder = scaled & ((one << shift) - 1);
+    unsigned __int128 half = one << (shift - 1);
+    rounded = scaled >> shift;
+    if (remainder > half || (remainder == half && (rounded & 1))) {
+      rounded++;
+    }
+  }
+  // NOTE(chogan): Otherwise scaled < 2^107 is less than half of 2^shift, so it
+  // rounds to 0
+
+  // NOTE(chogan): The truncated value is the integer part unless the rounding
+  // carried into it. Cheaper than a 128-bit division.
+  u64 integer = (u64)(negative ? -value : value);
+  u64 fraction = (u64)(rounded - (unsigned __int128)integer * kTenToThe16);
+  if (fraction >= kTenToThe16) {
+    integer++;
+    fraction -= kTenToThe16;
+  }
+
+  char *at = dest;
+  if (negative) {
+    *at++ = '-';
+  }
+  at += writeInteger(at, integer);
+  *at++ = '.';
+  writeEightDigits(at, (u32)(fraction / kTenToThe8));
+  writeEightDigits(at + 8, (u32)(fraction % kTenToThe8));
+  at += 16;
+
+  return (u32)(at - dest);
+#endif
+}
@@ -0,0 +1,14 @@
+#ifndef PERFAWARE_FLOAT_FORMAT_H_
+#define PERFAWARE_FLOAT_FORMAT_H_
+
+// NOTE(chogan): Longest output of formatF64Fixed16, not counting a NUL
+const u32 kMaxFormattedF64Size = 40;
+
+// NOTE(chogan): Writes exactly what printf("%.16f") would (correctly rounded,
+// ties to even) without the locale, varargs and parsing overhead. Magnitudes
+// of 2^64 or more, infinities and NaN are written as "%.17g" instead, so the
+// output always fits in kMaxFormattedF64Size and still parses back to the same
+// value. Returns the number of bytes written. No NUL is written.
+u32 formatF64Fixed16(char *dest, f64 value);
+
+#endif  // PERFAWARE_FLOAT_FORMAT_H_
@@ -0,0 +1,348 @@
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "perfaware_float_parser.h"
+#include "perfaware_float_tables.h"
+
+// NOTE(chogan): Decimal to binary conversion follows the Eisel-Lemire
+// algorithm as described in Lemire, "Number Parsing at a Gigabyte per Second"
+// (2021) and implemented in fast_float. Anything it can't decide (more than 19
+// significant digits where the truncation matters) goes to `strtod`, which is
+// exact, in the C locale.
+
+const u32 kMantissaExplicitBits = 52;
+const s32 kMinimumExponent = -1023;
+const s32 kInfinitePower = 0x7ff;
+
+static const f64 kExactPowersOfTen[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+struct AdjustedMantissa {
+  u64 mantissa;
+  s32 power2;
+};
+
+struct U128 {
+  u64 low;
+  u64 high;
+};
+
+static inline U128 fullMultiply(u64 a, u64 b) {
+  U128 result = {};
+#if _WIN32
+  result.low = _umul128(a, b, &result.high);
+#else
+  unsigned __int128 product = (unsigned __int128)a * b;
+  result.low = (u64)product;
+  result.high = (u64)(product >> 64);
+#endif
+
+  return result;
+}
+
+static inline u32 countLeadingZeros(u64 value) {
+#if _WIN32
+  unsigned long index = 0;
+  _BitScanReverse64(&index, value);
+  return 63 - (u32)index;
+#else
+  return (u32)__builtin_clzll(value);
+#endif
+}
+
+static inline bool isDigit(char c) {
+  bool result = (u8)(c - '0') <= 9;
+
+  return result;
+}
+
+static inline u64 loadEightBytes(const char *at) {
+  u64 result = 0;
+  memcpy(&result, at, sizeof(result));
+
+  return result;
+}
+
+// NOTE(chogan): SWAR digit handling, 8 ASCII bytes at a time.
+static inline bool isEightDigits(u64 value) {
+  bool result = !(((value + 0x4646464646464646) | (value - 0x3030303030303030)) &
+                  0x8080808080808080);
+
+  return result;
+}
+
+static inline u32 parseEightDigits(u64 value) {
+  const u64 mask = 0x000000ff000000ff;
+  const u64 mul1 = 0x000f424000000064;  // 100 + (1000000 << 32)
+  const u64 mul2 = 0x0000271000000001;  // 1 + (10000 << 32)
+  value -= 0x3030303030303030;
+  value = (value * 10) + (value >> 8);
+  value = (((value & mask) * mul1) + (((value >> 16) & mask) * mul2)) >> 32;
+
+  return (u32)value;
+}
+
+static inline u64 parseDigits(const char **at, const char *end, u64 value) {
+  const char *p = *at;
+
+  while (end - p >= 8) {
+    u64 chunk = loadEightBytes(p);
+    if (!isEightDigits(chunk)) {
+      break;
+    }
+    value = value * 100000000 + parseEightDigits(chunk);
+    p += 8;
+  }
+
+  while (p < end && isDigit(*p)) {
+    value = value * 10 + (u64)(*p - '0');
+    p++;
+  }
+  *at = p;
+
+  return value;
+}
+
+// NOTE(chogan): Approximately log2(10^q) + 63
+static inline s32 binaryPowerFromDecimal(s32 q) {
+  s32 result = (((152170 + 65536) * q) >> 16) + 63;
+
+  return result;
+}
+
+static AdjustedMantissa computeFloat(s64 q, u64 w) {
+  AdjustedMantissa result = {};
+
+  if (w == 0 || q < kSmallestPowerOfFive) {
+    return result;
+  }
+
+  if (q > kLargestPowerOfFive) {
+    result.power2 = kInfinitePower;
+    return result;
+  }
+
+  u32 lz = countLeadingZeros(w);
+  w <<= lz;
+
+  // NOTE(chogan): We need 55 good bits (52 explicit, 1 implicit, 1 for
+  // rounding, 1 for the possible leading 0). The second multiplication is
+  // only needed when the low bits of the first product are all ones.
+  u32 index = 2 * (u32)(q - kSmallestPowerOfFive);
+  U128 product = fullMultiply(w, kPowersOfFive128[index]);
+  const u64 precision_mask = 0xffffffffffffffffULL >> (kMantissaExplicitBits + 3);
+  if ((product.high & precision_mask) == precision_mask) {
+    U128 second = fullMultiply(w, kPowersOfFive128[index + 1]);
+    product.low += second.high;
+    if (second.high > product.low) {
+      product.high++;
+    }
+  }
+
+  s32 upper_bit = (s32)(product.high >> 63);
+  s32 shift = upper_bit + 64 - kMantissaExplicitBits - 3;
+  result.mantissa = product.high >> shift;
+  result.power2 = (binaryPowerFromDecimal((s32)q) + upper_bit - (s32)lz -
+                   kMinimumExponent);
+
+  if (result.power2 <= 0) {
+    // NOTE(chogan): Subnormal
+    if (-result.power2 + 1 >= 64) {
+      result.mantissa = 0;
+      result.power2 = 0;
+      return result;
+    }
+    result.mantissa >>= -result.power2 + 1;
+    result.mantissa += (result.mantissa & 1);
+    result.mantissa >>= 1;
+    result.power2 = (result.mantissa < (1ULL << kMantissaExplicitBits)) ? 0 : 1;
+    return result;
+  }
+
+  // NOTE(chogan): Exactly halfway between two floats. Only possible for small
+  // exponents, where we round to even instead of up.
+  if (product.low <= 1 && q >= -4 && q <= 23 && (result.mantissa & 3) == 1) {
+    if ((result.mantissa << shift) == product.high) {
+      result.mantissa &= ~1ULL;
+    }
+  }
+
+  result.mantissa += (result.mantissa & 1);
+  result.mantissa >>= 1;
+  if (result.mantissa >= (2ULL << kMantissaExplicitBits)) {
+    result.mantissa = 1ULL << kMantissaExplicitBits;
+    result.power2++;
+  }
+  result.mantissa &= ~(1ULL << kMantissaExplicitBits);
+
+  if (result.power2 >= kInfinitePower) {
+    result.power2 = kInfinitePower;
+    result.mantissa = 0;
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Plain strtod follows the global locale, which may not use `.`
+// for the decimal point.
+static f64 strtodInCLocale(const char *str) {
+#if _WIN32
+  static _locale_t c_locale = _create_locale(LC_ALL, "C");
+  f64 result = _strtod_l(str, NULL, c_locale);
+#else
+  static locale_t c_locale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+  f64 result = strtod_l(str, NULL, c_locale);
+#endif
+
+  return result;
+}
+
+static f64 parseF64Slow(const char *at, u64 size) {
+  char buffer[512];
+  char *str = buffer;
+
+  if (size >= sizeof(buffer)) {
+    str = (char *)malloc(size + 1);
+  }
+  memcpy(str, at, size);
+  str[size] = '\0';
+
+  f64 result = strtodInCLocale(str);
+
+  if (str != buffer) {
+    free(str);
+  }
+
+  return result;
+}
+
+f64 parseF64(const char *at, u64 size) {
+  const char *p = at;
+  const char *end = at + size;
+
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+
+  const char *integer_begin = p;
+  u64 w = parseDigits(&p, end, 0);
+  const char *integer_end = p;
+  u64 digit_count = integer_end - integer_begin;
+
+  const char *fraction_begin = p;
+  const char *fraction_end = p;
+  s64 exponent = 0;
+  if (p < end && *p == '.') {
+    p++;
+    fraction_begin = p;
+    w = parseDigits(&p, end, w);
+    fraction_end = p;
+    exponent = fraction_begin - fraction_end;
+    digit_count += fraction_end - fraction_begin;
+  }
+
+  if (digit_count == 0) {
+    return 0.0;
+  }
+
+  s64 explicit_exponent = 0;
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *exponent_begin = p++;
+    bool negative_exponent = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+      negative_exponent = *p == '-';
+      p++;
+    }
+
+    if (p < end && isDigit(*p)) {
+      while (p < end && isDigit(*p)) {
+        if (explicit_exponent < 0x10000000) {
+          explicit_exponent = explicit_exponent * 10 + (*p - '0');
+        }
+        p++;
+      }
+      if (negative_exponent) {
+        explicit_exponent = -explicit_exponent;
+      }
+      exponent += explicit_exponent;
+    } else {
+      // NOTE(chogan): "1e" is just 1
+      p = exponent_begin;
+    }
+  }
+
+  // NOTE(chogan): `w` overflowed if there were more than 19 digits. Leading
+  // zeros don't count, but if there are still too many we keep the first 19
+  // significant digits and remember that the rest were dropped.
+  bool truncated = false;
+  if (digit_count > 19) {
+    const char *start = integer_begin;
+    while (start < fraction_end && (*start == '0' || *start == '.')) {
+      if (*start == '0') {
+        digit_count--;
+      }
+      start++;
+    }
+
+    if (digit_count > 19) {
+      truncated = true;
+      const u64 kMinNineteenDigits = 1000000000000000000ULL;
+      w = 0;
+      const char *q = integer_begin;
+      while (w < kMinNineteenDigits && q < integer_end) {
+        w = w * 10 + (u64)(*q - '0');
+        q++;
+      }
+
+      if (w >= kMinNineteenDigits) {
+        exponent = (integer_end - q) + explicit_exponent;
+      } else {
+        q = fraction_begin;
+        while (w < kMinNineteenDigits && q < fraction_end) {
+          w = w * 10 + (u64)(*q - '0');
+          q++;
+        }
+        exponent = (fraction_begin - q) + explicit_exponent;
+      }
+    }
+  }
+
+  // NOTE(chogan): Clinger's fast path. Both operands are exact, so the single
+  // rounding of the multiply or divide is the correct rounding.
+  if (!truncated && exponent >= -22 && exponent <= 22 && w <= (1ULL << 53)) {
+    f64 result = (f64)w;
+    if (exponent < 0) {
+      result /= kExactPowersOfTen[-exponent];
+    } else {
+      result *= kExactPowersOfTen[exponent];
+    }
+    return negative ? -result : result;
+  }
+
+  AdjustedMantissa am = computeFloat(exponent, w);
+
+  if (truncated) {
+    // NOTE(chogan): The true value is between w and w + 1. If both round to
+    // the same float we're done, otherwise let strtod sort it out.
+    AdjustedMantissa upper = computeFloat(exponent, w + 1);
+    if (upper.mantissa != am.mantissa || upper.power2 != am.power2) {
+      return parseF64Slow(at, p - at);
+    }
+  }
+
+  u64 bits = am.mantissa | ((u64)am.power2 << kMantissaExplicitBits);
+  if (negative) {
+    bits |= 1ULL << 63;
+  }
+
+  f64 result = 0;
+  memcpy(&result, &bits, sizeof(result));
+
+  return result;
+}
@@ -0,0 +1,10 @@
+#ifndef PERFAWARE_FLOAT_PARSER_H_
+#define PERFAWARE_FLOAT_PARSER_H_
+
+// NOTE(chogan): Parses the decimal number in [at, at + size) and returns the
+// correctly rounded f64. Parsing stops at the first character that can't be
+// part of a number, like `atof`, but it never reads past `at + size` and
+// doesn't depend on the locale.
+f64 parseF64(const char *at, u64 size);
+
+#endif  // PERFAWARE_FLOAT_PARSER_H_
@@ -0,0 +1,185 @@
+#include <stdio.h>
+
+#include "perfaware_file.h"
+#include "perfaware_float_format.h"
+#include "perfaware_fused.h"
+#include "perfaware_haversine.h"
+#include "perfaware_json_parser.h"
+
+// NOTE(chogan): About 1000 records. The slice's tokens, points, columns and
+// answers all fit in L2.
+const u64 kFusedSliceSize = KILOBYTES(96);
+const u64 kMaxFusedSliceSize = 2 * kFusedSliceSize;
+const u64 kFusedFormatBufferSize = KILOBYTES(64);
+const u64 kMaxAnswerLineSize = kMaxFormattedF64Size + 1;
+
+// NOTE(chogan): A slice runs to the first record after kFusedSliceSize, but no
+// further than kMaxFusedSliceSize.
+u64 getFusedScratchSize() {
+  u64 max_records = getMaxRecordCount(kMaxFusedSliceSize);
+  u64 result = (kFusedFormatBufferSize + getMaxTokenBytes(kMaxFusedSliceSize) +
+                max_records * (sizeof(Point) + 4 * sizeof(f64) + sizeof(f64)));
+
+  return result;
+}
+
+bool beginFusedHaversine(FusedHaversine *fused, Arena *scratch, HaversineKernel kernel,
+                         const char *answers_path) {
+  bool result = true;
+  *fused = {};
+  fused->scratch = scratch;
+  fused->kernel = getHaversineKernelFunc(kernel);
+
+  if (answers_path) {
+    fused->answers_file = fopen(answers_path, "wb");
+    fused->format_buffer = (char *)pushSize(scratch, kFusedFormatBufferSize);
+
+    if (!fused->answers_file) {
+      fprintf(stderr, "ERROR: Couldn't open file %s\n", answers_path);
+      result = false;
+    }
+  }
+
+  return result;
+}
+
+static void flushFusedAnswers(FusedHaversine *fused) {
+  if (fused->format_used) {
+    if (fwrite(fused->format_buffer, fused->format_used, 1, fused->answers_file) != 1) {
+      fused->write_error = true;
+    }
+    fused->format_used = 0;
+  }
+}
+
+static void writeFusedAnswer(FusedHaversine *fused, f64 answer) {
+  if (fused->format_used + kMaxAnswerLineSize > kFusedFormatBufferSize) {
+    flushFusedAnswers(fused);
+  }
+  char *at = fused->format_buffer + fused->format_used;
+  u32 size = formatF64Fixed16(at, answer);
+  at[size++] = '\n';
+  fused->format_used += size;
+}
+
+static void addFusedAnswers(FusedHaversine *fused, f64 *answers, u64 count) {
+  f64 sum = fused->sum;
+  f64 compensation = fused->compensation;
+
+  for (u64 i = 0; i < count; ++i) {
+    f64 answer = answers[i];
+    f64 t = sum + answer;
+    if (fabs(sum) >= fabs(answer)) {
+      compensation += (sum - t) + answer;
+    } else {
+      compensation += (answer - t) + sum;
+    }
+    sum = t;
+  }
+
+  fused->sum = sum;
+  fused->compensation = compensation;
+  fused->num_points += count;
+
+  if (fused->answers_file) {
+    for (u64 i = 0; i < count; ++i) {
+      writeFusedAnswer(fused, answers[i]);
+    }
+  }
+}
+
+void addFusedColumns(FusedHaversine *fused, PointColumns *points) {
+  TimeBandwidth(__func__, points->num_points * sizeof(Point));
+  ScopedTemporaryMemory answer_memory(fused->scratch);
+  const u64 kBatchSize = KILOBYTES(1);
+  f64 *answers = pushArray<f64>(answer_memory, kBatchSize);
+
+  for (u64 first = 0; first < points->num_points; first += kBatchSize) {
+    PointColumns batch = {};
+    batch.x0 = points->x0 + first;
+    batch.y0 = points->y0 + first;
+    batch.x1 = points->x1 + first;
+    batch.y1 = points->y1 + first;
+    batch.num_points = points->num_points - first < kBatchSize ? points->num_points - first
+                                                               : kBatchSize;
+
+    fused->kernel(&batch, 0, batch.num_points, answers);
+    addFusedAnswers(fused, answers, batch.num_points);
+  }
+}
+
+u64 addFusedRecords(FusedHaversine *fused, EntireFile *records, u32 first_line) {
+  TimeBandwidth(__func__, records->size);
+  u64 offset = skipRecordSeparator(records, 0);
+  u64 result = 0;
+  LineOrigin origin = {(const char *)records->data, first_line};
+
+  while (offset < records->size && !fused->stopped) {
+    ScopedTemporaryMemory slice_memory(fused->scratch);
+    u64 slice_end = records->size;
+    if (records->size - offset > kFusedSliceSize) {
+      slice_end = findNextRecord(records, offset + kFusedSliceSize);
+      // NOTE(chogan): A long enough stretch without a `{` is cut short, and the
+      // slice that gets cut partway into a record is handled below
+      if (slice_end - offset > kMaxFusedSliceSize) {
+        slice_end = offset + kMaxFusedSliceSize;
+      }
+    }
+
+    EntireFile slice = {};
+    slice.data = records->data + offset;
+    slice.size = slice_end - offset;
+
+    TokenArray tokens = tokenize(slice_memory, &slice, false, &origin);
+    PointArray points = {};
+    points.data = pushArray<Point>(slice_memory, getMaxRecordCount(&tokens));
+    u32 index = 0;
+    points.num_points = (u32)parseRecords(&tokens, &index, points.data);
+    if (points.num_points) {
+      result = offset + getRecordsEnd(&tokens, index);
+    }
+
+    // NOTE(chogan): The slice started on a record, so if it parsed right up to
+    // its end then the next one does too. Otherwise the slice ended partway
+    // into a record, which could be because slice_end was in a string or a
+    // nested object, and the next slice starts on that record instead.
+    if (index == tokens.count) {
+      offset = slice_end;
+    } else if (getTokenType(tokens.head[index]) != TokenType::OpenCurlyBrace) {
+      fused->stopped = true;
+    } else if (slice_end == records->size) {
+      // NOTE(chogan): Left for the caller to hand over again
+      offset = records->size;
+    } else if (points.num_points) {
+      offset += getTokenOffset(tokens.head[index]);
+    } else {
+      fprintf(stderr, "ERROR: No complete record in %llu bytes\n",
+              (unsigned long long)slice.size);
+      fused->stopped = true;
+    }
+
+    PointColumns columns = toPointColumns(slice_memory, &points);
+    f64 *answers = pushArray<f64>(slice_memory, columns.num_points);
+    fused->kernel(&columns, 0, columns.num_points, answers);
+    addFusedAnswers(fused, answers, columns.num_points);
+  }
+
+  return result;
+}
+
+bool endFusedHaversine(FusedHaversine *fused, f64 *average) {
+  bool result = true;
+  *average = (fused->sum + fused->compensation) / (f64)fused->num_points;
+
+  if (fused->answers_file) {
+    writeFusedAnswer(fused, *average);
+    flushFusedAnswers(fused);
+    if (fclose(fused->answers_file) != 0 || fused->write_error) {
+      fprintf(stderr, "ERROR: Failed writing answers\n");
+      result = false;
+    }
+    fused->answers_file = NULL;
+  }
+
+  return result;
+}
@@ -0,0 +1,44 @@
+#ifndef PERFAWARE_FUSED_H_
+#define PERFAWARE_FUSED_H_
+
+#include <stdio.h>
+
+// NOTE(chogan): Computes the average haversine distance without ever holding
+// all the points or answers. Records are parsed a cache-sized slice at a time
+// into a small column batch, the batch goes straight through the haversine
+// kernel, and the answers are folded into a compensated (Neumaier) sum and
+// optionally written out. Memory use is fixed no matter how big the input is.
+struct FusedHaversine {
+  Arena *scratch;
+  HaversineKernelFunc *kernel;
+  FILE *answers_file;
+  char *format_buffer;
+  u64 format_used;
+  f64 sum;
+  f64 compensation;
+  u64 num_points;
+  bool write_error;
+  // NOTE(chogan): Set once something other than a record shows up, like the
+  // closing `]}`. Nothing after it is added.
+  bool stopped;
+};
+
+// NOTE(chogan): The most `scratch` memory the fused path uses, not counting
+// whatever feeds it records or columns.
+u64 getFusedScratchSize();
+// NOTE(chogan): `answers_path` may be NULL. Otherwise every answer, then the
+// average, is written there in the same text format point_generator uses.
+bool beginFusedHaversine(FusedHaversine *fused, Arena *scratch, HaversineKernel kernel,
+                         const char *answers_path);
+// NOTE(chogan): `records` starts on a record, or on the `,` before one, like
+// the runs runReadPipeline hands out, and may end partway into a record.
+// Returns the offset in `records` just past the last complete record that was
+// added, or 0 if there wasn't one. `first_line` is the line of the file
+// `records` starts on, for error messages.
+u64 addFusedRecords(FusedHaversine *fused, EntireFile *records, u32 first_line);
+void addFusedColumns(FusedHaversine *fused, PointColumns *points);
+// NOTE(chogan): Closes the answers file, failing if anything couldn't be
+// written to it. `average` is set either way.
+bool endFusedHaversine(FusedHaversine *fused, f64 *average);
+
+#endif  // PERFAWARE_FUSED_H_
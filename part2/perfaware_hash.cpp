@@ -0,0 +1,102 @@
+#include "perfaware_hash.h"
+
+const u64 kHashPrime1 = 0x9E3779B185EBCA87ULL;
+const u64 kHashPrime2 = 0xC2B2AE3D27D4EB4FULL;
+const u64 kHashPrime3 = 0x165667B19E3779F9ULL;
+const u64 kHashPrime4 = 0x85EBCA77C2B2AE63ULL;
+const u64 kHashPrime5 = 0x27D4EB2F165667C5ULL;
+
+static inline u64 rotateLeft(u64 value, u32 bits) {
+  u64 result = (value << bits) | (value >> (64 - bits));
+
+  return result;
+}
+
+static inline u64 readU64(const u8 *at) {
+  u64 result = 0;
+  memcpy(&result, at, sizeof(result));
+
+  return result;
+}
+
+static inline u32 readU32(const u8 *at) {
+  u32 result = 0;
+  memcpy(&result, at, sizeof(result));
+
+  return result;
+}
+
+static inline u64 hashRound(u64 acc, u64 input) {
+  acc += input * kHashPrime2;
+  acc = rotateLeft(acc, 31);
+  acc *= kHashPrime1;
+
+  return acc;
+}
+
+static inline u64 mergeRound(u64 acc, u64 value) {
+  acc ^= hashRound(0, value);
+  acc = acc * kHashPrime1 + kHashPrime4;
+
+  return acc;
+}
+
+u64 hashBytes(const void *data, u64 size, u64 seed) {
+  const u8 *at = (const u8 *)data;
+  const u8 *end = at + size;
+  u64 result = 0;
+
+  if (size >= 32) {
+    // NOTE(chogan): Four independent lanes so the multiplies overlap.
+    u64 v1 = seed + kHashPrime1 + kHashPrime2;
+    u64 v2 = seed + kHashPrime2;
+    u64 v3 = seed;
+    u64 v4 = seed - kHashPrime1;
+    const u8 *limit = end - 32;
+
+    do {
+      v1 = hashRound(v1, readU64(at));
+      v2 = hashRound(v2, readU64(at + 8));
+      v3 = hashRound(v3, readU64(at + 16));
+      v4 = hashRound(v4, readU64(at + 24));
+      at += 32;
+    } while (at <= limit);
+
+    result = (rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) +
+              rotateLeft(v4, 18));
+    result = mergeRound(result, v1);
+    result = mergeRound(result, v2);
+    result = mergeRound(result, v3);
+    result = mergeRound(result, v4);
+  } else {
+    result = seed + kHashPrime5;
+  }
+
+  result += size;
+
+  while (end - at >= 8) {
+    result ^= hashRound(0, readU64(at));
+    result = rotateLeft(result, 27) * kHashPrime1 + kHashPrime4;
+    at += 8;
+  }
+
+  if (end - at >= 4) {
+    result ^= (u64)readU32(at) * kHashPrime1;
+    result = rotateLeft(result, 23) * kHashPrime2 + kHashPrime3;
+    at += 4;
+  }
+
+  while (at < end) {
+    result ^= (*at) * kHashPrime5;
+    result = rotateLeft(result, 11) * kHashPrime1;
+    at++;
+  }
+
+  result ^= result >> 33;
+  result *= kHashPrime2;
+  result ^= result >> 29;
+  result *= kHashPrime3;
+  result ^= result >> 32;
+
+  return result;
+}
@@ -0,0 +1,9 @@
+#ifndef PERFAWARE_HASH_H_
+#define PERFAWARE_HASH_H_
+
+// NOTE(chogan): 64-bit xxHash (XXH64). Not cryptographic, just fast enough to
+// checksum whole datasets at memory bandwidth. Feed the result of one call in
+// as the `seed` of the next to hash several buffers as one.
+u64 hashBytes(const void *data, u64 size, u64 seed = 0);
+
+#endif  // PERFAWARE_HASH_H_
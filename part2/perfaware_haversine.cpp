@@ -1,4 +1,7 @@
+#include "perfaware_cpu.h"
 #include "perfaware_haversine.h"
+#include "perfaware_math.h"
+#include "perfaware_thread.h"
 
 const f64 kEarthRadius = 6372.8;
 
@@ -22,3 +25,514 @@ f64 *calculateHaversine(Arena *arena, Point *points, u64 num_points) {
 
   return haversine_answers;
 }
+
+PointColumns toPointColumns(Arena *arena, PointArray *points) {
+  TimeBandwidth(__func__, points->num_points * sizeof(Point));
+  PointColumns result = {};
+  u64 num_points = points->num_points;
+
+  result.x0 = pushArray<f64>(arena, num_points);
+  result.y0 = pushArray<f64>(arena, num_points);
+  result.x1 = pushArray<f64>(arena, num_points);
+  result.y1 = pushArray<f64>(arena, num_points);
+  result.num_points = num_points;
+
+  for (u64 i = 0; i < num_points; ++i) {
+    Point *point = points->data + i;
+    result.x0[i] = point->x0;
+    result.y0[i] = point->y0;
+    result.x1[i] = point->x1;
+    result.y1[i] = point->y1;
+  }
+
+  return result;
+}
+
+const char *kHaversineKernelNames[HaversineKernel_Count] = {
+  "reference",
+  "avx2",
+  "avx512",
+};
+
+// NOTE(chogan): The SIMD kernels replace libm with polynomials that only have
+// to cover the ranges the haversine formula actually produces for longitudes
+// in [-180, 180] and latitudes in [-90, 90]:
+//
+//   sin(x), |x| <= pi     reflected into |x| <= pi/2, then x + x*z*P(z), z = x^2
+//   cos(x), |x| <= pi/2   as sin(pi/2 - |x|)
+//   asin(x), 0 <= x <= 1  x + x*z*Q(z) for x <= 0.5, otherwise
+//                         pi/2 - 2*asin(sqrt((1 - x)/2))
+//
+// P and Q are the MathAccuracy_Full polynomials from perfaware_math, with max
+// relative error 1.7e-16 and 1.1e-16. That's about as good as libm, but not
+// bit identical to it.
+//
+// The formula itself limits how close any two implementations can get. With
+// a = sin^2(c/2), an error of da in `a` moves the central angle c by about
+// 2*da/sin(c), which blows up for nearly antipodal points. A one ulp
+// difference in sin or cos changes the answer by about 1e-8 km once the points
+// are within ~1km of antipodal, and by up to 3e-4 km right at the antipode. So
+// the bound is
+//
+//   |kernel - ReferenceHaversine| <= 1e-13 * d + R * |2*asin(sqrt(a +- 8u)) - c|
+//
+// with u = 2^-53 and R the Earth radius: the polynomial error plus whatever
+// 8 ulps of error in `a` does to the answer. getHaversineErrorBound computes
+// it from the reference distance.
+static const MathPolynomial *kSinPolynomial = kSinPolynomials + MathAccuracy_Full;
+static const MathPolynomial *kAsinPolynomial = kAsinPolynomials + MathAccuracy_Full;
+const f64 kDegreesToRadians = 0.01745329251994329577;
+
+static f64 haversineReference(PointColumns *points, u64 first, u64 count, f64 *answers) {
+  f64 result = 0;
+
+  for (u64 i = first; i < first + count; ++i) {
+    f64 answer = ReferenceHaversine(points->x0[i], points->y0[i], points->x1[i],
+                                    points->y1[i], kEarthRadius);
+    answers[i] = answer;
+    result += answer;
+  }
+
+  return result;
+}
+
+PERFAWARE_TARGET("avx2,fma")
+static inline __m256d polynomialAvx2(__m256d z, const MathPolynomial *polynomial) {
+  const f64 *coefficients = polynomial->coefficients;
+  __m256d result = _mm256_set1_pd(coefficients[polynomial->count - 1]);
+  for (s32 i = (s32)polynomial->count - 2; i >= 0; --i) {
+    result = _mm256_fmadd_pd(result, z, _mm256_set1_pd(coefficients[i]));
+  }
+
+  return result;
+}
+
+// NOTE(chogan): |x| <= pi/2
+PERFAWARE_TARGET("avx2,fma")
+static inline __m256d sinReducedAvx2(__m256d x) {
+  __m256d z = _mm256_mul_pd(x, x);
+  __m256d p = polynomialAvx2(z, kSinPolynomial);
+  __m256d result = _mm256_fmadd_pd(_mm256_mul_pd(x, z), p, x);
+
+  return result;
+}
+
+// NOTE(chogan): |x| <= pi
+PERFAWARE_TARGET("avx2,fma")
+static inline __m256d sinAvx2(__m256d x) {
+  __m256d sign_bit = _mm256_set1_pd(-0.0);
+  __m256d sign = _mm256_and_pd(x, sign_bit);
+  __m256d abs_x = _mm256_andnot_pd(sign_bit, x);
+  __m256d reflected = _mm256_add_pd(_mm256_sub_pd(_mm256_set1_pd(kPiHi), abs_x),
+                                    _mm256_set1_pd(kPiLo));
+  __m256d reflect = _mm256_cmp_pd(abs_x, _mm256_set1_pd(kHalfPiHi), _CMP_GT_OQ);
+  __m256d reduced = _mm256_blendv_pd(abs_x, reflected, reflect);
+  __m256d result = _mm256_xor_pd(sinReducedAvx2(reduced), sign);
+
+  return result;
+}
+
+// NOTE(chogan): |x| <= pi/2
+PERFAWARE_TARGET("avx2,fma")
+static inline __m256d cosAvx2(__m256d x) {
+  __m256d abs_x = _mm256_andnot_pd(_mm256_set1_pd(-0.0), x);
+  __m256d reduced = _mm256_add_pd(_mm256_sub_pd(_mm256_set1_pd(kHalfPiHi), abs_x),
+                                  _mm256_set1_pd(kHalfPiLo));
+  __m256d result = sinReducedAvx2(reduced);
+
+  return result;
+}
+
+// NOTE(chogan): 0 <= x <= 1
+PERFAWARE_TARGET("avx2,fma")
+static inline __m256d asinAvx2(__m256d x) {
+  __m256d half = _mm256_set1_pd(0.5);
+  __m256d big = _mm256_cmp_pd(x, half, _CMP_GT_OQ);
+  __m256d t = _mm256_sqrt_pd(_mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(1.0), x), half));
+  __m256d reduced = _mm256_blendv_pd(x, t, big);
+
+  __m256d z = _mm256_mul_pd(reduced, reduced);
+  __m256d q = polynomialAvx2(z, kAsinPolynomial);
+  __m256d p = _mm256_fmadd_pd(_mm256_mul_pd(reduced, z), q, reduced);
+
+  __m256d unreduced = _mm256_add_pd(_mm256_fnmadd_pd(_mm256_set1_pd(2.0), p,
+                                                     _mm256_set1_pd(kHalfPiHi)),
+                                    _mm256_set1_pd(kHalfPiLo));
+  __m256d result = _mm256_blendv_pd(p, unreduced, big);
+
+  return result;
+}
+
+PERFAWARE_TARGET("avx2,fma")
+static inline __m256d haversineAvx2(__m256d x0, __m256d y0, __m256d x1, __m256d y1) {
+  __m256d to_radians = _mm256_set1_pd(kDegreesToRadians);
+  __m256d half = _mm256_set1_pd(0.5);
+
+  __m256d d_lat = _mm256_mul_pd(_mm256_sub_pd(y1, y0), to_radians);
+  __m256d d_lon = _mm256_mul_pd(_mm256_sub_pd(x1, x0), to_radians);
+  __m256d lat1 = _mm256_mul_pd(y0, to_radians);
+  __m256d lat2 = _mm256_mul_pd(y1, to_radians);
+
+  __m256d sin_lat = sinReducedAvx2(_mm256_mul_pd(d_lat, half));
+  __m256d sin_lon = sinAvx2(_mm256_mul_pd(d_lon, half));
+  __m256d cos_product = _mm256_mul_pd(cosAvx2(lat1), cosAvx2(lat2));
+
+  // NOTE(chogan): Same operation order as ReferenceHaversine and no FMA. See
+  // the note on accuracy above.
+  __m256d a = _mm256_add_pd(_mm256_mul_pd(sin_lat, sin_lat),
+                            _mm256_mul_pd(cos_product, _mm256_mul_pd(sin_lon, sin_lon)));
+  // NOTE(chogan): Rounding can push `a` a hair past 1 for antipodal points
+  a = _mm256_min_pd(a, _mm256_set1_pd(1.0));
+  __m256d c = _mm256_mul_pd(_mm256_set1_pd(2.0), asinAvx2(_mm256_sqrt_pd(a)));
+  __m256d result = _mm256_mul_pd(_mm256_set1_pd(kEarthRadius), c);
+
+  return result;
+}
+
+PERFAWARE_TARGET("avx2,fma")
+static f64 haversineKernelAvx2(PointColumns *points, u64 first, u64 count, f64 *answers) {
+  const u32 kLanes = 4;
+  __m256d sum = _mm256_setzero_pd();
+  u64 i = first;
+  u64 end = first + count;
+
+  for (; i + kLanes <= end; i += kLanes) {
+    __m256d answer = haversineAvx2(_mm256_loadu_pd(points->x0 + i),
+                                   _mm256_loadu_pd(points->y0 + i),
+                                   _mm256_loadu_pd(points->x1 + i),
+                                   _mm256_loadu_pd(points->y1 + i));
+    _mm256_storeu_pd(answers + i, answer);
+    sum = _mm256_add_pd(sum, answer);
+  }
+
+  // NOTE(chogan): Zero padding contributes a distance of 0
+  if (i < end) {
+    u64 remaining = end - i;
+    f64 x0[kLanes] = {};
+    f64 y0[kLanes] = {};
+    f64 x1[kLanes] = {};
+    f64 y1[kLanes] = {};
+    f64 tail[kLanes] = {};
+    memcpy(x0, points->x0 + i, remaining * sizeof(f64));
+    memcpy(y0, points->y0 + i, remaining * sizeof(f64));
+    memcpy(x1, points->x1 + i, remaining * sizeof(f64));
+    memcpy(y1, points->y1 + i, remaining * sizeof(f64));
+
+    __m256d answer = haversineAvx2(_mm256_loadu_pd(x0), _mm256_loadu_pd(y0),
+                                   _mm256_loadu_pd(x1), _mm256_loadu_pd(y1));
+    _mm256_storeu_pd(tail, answer);
+    memcpy(answers + i, tail, remaining * sizeof(f64));
+    sum = _mm256_add_pd(sum, answer);
+  }
+
+  f64 lanes[kLanes];
+  _mm256_storeu_pd(lanes, sum);
+  f64 result = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+
+  return result;
+}
+
+// NOTE(chogan): GCC 12 warns that the unmasked _mm512_sqrt_pd and
+// _mm512_min_pd read an uninitialized register (they're implemented as masked
+// ops on _mm512_undefined_pd). The zero-masked forms with every lane enabled
+// compile to the same instructions without the warning.
+const __mmask8 kAllLanes = 0xff;
+
+PERFAWARE_TARGET("avx512f")
+static inline __m512d polynomialAvx512(__m512d z, const MathPolynomial *polynomial) {
+  const f64 *coefficients = polynomial->coefficients;
+  __m512d result = _mm512_set1_pd(coefficients[polynomial->count - 1]);
+  for (s32 i = (s32)polynomial->count - 2; i >= 0; --i) {
+    result = _mm512_fmadd_pd(result, z, _mm512_set1_pd(coefficients[i]));
+  }
+
+  return result;
+}
+
+PERFAWARE_TARGET("avx512f")
+static inline __m512d sinReducedAvx512(__m512d x) {
+  __m512d z = _mm512_mul_pd(x, x);
+  __m512d p = polynomialAvx512(z, kSinPolynomial);
+  __m512d result = _mm512_fmadd_pd(_mm512_mul_pd(x, z), p, x);
+
+  return result;
+}
+
+// NOTE(chogan): AVX-512F has no floating point and/xor (that's AVX-512DQ), so
+// the sign is handled with integer ops.
+PERFAWARE_TARGET("avx512f")
+static inline __m512d sinAvx512(__m512d x) {
+  __m512i sign_bit = _mm512_set1_epi64((s64)0x8000000000000000ULL);
+  __m512i sign = _mm512_and_si512(_mm512_castpd_si512(x), sign_bit);
+  __m512d abs_x = _mm512_abs_pd(x);
+  __m512d reflected = _mm512_add_pd(_mm512_sub_pd(_mm512_set1_pd(kPiHi), abs_x),
+                                    _mm512_set1_pd(kPiLo));
+  __mmask8 reflect = _mm512_cmp_pd_mask(abs_x, _mm512_set1_pd(kHalfPiHi), _CMP_GT_OQ);
+  __m512d reduced = _mm512_mask_blend_pd(reflect, abs_x, reflected);
+  __m512i sin = _mm512_castpd_si512(sinReducedAvx512(reduced));
+  __m512d result = _mm512_castsi512_pd(_mm512_xor_si512(sin, sign));
+
+  return result;
+}
+
+PERFAWARE_TARGET("avx512f")
+static inline __m512d cosAvx512(__m512d x) {
+  __m512d reduced = _mm512_add_pd(_mm512_sub_pd(_mm512_set1_pd(kHalfPiHi), _mm512_abs_pd(x)),
+                                  _mm512_set1_pd(kHalfPiLo));
+  __m512d result = sinReducedAvx512(reduced);
+
+  return result;
+}
+
+PERFAWARE_TARGET("avx512f")
+static inline __m512d asinAvx512(__m512d x) {
+  __m512d half = _mm512_set1_pd(0.5);
+  __mmask8 big = _mm512_cmp_pd_mask(x, half, _CMP_GT_OQ);
+  __m512d t = _mm512_maskz_sqrt_pd(kAllLanes,
+                                   _mm512_mul_pd(_mm512_sub_pd(_mm512_set1_pd(1.0), x), half));
+  __m512d reduced = _mm512_mask_blend_pd(big, x, t);
+
+  __m512d z = _mm512_mul_pd(reduced, reduced);
+  __m512d q = polynomialAvx512(z, kAsinPolynomial);
+  __m512d p = _mm512_fmadd_pd(_mm512_mul_pd(reduced, z), q, reduced);
+
+  __m512d unreduced = _mm512_add_pd(_mm512_fnmadd_pd(_mm512_set1_pd(2.0), p,
+                                                     _mm512_set1_pd(kHalfPiHi)),
+                                    _mm512_set1_pd(kHalfPiLo));
+  __m512d result = _mm512_mask_blend_pd(big, p, unreduced);
+
+  return result;
+}
+
+PERFAWARE_TARGET("avx512f")
+static inline __m512d haversineAvx512(__m512d x0, __m512d y0, __m512d x1, __m512d y1) {
+  __m512d to_radians = _mm512_set1_pd(kDegreesToRadians);
+  __m512d half = _mm512_set1_pd(0.5);
+
+  __m512d d_lat = _mm512_mul_pd(_mm512_sub_pd(y1, y0), to_radians);
+  __m512d d_lon = _mm512_mul_pd(_mm512_sub_pd(x1, x0), to_radians);
+  __m512d lat1 = _mm512_mul_pd(y0, to_radians);
+  __m512d lat2 = _mm512_mul_pd(y1, to_radians);
+
+  __m512d sin_lat = sinReducedAvx512(_mm512_mul_pd(d_lat, half));
+  __m512d sin_lon = sinAvx512(_mm512_mul_pd(d_lon, half));
+  __m512d cos_product = _mm512_mul_pd(cosAvx512(lat1), cosAvx512(lat2));
+
+  __m512d a = _mm512_add_pd(_mm512_mul_pd(sin_lat, sin_lat),
+                            _mm512_mul_pd(cos_product, _mm512_mul_pd(sin_lon, sin_lon)));
+  a = _mm512_maskz_min_pd(kAllLanes, a, _mm512_set1_pd(1.0));
+  __m512d c = _mm512_mul_pd(_mm512_set1_pd(2.0), asinAvx512(_mm512_maskz_sqrt_pd(kAllLanes, a)));
+  __m512d result = _mm512_mul_pd(_mm512_set1_pd(kEarthRadius), c);
+
+  return result;
+}
+
+PERFAWARE_TARGET("avx512f")
+static f64 haversineKernelAvx512(PointColumns *points, u64 first, u64 count, f64 *answers) {
+  const u32 kLanes = 8;
+  __m512d sum = _mm512_setzero_pd();
+  u64 i = first;
+  u64 end = first + count;
+
+  for (; i + kLanes <= end; i += kLanes) {
+    __m512d answer = haversineAvx512(_mm512_loadu_pd(points->x0 + i),
+                                     _mm512_loadu_pd(points->y0 + i),
+                                     _mm512_loadu_pd(points->x1 + i),
+                                     _mm512_loadu_pd(points->y1 + i));
+    _mm512_storeu_pd(answers + i, answer);
+    sum = _mm512_add_pd(sum, answer);
+  }
+
+  // NOTE(chogan): Masked lanes load as 0, which is a distance of 0
+  if (i < end) {
+    __mmask8 mask = (__mmask8)((1u << (end - i)) - 1);
+    __m512d answer = haversineAvx512(_mm512_maskz_loadu_pd(mask, points->x0 + i),
+                                     _mm512_maskz_loadu_pd(mask, points->y0 + i),
+                                     _mm512_maskz_loadu_pd(mask, points->x1 + i),
+                                     _mm512_maskz_loadu_pd(mask, points->y1 + i));
+    _mm512_mask_storeu_pd(answers + i, mask, answer);
+    sum = _mm512_add_pd(sum, answer);
+  }
+
+  f64 lanes[kLanes];
+  _mm512_storeu_pd(lanes, sum);
+  f64 result = (((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+                ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7])));
+
+  return result;
+}
+
+f64 getHaversineErrorBound(HaversineKernel kernel, f64 distance) {
+  f64 result = 0;
+
+  if (kernel != HaversineKernel_Reference) {
+    const f64 kSlack = 8 * 1.1102230246251565e-16;
+    f64 c = distance / kEarthRadius;
+    f64 a = sin(0.5 * c) * sin(0.5 * c);
+    f64 c_high = 2 * asin(sqrt(fmin(a + kSlack, 1.0)));
+    f64 c_low = 2 * asin(sqrt(fmax(a - kSlack, 0.0)));
+    result = 1e-13 * distance + kEarthRadius * fmax(c_high - c, c - c_low);
+  }
+
+  return result;
+}
+
+bool parseHaversineKernel(const char *name, HaversineKernel *kernel) {
+  bool result = false;
+
+  for (u32 i = 0; i < HaversineKernel_Count; ++i) {
+    if (strcmp(name, kHaversineKernelNames[i]) == 0) {
+      *kernel = (HaversineKernel)i;
+      result = true;
+      break;
+    }
+  }
+
+  return result;
+}
+
+bool isHaversineKernelSupported(HaversineKernel kernel) {
+  CpuFeatures *cpu = getCpuFeatures();
+  bool result = false;
+
+  switch (kernel) {
+    case HaversineKernel_Reference: {
+      result = true;
+      break;
+    }
+    case HaversineKernel_Avx2: {
+      result = cpu->avx2 && cpu->fma;
+      break;
+    }
+    case HaversineKernel_Avx512: {
+      result = cpu->avx512f;
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+
+  return result;
+}
+
+HaversineKernel getBestHaversineKernel() {
+  HaversineKernel result = HaversineKernel_Reference;
+
+  if (isHaversineKernelSupported(HaversineKernel_Avx512)) {
+    result = HaversineKernel_Avx512;
+  } else if (isHaversineKernelSupported(HaversineKernel_Avx2)) {
+    result = HaversineKernel_Avx2;
+  }
+
+  return result;
+}
+
+HaversineKernelFunc *getHaversineKernelFunc(HaversineKernel kernel) {
+  HaversineKernelFunc *result = haversineReference;
+
+  switch (kernel) {
+    case HaversineKernel_Avx2: {
+      result = haversineKernelAvx2;
+      break;
+    }
+    case HaversineKernel_Avx512: {
+      result = haversineKernelAvx512;
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+
+  return result;
+}
+
+// NOTE(chogan): The sum of the answers is built from fixed size blocks that
+// don't depend on the thread count: each block is summed by the kernel, then
+// the block sums are added pairwise in a fixed tree. Threads only decide who
+// computes which blocks, so the average is bit identical for any number of
+// threads (for a given kernel).
+const u64 kHaversineBlockSize = 4096;
+
+struct HaversineWork {
+  PointColumns *points;
+  f64 *answers;
+  f64 *block_sums;
+  HaversineKernelFunc *kernel;
+  u64 first_block;
+  u64 block_count;
+};
+
+static void calculateHaversineBlocks(HaversineWork *work) {
+  u64 num_points = work->points->num_points;
+
+  for (u64 block = work->first_block; block < work->first_block + work->block_count; ++block) {
+    u64 first = block * kHaversineBlockSize;
+    u64 count = num_points - first < kHaversineBlockSize ? num_points - first : kHaversineBlockSize;
+    work->block_sums[block] = work->kernel(work->points, first, count, work->answers);
+  }
+}
+
+f64 pairwiseSum(f64 *values, u64 count) {
+  f64 result = 0;
+
+  if (count == 1) {
+    result = values[0];
+  } else if (count > 1) {
+    u64 half = count / 2;
+    result = pairwiseSum(values, half) + pairwiseSum(values + half, count - half);
+  }
+
+  return result;
+}
+
+f64 *calculateHaversine(Arena *arena, PointColumns *points, HaversineKernel kernel,
+                        u32 thread_count) {
+  TimeBandwidth(__func__, points->num_points * sizeof(Point));
+  assert(isHaversineKernelSupported(kernel));
+  assert(thread_count >= 1 && thread_count <= kMaxThreads);
+
+  // NOTE(chogan): Add 1 to store the avg
+  f64 *haversine_answers = pushArray<f64>(arena, points->num_points + 1);
+  ScopedTemporaryMemory block_memory(arena);
+  u64 block_count = (points->num_points + kHaversineBlockSize - 1) / kHaversineBlockSize;
+  f64 *block_sums = pushArray<f64>(block_memory, block_count);
+
+  if (thread_count > block_count) {
+    thread_count = block_count > 0 ? (u32)block_count : 1;
+  }
+
+  HaversineWork work[kMaxThreads] = {};
+  u64 blocks_per_thread = block_count / thread_count;
+  u64 extra_blocks = block_count % thread_count;
+  u64 next_block = 0;
+
+  for (u32 i = 0; i < thread_count; ++i) {
+    work[i].points = points;
+    work[i].answers = haversine_answers;
+    work[i].block_sums = block_sums;
+    work[i].kernel = getHaversineKernelFunc(kernel);
+    work[i].first_block = next_block;
+    work[i].block_count = blocks_per_thread + (i < extra_blocks ? 1 : 0);
+    next_block += work[i].block_count;
+  }
+  runOnThreads(calculateHaversineBlocks, work, thread_count);
+
+  f64 sum = pairwiseSum(block_sums, block_count);
+  haversine_answers[points->num_points] = sum / (f64)points->num_points;
+
+  return haversine_answers;
+}
+
+f64 *calculateHaversine(Arena *arena, PointColumns *points, HaversineKernel kernel) {
+  f64 *result = calculateHaversine(arena, points, kernel, 1);
+
+  return result;
+}
+
+f64 *calculateHaversine(Arena *arena, PointColumns *points) {
+  f64 *result = calculateHaversine(arena, points, getBestHaversineKernel());
+
+  return result;
+}
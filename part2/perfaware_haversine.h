@@ -13,4 +13,38 @@ struct PointArray {
   u32 num_points;
 };
 
+// NOTE(chogan): The same points as a PointArray, one array per coordinate.
+struct PointColumns {
+  f64 *x0;
+  f64 *y0;
+  f64 *x1;
+  f64 *y1;
+  u64 num_points;
+};
+
+enum HaversineKernel {
+  HaversineKernel_Reference,
+  HaversineKernel_Avx2,
+  HaversineKernel_Avx512,
+
+  HaversineKernel_Count
+};
+
+extern const char *kHaversineKernelNames[HaversineKernel_Count];
+
+// NOTE(chogan): Computes answers[first..first + count) and returns their sum.
+typedef f64 HaversineKernelFunc(PointColumns *points, u64 first, u64 count, f64 *answers);
+
+bool parseHaversineKernel(const char *name, HaversineKernel *kernel);
+bool isHaversineKernelSupported(HaversineKernel kernel);
+// NOTE(chogan): The widest kernel this CPU can run
+HaversineKernel getBestHaversineKernel();
+HaversineKernelFunc *getHaversineKernelFunc(HaversineKernel kernel);
+// NOTE(chogan): How far `kernel`'s answer for a pair `distance` km apart may
+// be from ReferenceHaversine's. 0 for the reference kernel.
+f64 getHaversineErrorBound(HaversineKernel kernel, f64 distance);
+// NOTE(chogan): Recursive halving, so the rounding error grows with log(count)
+// and the result only depends on the order of `values`
+f64 pairwiseSum(f64 *values, u64 count);
+
 #endif  // PERFAWARE_HAVERSINE_H_
@@ -0,0 +1,387 @@
+#include <string.h>
+
+#include "perfaware_float_parser.h"
+#include "perfaware_json_parser.h"
+#include "perfaware_json_cursor.h"
+
+const u32 kNoPendingValue = 0xffffffff;
+
+static inline const char *getTokenText(TokenArray *tokens, u32 index) {
+  const char *result = tokens->base + getTokenOffset(tokens->head[index]);
+
+  return result;
+}
+
+JsonValue getJsonRoot(TokenArray *tokens) {
+  JsonValue result = {};
+  result.tokens = tokens;
+  result.index = 0;
+
+  return result;
+}
+
+JsonType getJsonType(JsonValue value) {
+  JsonType result = JsonType_Invalid;
+
+  switch (getTokenTypeAt(value.tokens, value.index)) {
+    case TokenType::Number: result = JsonType_Number; break;
+    case TokenType::String: result = JsonType_String; break;
+    case TokenType::OpenBrace: result = JsonType_Array; break;
+    case TokenType::OpenCurlyBrace: result = JsonType_Object; break;
+    case TokenType::True: result = JsonType_Bool; break;
+    case TokenType::False: result = JsonType_Bool; break;
+    case TokenType::Null: result = JsonType_Null; break;
+    default: break;
+  }
+
+  return result;
+}
+
+u32 skipJsonValue(TokenArray *tokens, u32 index) {
+  u32 count = tokens->count;
+  TokenType type = getTokenTypeAt(tokens, index);
+  u32 result = index < count ? index + 1 : count;
+
+  if (type == TokenType::OpenBrace || type == TokenType::OpenCurlyBrace) {
+    s64 depth = 0;
+    u32 at = index;
+
+    do {
+      TokenType t = getTokenType(tokens->head[at++]);
+      depth += (s64)(t == TokenType::OpenBrace || t == TokenType::OpenCurlyBrace);
+      depth -= (s64)(t == TokenType::CloseBrace || t == TokenType::CloseCurlyBrace);
+    } while (depth > 0 && at < count);
+
+    result = depth == 0 ? at : count;
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Checks that the word at the token is exactly `word`. The
+// tokenizer has already turned away misspellings, but not a word cut off by the
+// end of the input.
+static bool matchesLiteral(JsonValue value, const char *word, u32 size) {
+  TokenArray *tokens = value.tokens;
+  u64 offset = getTokenOffset(tokens->head[value.index]);
+  const char *text = tokens->base + offset;
+  bool result = (offset + size <= tokens->size && memcmp(text, word, size) == 0 &&
+                 (offset + size == tokens->size || !isWordChar(text[size])));
+
+  return result;
+}
+
+bool getJsonNumber(JsonValue value, f64 *result) {
+  bool ok = getTokenTypeAt(value.tokens, value.index) == TokenType::Number;
+
+  if (ok) {
+    TokenArray *tokens = value.tokens;
+    u64 offset = getTokenOffset(tokens->head[value.index]);
+    *result = parseF64(tokens->base + offset, tokens->size - offset);
+  }
+
+  return ok;
+}
+
+bool getJsonBool(JsonValue value, bool *result) {
+  TokenType type = getTokenTypeAt(value.tokens, value.index);
+  bool ok = ((type == TokenType::True && matchesLiteral(value, "true", 4)) ||
+             (type == TokenType::False && matchesLiteral(value, "false", 5)));
+
+  if (ok) {
+    *result = type == TokenType::True;
+  }
+
+  return ok;
+}
+
+bool isJsonNull(JsonValue value) {
+  bool result = (getTokenTypeAt(value.tokens, value.index) == TokenType::Null &&
+                 matchesLiteral(value, "null", 4));
+
+  return result;
+}
+
+bool getJsonString(JsonValue value, JsonString *result) {
+  TokenArray *tokens = value.tokens;
+  bool ok = getTokenTypeAt(tokens, value.index) == TokenType::String;
+
+  if (ok) {
+    const char *data = getTokenText(tokens, value.index) + 1;
+    const char *end = tokens->base + tokens->size;
+    const char *at = data;
+    bool has_escapes = false;
+
+    while (at < end && *at != '"') {
+      if (*at == '\\') {
+        has_escapes = true;
+        at++;
+      }
+      at++;
+    }
+
+    ok = at < end;
+    if (ok) {
+      result->data = data;
+      result->size = (u32)(at - data);
+      result->has_escapes = has_escapes;
+    }
+  }
+
+  return ok;
+}
+
+static bool parseHex4(const char *at, const char *end, u32 *result) {
+  u32 value = 0;
+  bool ok = end - at >= 4;
+
+  for (u32 i = 0; i < 4 && ok; ++i) {
+    char c = at[i];
+    u32 digit = 0;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else {
+      ok = false;
+    }
+    value = value * 16 + digit;
+  }
+  *result = value;
+
+  return ok;
+}
+
+static u32 encodeUtf8(u32 code_point, char *dest) {
+  u32 result = 0;
+
+  if (code_point < 0x80) {
+    dest[result++] = (char)code_point;
+  } else if (code_point < 0x800) {
+    dest[result++] = (char)(0xc0 | (code_point >> 6));
+    dest[result++] = (char)(0x80 | (code_point & 0x3f));
+  } else if (code_point < 0x10000) {
+    dest[result++] = (char)(0xe0 | (code_point >> 12));
+    dest[result++] = (char)(0x80 | ((code_point >> 6) & 0x3f));
+    dest[result++] = (char)(0x80 | (code_point & 0x3f));
+  } else {
+    dest[result++] = (char)(0xf0 | (code_point >> 18));
+    dest[result++] = (char)(0x80 | ((code_point >> 12) & 0x3f));
+    dest[result++] = (char)(0x80 | ((code_point >> 6) & 0x3f));
+    dest[result++] = (char)(0x80 | (code_point & 0x3f));
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Decodes one character or escape at `*at` into `dest` (at most 4
+// bytes) and advances `*at` past it. Returns the number of bytes written, or 0
+// for a bad escape.
+static u32 decodeJsonChar(const char **at, const char *end, char *dest) {
+  const char *p = *at;
+  u32 result = 0;
+
+  if (*p != '\\') {
+    dest[result++] = *p++;
+  } else if (p + 1 < end) {
+    char escape = p[1];
+    p += 2;
+
+    switch (escape) {
+      case '"': dest[result++] = '"'; break;
+      case '\\': dest[result++] = '\\'; break;
+      case '/': dest[result++] = '/'; break;
+      case 'b': dest[result++] = '\b'; break;
+      case 'f': dest[result++] = '\f'; break;
+      case 'n': dest[result++] = '\n'; break;
+      case 'r': dest[result++] = '\r'; break;
+      case 't': dest[result++] = '\t'; break;
+      case 'u': {
+        u32 code_point = 0;
+        if (parseHex4(p, end, &code_point)) {
+          p += 4;
+          if (code_point >= 0xd800 && code_point < 0xdc00) {
+            u32 low = 0;
+            if (end - p >= 6 && p[0] == '\\' && p[1] == 'u' && parseHex4(p + 2, end, &low) &&
+                low >= 0xdc00 && low < 0xe000) {
+              p += 6;
+              code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+              result = encodeUtf8(code_point, dest);
+            }
+          } else if (code_point < 0xdc00 || code_point >= 0xe000) {
+            result = encodeUtf8(code_point, dest);
+          }
+        }
+        break;
+      }
+      default: {
+        break;
+      }
+    }
+  }
+  *at = p;
+
+  return result;
+}
+
+bool unescapeJsonString(JsonString *string, char *dest, u32 *size) {
+  bool result = true;
+
+  if (!string->has_escapes) {
+    memcpy(dest, string->data, string->size);
+    *size = string->size;
+  } else {
+    const char *at = string->data;
+    const char *end = at + string->size;
+    char *out = dest;
+
+    while (at < end && result) {
+      u32 written = decodeJsonChar(&at, end, out);
+      out += written;
+      result = written > 0;
+    }
+    *size = (u32)(out - dest);
+  }
+
+  return result;
+}
+
+bool jsonStringEquals(JsonString *string, const char *text) {
+  bool result = true;
+
+  if (!string->has_escapes) {
+    size_t text_size = strlen(text);
+    result = text_size == string->size && memcmp(string->data, text, text_size) == 0;
+  } else {
+    const char *at = string->data;
+    const char *end = at + string->size;
+
+    while (at < end && result) {
+      char decoded[4];
+      u32 size = decodeJsonChar(&at, end, decoded);
+      result = size > 0 && strnlen(text, size) == size && memcmp(text, decoded, size) == 0;
+      text += size;
+    }
+    result = result && *text == 0;
+  }
+
+  return result;
+}
+
+static JsonIterator beginJsonIterator(JsonValue value, TokenType open, TokenType close) {
+  JsonIterator result = {};
+  result.tokens = value.tokens;
+  result.next = value.index + 1;
+  result.pending = kNoPendingValue;
+  result.close = close;
+
+  if (getTokenTypeAt(value.tokens, value.index) != open) {
+    result.done = true;
+    result.failed = true;
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Skips the value that was last handed out (if any) and the
+// comma after it. Returns false, and finishes the iterator, at the closing
+// bracket or on an error.
+static bool advanceJsonIterator(JsonIterator *it) {
+  TokenArray *tokens = it->tokens;
+  u32 at = it->next;
+  bool result = false;
+
+  if (!it->done) {
+    if (it->pending != kNoPendingValue) {
+      at = skipJsonValue(tokens, it->pending);
+      it->pending = kNoPendingValue;
+
+      TokenType type = getTokenTypeAt(tokens, at);
+      if (type == TokenType::Comma) {
+        at++;
+        result = getTokenTypeAt(tokens, at) != it->close;
+        it->failed = !result;
+      } else {
+        it->failed = type != it->close;
+      }
+    } else {
+      TokenType type = getTokenTypeAt(tokens, at);
+      result = type != it->close;
+      it->failed = type == TokenType::Count;
+      result = result && !it->failed;
+    }
+
+    if (!result) {
+      it->done = true;
+      at++;
+    }
+    it->next = at;
+  }
+
+  return result;
+}
+
+JsonIterator iterateJsonObject(JsonValue object) {
+  JsonIterator result = beginJsonIterator(object, TokenType::OpenCurlyBrace,
+                                          TokenType::CloseCurlyBrace);
+
+  return result;
+}
+
+bool nextJsonField(JsonIterator *it, JsonString *key, JsonValue *value) {
+  bool result = advanceJsonIterator(it);
+
+  if (result) {
+    JsonValue key_value = {it->tokens, it->next};
+    result = (getTokenTypeAt(it->tokens, it->next + 1) == TokenType::Colon &&
+              getJsonString(key_value, key));
+
+    if (result) {
+      value->tokens = it->tokens;
+      value->index = it->next + 2;
+      it->pending = value->index;
+    } else {
+      it->done = true;
+      it->failed = true;
+    }
+  }
+
+  return result;
+}
+
+JsonIterator iterateJsonArray(JsonValue array) {
+  JsonIterator result = beginJsonIterator(array, TokenType::OpenBrace, TokenType::CloseBrace);
+
+  return result;
+}
+
+bool nextJsonElement(JsonIterator *it, JsonValue *value) {
+  bool result = advanceJsonIterator(it);
+
+  if (result) {
+    value->tokens = it->tokens;
+    value->index = it->next;
+    it->pending = value->index;
+  }
+
+  return result;
+}
+
+bool findJsonField(JsonValue object, const char *key, JsonValue *result) {
+  JsonIterator it = iterateJsonObject(object);
+  JsonString name = {};
+  JsonValue value = {};
+  bool found = false;
+
+  while (!found && nextJsonField(&it, &name, &value)) {
+    found = jsonStringEquals(&name, key);
+  }
+
+  if (found) {
+    *result = value;
+  }
+
+  return found;
+}
@@ -0,0 +1,74 @@
+#ifndef PERFAWARE_JSON_CURSOR_H_
+#define PERFAWARE_JSON_CURSOR_H_
+
+// NOTE(chogan): On demand access to any JSON document through its token tape
+// (see tokenize). A JsonValue is just a token index, and nothing is parsed
+// until it's asked for: numbers are converted by getJsonNumber, strings are
+// only measured and unescaped when they're read, and a value that isn't
+// wanted is skipped by walking its tokens without looking at the text. So a
+// consumer pays for the fields it reads and not for the rest of the document.
+//
+// Every function fails (returns false, or an invalid value) rather than
+// reading past the tape on malformed input.
+
+enum JsonType {
+  JsonType_Invalid,
+  JsonType_Null,
+  JsonType_Bool,
+  JsonType_Number,
+  JsonType_String,
+  JsonType_Array,
+  JsonType_Object,
+
+  JsonType_Count
+};
+
+struct JsonValue {
+  TokenArray *tokens;
+  u32 index;
+};
+
+// NOTE(chogan): The raw text between the quotes, escapes and all
+struct JsonString {
+  const char *data;
+  u32 size;
+  bool has_escapes;
+};
+
+// NOTE(chogan): Walks the members of an object or the elements of an array.
+// Once the last one has been returned, `next` is the token after the closing
+// bracket. `failed` is set if the container turned out to be malformed.
+struct JsonIterator {
+  TokenArray *tokens;
+  u32 next;
+  u32 pending;
+  TokenType close;
+  bool done;
+  bool failed;
+};
+
+JsonValue getJsonRoot(TokenArray *tokens);
+JsonType getJsonType(JsonValue value);
+// NOTE(chogan): The index of the token after the value at `index`. Containers
+// are skipped by matching brackets on the tape. Returns `tokens->count` if the
+// brackets don't match.
+u32 skipJsonValue(TokenArray *tokens, u32 index);
+
+bool getJsonNumber(JsonValue value, f64 *result);
+bool getJsonBool(JsonValue value, bool *result);
+bool isJsonNull(JsonValue value);
+bool getJsonString(JsonValue value, JsonString *result);
+// NOTE(chogan): Decodes escapes (including \u with surrogate pairs, to UTF-8)
+// into `dest`, which needs `string->size` bytes. Returns false on a bad escape.
+bool unescapeJsonString(JsonString *string, char *dest, u32 *size);
+// NOTE(chogan): Compares the decoded string with the NUL terminated `text`
+bool jsonStringEquals(JsonString *string, const char *text);
+
+JsonIterator iterateJsonObject(JsonValue object);
+bool nextJsonField(JsonIterator *it, JsonString *key, JsonValue *value);
+JsonIterator iterateJsonArray(JsonValue array);
+bool nextJsonElement(JsonIterator *it, JsonValue *value);
+// NOTE(chogan): Looks through `object`'s keys, skipping the values it passes
+bool findJsonField(JsonValue object, const char *key, JsonValue *result);
+
+#endif  // PERFAWARE_JSON_CURSOR_H_
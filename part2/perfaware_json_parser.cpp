@@ -1,235 +1,790 @@
 #include <stdio.h>
 
+#include "perfaware_cpu.h"
+#include "perfaware_file.h"
+#include "perfaware_float_parser.h"
+#include "perfaware_json_cursor.h"
 #include "perfaware_json_parser.h"
+#include "perfaware_json_schema.h"
 #include "perfaware_memory.h"
+#include "perfaware_thread.h"
 
-EntireFile readEntireFile(Arena *arena, const char *path) {
-  EntireFile result = {};
-  FILE *fstream = fopen(path, "r");
-
-  if (fstream) {
-    int fseek_result = fseek(fstream, 0, SEEK_END);
-
-    if (fseek_result == 0) {
-      long file_size = ftell(fstream);
-
-      if (file_size > 0) {
-        if ((u32)file_size <= arena->capacity) {
-          fseek(fstream, 0, SEEK_SET);
-          result.data = pushArray<u8>(arena, file_size);
-          size_t items_read = 0;
-          {
-            TimeBandwidth("fread", file_size);
-            items_read = fread(result.data, file_size, 1, fstream);
-          }
-          assert(items_read == 1);
-          result.size = file_size;
-        } else {
-          // LOG(FATAL) << "Arena capacity (" << arena->capacity
-          //            << ") too small to read file of size (" << file_size
-          //            << ")" << std::endl;
-        }
-
-      } else {
-      }
-    } else {
-      // FailedLibraryCall("fseek");
-    }
+bool isWhitespace(char c) {
+  bool result = c == ' ' || c == '\t' || c == '\n' || c == '\r';
 
-    if (fclose(fstream) != 0) {
-      // FailedLibraryCall("fclose");
-    }
+  return result;
+}
 
-  } else {
-    // FailedLibraryCall("fopen");
-  }
+bool beginsNumber(char c) {
+  bool result = (c >= '0' && c <= '9') || (c == '.') || (c == '-');
 
   return result;
 }
 
-bool isWhitespace(char c) {
-  bool result = c == ' ' || c == '\t' || c == '\n' || c == '\r';
+bool isNumberChar(char c) {
+  bool result = beginsNumber(c) || c == 'e' || c == 'E' || c == '+';
 
   return result;
 }
 
-bool beginsNumber(char c) {
-  bool result = (c >= '0' && c <= '9') || (c == '.') || (c == '-');
+// NOTE(chogan): true, false and null are read as words of ASCII letters, so
+// that a misspelling is one error rather than one per letter
+bool isWordChar(char c) {
+  bool result = (u8)((c | 0x20) - 'a') < 26;
 
   return result;
 }
 
-bool endOfNumber(char c) {
-  bool result = (c == ',') || (c == '}');
+// NOTE(chogan): Tokens are reserved from the arena in bulk and whatever's left
+// of the last reservation is given back at the end. Nothing else is pushed to
+// the arena while tokenizing, so the reservations are contiguous.
+const u64 kTokenReserveCount = 4096;
+
+struct TokenTape {
+  Arena *arena;
+  Token *next;
+  Token *reserved_end;
+};
+
+static TokenTape beginTokenTape(Arena *arena, TokenArray *tokens) {
+  TokenTape result = {};
+  result.arena = arena;
+  result.next = (Token *)(arena->base + arena->used);
+  result.reserved_end = result.next;
+  tokens->head = result.next;
 
   return result;
 }
 
-bool isEndOfLine(char **at, char *end) {
-  // Linux style
-  bool result = (*at)[0] == '\n';
+// NOTE(chogan): Never reserves more than the arena has left, so input that
+// fits exactly still tokenizes.
+static inline void reserveTokens(TokenTape *tape, u64 count) {
+  u64 available = tape->reserved_end - tape->next;
 
-  // Windows style
-  if (*at + 1 < end && !result) {
-    result = ((*at)[0] == '\r' && (*at)[1] == '\n');
-    if (result) {
-      (*at)++;
+  if (available < count) {
+    u64 remaining = getRemainingCapacity(tape->arena) / sizeof(Token);
+    u64 reserve_count = kTokenReserveCount < remaining ? kTokenReserveCount : remaining;
+    if (reserve_count < count - available) {
+      reserve_count = count - available;
     }
+    pushArray<Token>(tape->arena, reserve_count);
+    tape->reserved_end += reserve_count;
+  }
+}
+
+static void endTokenTape(TokenTape *tape, TokenArray *tokens) {
+  tape->arena->used -= (tape->reserved_end - tape->next) * sizeof(Token);
+  tokens->count = (u32)(tape->next - tokens->head);
+
+  if (tokens->count == 0) {
+    tokens->head = NULL;
+  }
+}
+
+// NOTE(chogan): Eight bytes at a time, since the read pipeline counts every
+// buffer. After the xor a newline is a zero byte, which is the only kind that
+// ends up with its high bit set in `zeros`, and the multiply adds those bits up
+// in the top byte.
+u64 countNewlines(const u8 *data, u64 size) {
+  const u64 kOnes = 0x0101010101010101ULL;
+  const u64 kLowBits = 0x7f7f7f7f7f7f7f7fULL;
+  u64 result = 0;
+  u64 i = 0;
+
+  for (; i + 8 <= size; i += 8) {
+    u64 word;
+    memcpy(&word, data + i, sizeof(word));
+    word ^= kOnes * '\n';
+    u64 zeros = ~(((word & kLowBits) + kLowBits) | word | kLowBits);
+    result += ((zeros >> 7) * kOnes) >> 56;
+  }
+  for (; i < size; ++i) {
+    result += data[i] == '\n';
   }
 
   return result;
 }
 
-Token *getLastToken(TokenArray *arr) {
-  Token *result = NULL;
+// NOTE(chogan): Only for error messages, which (nearly always) come in file
+// order, so the newlines are only counted once. Counting starts from the
+// origin, which is before the tokenized buffer when that's part of a file.
+struct LineCounter {
+  const char *origin;
+  u64 offset;
+  u32 first_line;
+  u32 line;
+};
+
+static LineCounter beginLineCounter(const char *base, LineOrigin *origin) {
+  LineCounter result = {};
+  result.origin = origin ? origin->at : base;
+  result.first_line = origin ? origin->line : 1;
+  result.line = result.first_line;
 
-  if (arr && arr->head) {
-    result = &arr->head[arr->count - 1];
-  } else {
-    fprintf(stderr, "ERROR: arr is NULL: %s\n", __FUNCTION__);
+  return result;
+}
+
+static u32 getLineNumber(LineCounter *counter, const char *at) {
+  u64 offset = at - counter->origin;
+  if (offset < counter->offset) {
+    counter->offset = 0;
+    counter->line = counter->first_line;
+  }
+  for (; counter->offset < offset; ++counter->offset) {
+    counter->line += counter->origin[counter->offset] == '\n';
   }
 
-  return result;
+  return counter->line;
 }
 
-void addTokenToArray(Arena *arena, TokenArray *arr, TokenType type,
-                    u32 line_number) {
-  Token *tok = pushClearedStruct<Token>(arena);
-  tok->type = type;
-  tok->line = line_number;
-  if (!arr->head) {
-    arr->head = tok;
+static void reportUnexpectedChar(TokenArray *tokens, LineCounter *lines, u64 offset,
+                                 bool quiet) {
+  tokens->error_count++;
+  if (!quiet) {
+    fprintf(stderr, "Config parser encountered unexpected token on line %u: %c\n",
+            getLineNumber(lines, tokens->base + offset), tokens->base[offset]);
   }
-  arr->count++;
 }
 
-TokenArray tokenize(Arena *arena, EntireFile *entire_file) {
-  TimeFunction;
-  u32 line_number = 1;
+// NOTE(chogan): The type of the token that starts with `c`, other than a
+// number. Words only get a type if they start like true, false or null, and
+// the tokenizers check the rest of the spelling with isMisspelledLiteral.
+TokenType charTokenType(char c) {
+  switch (c) {
+    case ',': return TokenType::Comma;
+    case ':': return TokenType::Colon;
+    case '{': return TokenType::OpenCurlyBrace;
+    case '}': return TokenType::CloseCurlyBrace;
+    case '[': return TokenType::OpenBrace;
+    case ']': return TokenType::CloseBrace;
+    case '"': return TokenType::String;
+    case 't': return TokenType::True;
+    case 'f': return TokenType::False;
+    case 'n': return TokenType::Null;
+    default: return TokenType::Count;
+  }
+}
+
+// NOTE(chogan): Whether the word at `offset`, which charTokenType says is a
+// true, false or null, is spelled some other way. A word that runs off the end
+// of the input only has to match as far as it goes, since chunked callers hand
+// over input that can stop partway into a record, and that's for the parser to
+// deal with the same as a cut off string or number.
+static bool isMisspelledLiteral(const char *base, u64 size, u64 offset, TokenType type) {
+  const char *literal = (type == TokenType::True ? "true" :
+                         type == TokenType::False ? "false" : "null");
+  u64 length = strlen(literal);
+  u64 available = size - offset < length ? size - offset : length;
+  bool result = (memcmp(base + offset, literal, available) != 0 ||
+                 (offset + length < size && isWordChar(base[offset + length])));
+
+  return result;
+}
+
+TokenArray tokenizeScalar(Arena *arena, EntireFile *entire_file, bool quiet,
+                          LineOrigin *origin) {
   TokenArray result = {};
+  result.base = (const char *)entire_file->data;
+  result.size = entire_file->size;
+  TokenTape tape = beginTokenTape(arena, &result);
+  LineCounter lines = beginLineCounter(result.base, origin);
 
-  char *at = (char *)entire_file->data;
-  char *end = at + entire_file->size;
+  const char *base = result.base;
+  u64 size = result.size;
+  u64 at = 0;
 
-  while (at < end) {
-    if (isWhitespace(*at)) {
-      if (isEndOfLine(&at, end)) {
-        line_number++;
-      }
+  while (at < size) {
+    char c = base[at];
 
+    if (isWhitespace(c)) {
       ++at;
       continue;
     }
 
-    if (beginsNumber(*at)) {
-      addTokenToArray(arena, &result, TokenType::Number, line_number);
-      getLastToken(&result)->data = at;
+    reserveTokens(&tape, 1);
+    if (beginsNumber(c)) {
+      *tape.next++ = makeToken(TokenType::Number, at);
+      result.num_points++;
 
-      while (at && !endOfNumber(*at)) {
-        getLastToken(&result)->size++;
+      while (at < size && isNumberChar(base[at])) {
         at++;
       }
-      result.num_points++;
     } else {
-      switch (*at) {
-        case ',': {
-          addTokenToArray(arena, &result, TokenType::Comma, line_number);
-          break;
-        }
-        case '{': {
-          addTokenToArray(arena, &result, TokenType::OpenCurlyBrace, line_number);
-          break;
-        }
-        case '}': {
-          addTokenToArray(arena, &result, TokenType::CloseCurlyBrace, line_number);
-          break;
-        }
-        case '[': {
-          addTokenToArray(arena, &result, TokenType::OpenBrace, line_number);
-          break;
-        }
-        case ']': {
-          addTokenToArray(arena, &result, TokenType::CloseBrace, line_number);
-          break;
-        }
-        case ':': {
-          addTokenToArray(arena, &result, TokenType::Colon, line_number);
-          break;
-        }
-        case '"': {
-          addTokenToArray(arena, &result, TokenType::String, line_number);
-          at++;
-          getLastToken(&result)->data = at;
+      TokenType type = charTokenType(c);
+      if (type != TokenType::Count && isWordChar(c) &&
+          isMisspelledLiteral(base, size, at, type)) {
+        type = TokenType::Count;
+      }
+
+      if (type == TokenType::Count) {
+        reportUnexpectedChar(&result, &lines, at, quiet);
+      } else {
+        *tape.next++ = makeToken(type, at);
+      }
 
-          while (at && *at != '"') {
-            getLastToken(&result)->size++;
-            at++;
-          }
-          break;
+      if (type == TokenType::String) {
+        at++;
+        while (at < size && base[at] != '"') {
+          at += base[at] == '\\' ? 2 : 1;
         }
-        default: {
-          fprintf(stderr, "Config parser encountered unexpected token on line %u: %c\n", line_number, *at);
-          break;
+        at++;
+      } else if (isWordChar(c)) {
+        while (at < size && isWordChar(base[at])) {
+          at++;
         }
+      } else {
+        at++;
+      }
+    }
+  }
+
+  endTokenTape(&tape, &result);
+
+  return result;
+}
+
+// NOTE(chogan): One bit per byte of a 64 byte block. The SIMD classifiers fill
+// this in and `tokenizeBlocks` turns the set bits into tokens.
+struct BlockClassification {
+  u64 structural;
+  u64 quote;
+  u64 backslash;
+  u64 number;
+  u64 number_begin;
+  u64 word;
+  u64 other;
+};
+
+typedef void ClassifyBlockFunc(const char *block, BlockClassification *result);
+
+PERFAWARE_TARGET("avx2")
+static inline __m256i equalsAvx2(__m256i c, char x) {
+  return _mm256_cmpeq_epi8(c, _mm256_set1_epi8(x));
+}
+
+PERFAWARE_TARGET("avx2")
+static void classifyHalfAvx2(const char *at, u32 *masks) {
+  __m256i c = _mm256_loadu_si256((const __m256i *)at);
+
+  __m256i digit = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+  digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+
+  __m256i ws = _mm256_or_si256(_mm256_or_si256(equalsAvx2(c, ' '), equalsAvx2(c, '\t')),
+                               _mm256_or_si256(equalsAvx2(c, '\n'), equalsAvx2(c, '\r')));
+  __m256i st = _mm256_or_si256(_mm256_or_si256(equalsAvx2(c, '{'), equalsAvx2(c, '}')),
+                               _mm256_or_si256(equalsAvx2(c, '['), equalsAvx2(c, ']')));
+  st = _mm256_or_si256(st, _mm256_or_si256(equalsAvx2(c, ','), equalsAvx2(c, ':')));
+  __m256i qt = equalsAvx2(c, '"');
+  __m256i nb = _mm256_or_si256(digit, _mm256_or_si256(equalsAvx2(c, '.'), equalsAvx2(c, '-')));
+  __m256i nc = _mm256_or_si256(nb, _mm256_or_si256(_mm256_or_si256(equalsAvx2(c, 'e'),
+                                                                   equalsAvx2(c, 'E')),
+                                                   equalsAvx2(c, '+')));
+  __m256i bs = equalsAvx2(c, '\\');
+  __m256i wd = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+  wd = _mm256_cmpeq_epi8(_mm256_min_epu8(wd, _mm256_set1_epi8(25)), wd);
+  __m256i known = _mm256_or_si256(_mm256_or_si256(ws, st), _mm256_or_si256(qt, nc));
+  known = _mm256_or_si256(known, wd);
+
+  masks[0] = (u32)_mm256_movemask_epi8(st);
+  masks[1] = (u32)_mm256_movemask_epi8(qt);
+  masks[2] = (u32)_mm256_movemask_epi8(bs);
+  masks[3] = (u32)_mm256_movemask_epi8(nc);
+  masks[4] = (u32)_mm256_movemask_epi8(nb);
+  masks[5] = (u32)_mm256_movemask_epi8(wd);
+  masks[6] = ~(u32)_mm256_movemask_epi8(known);
+}
+
+PERFAWARE_TARGET("avx2")
+void classifyBlockAvx2(const char *block, BlockClassification *result) {
+  u32 lo[7];
+  u32 hi[7];
+  classifyHalfAvx2(block, lo);
+  classifyHalfAvx2(block + 32, hi);
+
+  result->structural = ((u64)hi[0] << 32) | lo[0];
+  result->quote = ((u64)hi[1] << 32) | lo[1];
+  result->backslash = ((u64)hi[2] << 32) | lo[2];
+  result->number = ((u64)hi[3] << 32) | lo[3];
+  result->number_begin = ((u64)hi[4] << 32) | lo[4];
+  result->word = ((u64)hi[5] << 32) | lo[5];
+  result->other = ((u64)hi[6] << 32) | lo[6];
+}
+
+PERFAWARE_TARGET("avx512f,avx512bw")
+static inline u64 equalsAvx512(__m512i c, char x) {
+  return _mm512_cmpeq_epi8_mask(c, _mm512_set1_epi8(x));
+}
+
+PERFAWARE_TARGET("avx512f,avx512bw")
+void classifyBlockAvx512(const char *block, BlockClassification *result) {
+  __m512i c = _mm512_loadu_si512((const void *)block);
+
+  __m512i digit = _mm512_sub_epi8(c, _mm512_set1_epi8('0'));
+  u64 digits = _mm512_cmple_epu8_mask(digit, _mm512_set1_epi8(9));
+
+  u64 whitespace = (equalsAvx512(c, '\n') | equalsAvx512(c, ' ') | equalsAvx512(c, '\t') |
+                    equalsAvx512(c, '\r'));
+  u64 structural = (equalsAvx512(c, '{') | equalsAvx512(c, '}') |
+                    equalsAvx512(c, '[') | equalsAvx512(c, ']') |
+                    equalsAvx512(c, ',') | equalsAvx512(c, ':'));
+  u64 quote = equalsAvx512(c, '"');
+  u64 number_begin = digits | equalsAvx512(c, '.') | equalsAvx512(c, '-');
+  u64 number = (number_begin | equalsAvx512(c, 'e') | equalsAvx512(c, 'E') |
+                equalsAvx512(c, '+'));
+  __m512i letter = _mm512_sub_epi8(_mm512_or_si512(c, _mm512_set1_epi8(0x20)),
+                                   _mm512_set1_epi8('a'));
+  u64 word = _mm512_cmple_epu8_mask(letter, _mm512_set1_epi8(25));
+
+  result->structural = structural;
+  result->quote = quote;
+  result->backslash = equalsAvx512(c, '\\');
+  result->number = number;
+  result->number_begin = number_begin;
+  result->word = word;
+  result->other = ~(whitespace | structural | quote | number | word);
+}
+
+// NOTE(chogan): Bit i of the result is the xor of bits 0 through i, so each
+// bit between an opening and closing quote ends up set.
+inline u64 prefixXor(u64 bits) {
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+
+  return bits;
+}
+
+// NOTE(chogan): Marks the characters escaped by a backslash: the ones right
+// after a run of an odd number of backslashes. Runs that start on even and odd
+// bits are handled separately, since adding a run's start bit to the run
+// carries out of its end, and whether the run was odd or even falls out of
+// where the carry lands. `carry` is set when a block ends in the middle of an
+// escape.
+static inline u64 findEscapedChars(u64 backslash, u64 *carry) {
+  const u64 kEvenBits = 0x5555555555555555ULL;
+  const u64 kOddBits = ~kEvenBits;
+
+  u64 start_edges = backslash & ~(backslash << 1);
+  u64 even_start_mask = kEvenBits ^ *carry;
+  u64 even_starts = start_edges & even_start_mask;
+  u64 odd_starts = start_edges & ~even_start_mask;
+  u64 even_carries = backslash + even_starts;
+  u64 odd_carries = backslash + odd_starts;
+  bool ends_odd = odd_carries < backslash;
+  odd_carries |= *carry;
+  *carry = ends_odd ? 1 : 0;
+
+  u64 even_carry_ends = even_carries & ~backslash;
+  u64 odd_carry_ends = odd_carries & ~backslash;
+  u64 result = (even_carry_ends & kOddBits) | (odd_carry_ends & kEvenBits);
+
+  return result;
+}
+
+// NOTE(chogan): Only called when AVX2 is available, which implies POPCNT.
+PERFAWARE_TARGET("popcnt,bmi")
+TokenArray tokenizeBlocks(Arena *arena, EntireFile *entire_file,
+                          ClassifyBlockFunc *classify, bool quiet, LineOrigin *origin) {
+  TokenArray result = {};
+  result.base = (const char *)entire_file->data;
+  result.size = entire_file->size;
+  TokenTape tape = beginTokenTape(arena, &result);
+  LineCounter lines = beginLineCounter(result.base, origin);
+
+  const char *base = result.base;
+  u64 size = result.size;
+  u64 previous_number = 0;
+  u64 previous_word = 0;
+  u64 escape_carry = 0;
+  u64 string_carry = 0;
+
+  for (u64 block = 0; block < size; block += 64) {
+    BlockClassification c;
+    if (block + 64 <= size) {
+      classify(base + block, &c);
+    } else {
+      // NOTE(chogan): Pad the final partial block with whitespace so the
+      // classifier can always load 64 bytes.
+      char tail[64];
+      memset(tail, ' ', sizeof(tail));
+      memcpy(tail, base + block, size - block);
+      classify(tail, &c);
+    }
+
+    // NOTE(chogan): A number starts where a number character isn't preceded by
+    // another one, including across the block boundary.
+    u64 number_starts = c.number_begin & ~((c.number << 1) | previous_number);
+    previous_number = c.number >> 63;
+    // NOTE(chogan): The same for words (true, false and null). The e in 1e5 is
+    // part of the number, not a word.
+    u64 word_starts = c.word & ~((c.word << 1) | previous_word) & ~c.number;
+    previous_word = c.word >> 63;
+
+    // NOTE(chogan): `inside` covers an opening quote up to, but not including,
+    // its closing quote. Anything in there is string contents, not a token.
+    if (c.backslash | escape_carry) {
+      c.quote &= ~findEscapedChars(c.backslash, &escape_carry);
+    }
+    u64 inside = prefixXor(c.quote) ^ string_carry;
+    string_carry = 0 - (inside >> 63);
+    u64 closing_quotes = c.quote & ~inside;
+    u64 events = ((c.structural | number_starts | word_starts | c.other | c.quote) &
+                  ~closing_quotes);
+    events &= ~inside | c.quote;
+
+    if (c.other) {
+      u64 other = c.other & ~inside;
+      while (other) {
+        u32 bit = countTrailingZeros(other);
+        other &= other - 1;
+        reportUnexpectedChar(&result, &lines, block + bit, quiet);
       }
-      at++;
+      events &= ~c.other;
     }
+
+    // NOTE(chogan): A token is written without branching on its type, since
+    // the type sequence is too irregular across block boundaries for the
+    // branch predictor.
+    u32 event_count = popCount(events);
+    reserveTokens(&tape, event_count);
+    Token *tok = tape.next;
+
+    while (events) {
+      u32 bit = countTrailingZeros(events);
+      events &= events - 1;
+
+      u64 is_number = (number_starts >> bit) & 1;
+      TokenType type = is_number ? TokenType::Number : charTokenType(base[block + bit]);
+      bool valid = type != TokenType::Count;
+      // NOTE(chogan): Words are rare enough that this branch is predictable
+      if (valid && ((word_starts >> bit) & 1)) {
+        valid = !isMisspelledLiteral(base, size, block + bit, type);
+      }
+      *tok = makeToken(type, block + bit);
+      tok += valid;
+      result.num_points += (u32)is_number;
+
+      // NOTE(chogan): A word that isn't true, false or null
+      if (!valid) {
+        reportUnexpectedChar(&result, &lines, block + bit, quiet);
+      }
+    }
+    tape.next = tok;
   }
 
+  endTokenTape(&tape, &result);
+
   return result;
 }
 
+u64 getMaxRecordCount(u64 size) {
+  u64 result = size / kMinRecordSize + 1;
+
+  return result;
+}
+
+u64 getMaxTokenBytes(u64 size) {
+  u64 result = size * sizeof(Token);
+
+  return result;
+}
+
+u64 getMaxRecordCount(TokenArray *tokens) {
+  u64 result = getMaxRecordCount(tokens->size);
+  if (tokens->num_points / 4 < result) {
+    result = tokens->num_points / 4;
+  }
+
+  return result;
+}
+
+TokenArray tokenize(Arena *arena, EntireFile *entire_file, bool quiet, LineOrigin *origin) {
+  TimeBandwidth(__func__, entire_file->size);
+  TokenArray result = {};
+  CpuFeatures *cpu = getCpuFeatures();
+
+  if (cpu->avx512bw) {
+    result = tokenizeBlocks(arena, entire_file, classifyBlockAvx512, quiet, origin);
+  } else if (cpu->avx2) {
+    result = tokenizeBlocks(arena, entire_file, classifyBlockAvx2, quiet, origin);
+  } else {
+    result = tokenizeScalar(arena, entire_file, quiet, origin);
+  }
+
+  return result;
+}
+
+struct PointSchema {
+  typedef Point Record;
+  static constexpr JsonField<Point> kFields[] = {
+    {"x0", &Point::x0},
+    {"y0", &Point::y0},
+    {"x1", &Point::x1},
+    {"y1", &Point::y1},
+  };
+};
+
+// NOTE(chogan): Parses consecutive records starting at token `*index` into
+// `out` until the tokens run out or something other than a record shows up
+// (like the closing `]}`), and leaves `*index` there. Records are whatever
+// parseSchemaRecordGeneric accepts, but the usual four number layout goes
+// through the fast path. Returns the number of records parsed.
+u64 parseRecords(TokenArray *tokens, u32 *index, Point *out) {
+  u64 result = 0;
+
+  while (*index < tokens->count) {
+    result += parseSchemaRecords<PointSchema>(tokens, index, out + result);
+
+    if (getTokenTypeAt(tokens, *index) != TokenType::OpenCurlyBrace ||
+        !parseSchemaRecordGeneric<PointSchema>(tokens, index, out + result)) {
+      break;
+    }
+    result++;
+    if (getTokenTypeAt(tokens, *index) == TokenType::Comma) {
+      (*index)++;
+    }
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Just past the closing brace of the record that ends before
+// token `index` (where parseRecords left off), or 0 if there isn't one.
+u64 getRecordsEnd(TokenArray *tokens, u32 index) {
+  u64 result = 0;
+
+  if (index > 0 && getTokenType(tokens->head[index - 1]) == TokenType::Comma) {
+    index--;
+  }
+  if (index > 0 && getTokenType(tokens->head[index - 1]) == TokenType::CloseCurlyBrace) {
+    result = getTokenOffset(tokens->head[index - 1]) + 1;
+  }
+
+  return result;
+}
+
+// NOTE(chogan): The records are the elements of the root object's "pairs"
+// array, wherever it is among the root's members.
 PointArray parseTokens(Arena *arena, TokenArray *tokens) {
   TimeFunction;
-  u32 num_points = tokens->num_points / 4;
-  Point *data = pushArray<Point>(arena, num_points);
+  Point *data = pushArray<Point>(arena, getMaxRecordCount(tokens));
   PointArray result = {};
   result.data = data;
-  result.num_points = num_points;
-
-  Token *at = tokens->head;
-  Token *end = at + tokens->count - 2;
-  u32 offset = 0;
-
-  ++at;  // {
-  ++at;  // pairs
-  ++at;  // :
-  ++at;  // [
-
-  while (at < end) {
-    ++at;  // {
-    ++at;  // x0
-    ++at;  // :
-    f64 x0 = atof(at->data);
-    ++at;
-
-    ++at;  // ,
-    ++at;  // y0
-    ++at;  // :
-    f64 y0 = atof(at->data);
-    ++at;
-
-    ++at;  // ,
-    ++at;  // x1
-    ++at;  // :
-    f64 x1 = atof(at->data);
-    ++at;
-
-    ++at;  // ,
-    ++at;  // y1
-    ++at;  // :
-    f64 y1 = atof(at->data);
-    ++at;
-
-    ++at;  // }
-    ++at;  // ,
-
-    result.data[offset].x0 = x0;
-    result.data[offset].y0 = y0;
-    result.data[offset].x1 = x1;
-    result.data[offset].y1 = y1;
-    offset++;
+
+  JsonValue pairs = {};
+  if (findJsonField(getJsonRoot(tokens), "pairs", &pairs) &&
+      getJsonType(pairs) == JsonType_Array) {
+    u32 index = pairs.index + 1;
+    result.num_points = (u32)parseRecords(tokens, &index, data);
+  } else {
+    fprintf(stderr, "ERROR: No \"pairs\" array in the input\n");
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Only a guess at a record boundary, since a `{` can also be in
+// a string or a nested object. Callers check the guess by parsing up to it.
+u64 findNextRecord(EntireFile *file, u64 offset) {
+  u8 *at = file->data + offset;
+  u8 *end = file->data + file->size;
+
+  while (at < end && *at != '{') {
+    at++;
+  }
+
+  return at - file->data;
+}
+
+// NOTE(chogan): Skips the whitespace and `,` that can come between the end of
+// one record and the start of the next.
+u64 skipRecordSeparator(EntireFile *file, u64 offset) {
+  u64 at = offset;
+
+  while (at < file->size && isWhitespace(file->data[at])) {
+    at++;
+  }
+  if (at < file->size && file->data[at] == ',') {
+    at++;
+  }
+  while (at < file->size && isWhitespace(file->data[at])) {
+    at++;
+  }
+
+  return at;
+}
+
+// NOTE(chogan): Skips the `{"pairs":[` header
+u64 findFirstRecord(EntireFile *file) {
+  u64 result = file->size;
+  u8 *open_brace = (u8 *)memchr(file->data, '[', file->size);
+
+  if (open_brace) {
+    result = findNextRecord(file, open_brace - file->data);
+  }
+
+  return result;
+}
+
+struct ParseChunkWork {
+  EntireFile chunk;
+  Arena scratch;
+  Point *points;
+  u64 num_points;
+  Point *dest;
+  // NOTE(chogan): Relative to the chunk, 0 if there's no complete record
+  u64 records_end;
+  u32 error_count;
+  bool quiet;
+  LineOrigin origin;
+  // NOTE(chogan): Parsing stopped at the end of the chunk, not before it
+  bool reached_end;
+};
+
+void parseChunk(ParseChunkWork *work) {
+  TokenArray tokens = tokenize(&work->scratch, &work->chunk, work->quiet, &work->origin);
+  work->points = pushArray<Point>(&work->scratch, getMaxRecordCount(&tokens));
+  u32 index = 0;
+  work->num_points = parseRecords(&tokens, &index, work->points);
+  work->records_end = getRecordsEnd(&tokens, index);
+  work->error_count = tokens.error_count;
+  work->reached_end = index == tokens.count;
+}
+
+void copyChunkPoints(ParseChunkWork *work) {
+  memcpy(work->dest, work->points, work->num_points * sizeof(Point));
+}
+
+// NOTE(chogan): `records` starts on a record, or on the `,` before one. It's
+// split into `thread_count` chunks at guessed record boundaries (see
+// findNextRecord). Each chunk is tokenized and parsed on its
+// own thread into that thread's slice of `scratch`, then the chunks are copied
+// into one `PointArray` in file order.
+//
+// The first chunk starts on a real record, and if it parses cleanly right up
+// to its end then the next one does too, and so on. So the guesses were right
+// if every chunk but the last is clean. The last one stops wherever a single
+// threaded parse would. If a guess was wrong (or there's something to report)
+// the whole of `records` is parsed again on this thread.
+//
+// `records_end`, if not NULL, gets the offset just past the last complete
+// record, or 0 if there wasn't one. `origin` places `records` in its file for
+// error messages.
+PointArray parseRecordChunks(Arena *arena, Arena *scratch, EntireFile *records,
+                             LineOrigin origin, u32 thread_count, u64 *records_end) {
+  PointArray result = {};
+  u64 first = skipRecordSeparator(records, 0);
+  bool clean = false;
+  u64 end = 0;
+
+  if (thread_count > 1) {
+    ScopedTemporaryMemory chunk_memory(scratch);
+    ParseChunkWork *work = pushClearedArray<ParseChunkWork>(chunk_memory, thread_count);
+    u64 *boundaries = pushArray<u64>(chunk_memory, thread_count + 1);
+
+    u64 size = records->size - first;
+    boundaries[0] = first;
+    boundaries[thread_count] = records->size;
+    for (u32 i = 1; i < thread_count; ++i) {
+      u64 nominal = first + size * i / thread_count;
+      u64 boundary = findNextRecord(records, nominal);
+      boundaries[i] = boundary > boundaries[i - 1] ? boundary : boundaries[i - 1];
+    }
+
+    // NOTE(chogan): The boundaries can move, so the chunks aren't always the
+    // same size. Each one gets what it could need.
+    for (u32 i = 0; i < thread_count; ++i) {
+      work[i].chunk.data = records->data + boundaries[i];
+      work[i].chunk.size = boundaries[i + 1] - boundaries[i];
+      u64 chunk_scratch = (getMaxTokenBytes(work[i].chunk.size) +
+                           getMaxRecordCount(work[i].chunk.size) * sizeof(Point));
+      work[i].scratch = subArena(chunk_memory, chunk_scratch);
+      work[i].quiet = true;
+    }
+
+    runOnThreads(parseChunk, work, thread_count);
+
+    clean = true;
+    u64 num_points = 0;
+    for (u32 i = 0; i < thread_count; ++i) {
+      bool is_last = i + 1 == thread_count;
+      clean = clean && work[i].error_count == 0 && (work[i].reached_end || is_last);
+      num_points += work[i].num_points;
+      if (work[i].records_end) {
+        end = boundaries[i] + work[i].records_end;
+      }
+    }
+
+    if (clean) {
+      result.data = pushArray<Point>(arena, num_points);
+      result.num_points = (u32)num_points;
+
+      u64 offset = 0;
+      for (u32 i = 0; i < thread_count; ++i) {
+        work[i].dest = result.data + offset;
+        offset += work[i].num_points;
+      }
+
+      runOnThreads(copyChunkPoints, work, thread_count);
+    }
+  }
+
+  if (!clean) {
+    ScopedTemporaryMemory chunk_memory(scratch);
+    ParseChunkWork work = {};
+    work.chunk.data = records->data + first;
+    work.chunk.size = records->size - first;
+    work.scratch = subArena(chunk_memory, getRemainingCapacity(chunk_memory));
+    work.origin = origin;
+    parseChunk(&work);
+
+    result.data = pushArray<Point>(arena, work.num_points);
+    result.num_points = (u32)work.num_points;
+    work.dest = result.data;
+    copyChunkPoints(&work);
+    end = work.records_end ? first + work.records_end : 0;
+  }
+
+  if (records_end) {
+    *records_end = end;
+  }
+
+  return result;
+}
+
+PointArray parseJsonChunks(Arena *arena, Arena *scratch, EntireFile *file,
+                           u32 thread_count) {
+  TimeBandwidth(__func__, file->size);
+  u64 records_begin = findFirstRecord(file);
+  EntireFile records = {};
+  records.data = file->data + records_begin;
+  records.size = file->size - records_begin;
+
+  LineOrigin origin = {(const char *)file->data, 1};
+  PointArray result = parseRecordChunks(arena, scratch, &records, origin, thread_count, NULL);
+
+  return result;
+}
+
+PointArray parseJsonFile(Arena *arena, Arena *scratch, const char *path,
+                         FileReadOptions *options, u32 thread_count) {
+  TimeFunction;
+  ScopedTemporaryMemory scratch_memory(scratch);
+  EntireFile file = readEntireFile(scratch_memory, path, options);
+  PointArray result = {};
+
+  if (file.data) {
+    if (thread_count > 1) {
+      result = parseJsonChunks(arena, scratch_memory, &file, thread_count);
+    } else {
+      TokenArray tokens = tokenize(scratch_memory, &file);
+      result = parseTokens(arena, &tokens);
+    }
   }
+  releaseEntireFile(&file);
 
   return result;
 }
@@ -10,29 +10,90 @@ enum TokenType {
   CloseCurlyBrace,
   Comma,
   Colon,
+  True,
+  False,
+  Null,
 
   Count
 };
 
-struct Token {
-  char *data;
-  u32 size;
-  u32 line;
-  TokenType type;
-};
+// NOTE(chogan): A token is its type in the top 4 bits and its byte offset into
+// the tokenized buffer in the rest. Strings are at their opening quote. Sizes
+// aren't stored since the parser doesn't need them (parseF64 finds the end of
+// a number and keys are compared in place, see perfaware_json_schema.h), and
+// line numbers are only worked out when there's an error to report.
+typedef u64 Token;
+
+const u32 kTokenTypeShift = 60;
+const u64 kTokenOffsetMask = (1ULL << kTokenTypeShift) - 1;
+
+inline Token makeToken(TokenType type, u64 offset) {
+  Token result = ((u64)type << kTokenTypeShift) | offset;
+
+  return result;
+}
+
+inline TokenType getTokenType(Token token) {
+  TokenType result = (TokenType)(token >> kTokenTypeShift);
+
+  return result;
+}
+
+inline u64 getTokenOffset(Token token) {
+  u64 result = token & kTokenOffsetMask;
+
+  return result;
+}
 
 struct TokenArray {
   Token *head;
+  // NOTE(chogan): The buffer the offsets are into
+  const char *base;
+  u64 size;
   u32 count;
   u32 num_points;
+  // NOTE(chogan): Characters that can't start a token
+  u32 error_count;
 };
 
-struct EntireFile {
-  u8 *data;
-  u64 size;
+// NOTE(chogan): Count past the end of the tape
+inline TokenType getTokenTypeAt(TokenArray *tokens, u32 index) {
+  TokenType result = index < tokens->count ? getTokenType(tokens->head[index]) : TokenType::Count;
+
+  return result;
+}
+
+// NOTE(chogan): The smallest record, {"x0":0,"y0":0,"x1":0,"y1":0}, is 29
+// bytes. Records can have other members too, so the tokens are only bounded by
+// the input size: every token starts on a different byte. Used to bound how
+// much memory `size` bytes of input can need.
+const u64 kMinRecordSize = 29;
+
+u64 getMaxRecordCount(u64 size);
+u64 getMaxTokenBytes(u64 size);
+// NOTE(chogan): Each record has at least four numbers, and takes at least
+// kMinRecordSize bytes
+u64 getMaxRecordCount(TokenArray *tokens);
+
+// NOTE(chogan): For a buffer that's part of a file: `at` is on line `line` of
+// the file, and is at or before the start of the buffer. The newlines between
+// are only counted if there's an error to report.
+struct LineOrigin {
+  const char *at;
+  u32 line;
 };
 
-TokenArray tokenize(Arena *arena, EntireFile entire_file);
-void parseTokens(TokenArray *tokens);
+u64 countNewlines(const u8 *data, u64 size);
+
+// NOTE(chogan): Unless `quiet`, every unexpected character is reported as
+// it's found, with its line counted from `origin` (or the start of the buffer).
+// Either way they're counted in `error_count`.
+TokenArray tokenize(Arena *arena, EntireFile *entire_file, bool quiet = false,
+                    LineOrigin *origin = 0);
+PointArray parseTokens(Arena *arena, TokenArray *tokens);
+// NOTE(chogan): Reads all of `path` and parses it, on `thread_count` threads if
+// that's more than one (see parseJsonChunks)
+PointArray parseJsonFile(Arena *arena, Arena *scratch, const char *path,
+                         FileReadOptions *options, u32 thread_count);
 
 #endif  // PERFAWARE_JSON_PARSER_H_
@@ -0,0 +1,197 @@
+#ifndef PERFAWARE_JSON_SCHEMA_H_
+#define PERFAWARE_JSON_SCHEMA_H_
+
+// NOTE(chogan): Record parsers generated at compile time from a schema that
+// maps JSON keys to a struct's number members:
+//
+//   struct PointSchema {
+//     typedef Point Record;
+//     static constexpr JsonField<Point> kFields[] = {{"x0", &Point::x0}, ...};
+//   };
+//
+// The keys, quotes included, are packed into 8 byte words at compile time, so
+// a key on the tape is matched against every field with a few wide compares
+// straight out of the input, without measuring or unescaping it. Records that
+// are exactly the schema's members, in any order, go through
+// parseSchemaRecords with no branches on the data until the record is
+// accepted. Anything else (escaped keys, extra or missing members, nested
+// values) is left for parseSchemaRecordGeneric, which reads one record through
+// the JSON cursor.
+//
+// Key names can't contain anything that needs escaping in JSON.
+
+template<typename Record>
+struct JsonField {
+  const char *name;
+  f64 Record::*member;
+};
+
+const u32 kMaxJsonKeyWords = 4;
+
+struct JsonKeyPattern {
+  u64 words[kMaxJsonKeyWords];
+  u64 masks[kMaxJsonKeyWords];
+  u32 word_count;
+};
+
+constexpr JsonKeyPattern makeJsonKeyPattern(const char *name) {
+  JsonKeyPattern result = {};
+  u32 name_size = 0;
+  while (name[name_size]) {
+    name_size++;
+  }
+
+  u32 quoted_size = name_size + 2;
+  for (u32 i = 0; i < quoted_size && i < 8 * kMaxJsonKeyWords; ++i) {
+    u8 c = (i == 0 || i == quoted_size - 1) ? (u8)'"' : (u8)name[i - 1];
+    result.words[i / 8] |= (u64)c << (8 * (i % 8));
+    result.masks[i / 8] |= 0xffULL << (8 * (i % 8));
+  }
+  result.word_count = (quoted_size + 7) / 8;
+
+  return result;
+}
+
+template<typename Schema>
+struct JsonSchemaKeys {
+  static constexpr u32 kFieldCount = sizeof(Schema::kFields) / sizeof(Schema::kFields[0]);
+
+  JsonKeyPattern patterns[kFieldCount];
+  // NOTE(chogan): The most words any key needs, which is how much of each key
+  // on the tape gets loaded
+  u32 load_words;
+
+  constexpr JsonSchemaKeys() : patterns(), load_words(0) {
+    for (u32 i = 0; i < kFieldCount; ++i) {
+      patterns[i] = makeJsonKeyPattern(Schema::kFields[i].name);
+      load_words = patterns[i].word_count > load_words ? patterns[i].word_count : load_words;
+    }
+  }
+};
+
+template<typename Schema>
+constexpr JsonSchemaKeys<Schema> kJsonSchemaKeys = JsonSchemaKeys<Schema>();
+
+// NOTE(chogan): Bit i is set if the key at `key` (its opening quote) is field
+// i. Loads `load_words` words, so the caller makes sure they're in bounds.
+template<typename Schema>
+inline u32 matchJsonKey(const char *key) {
+  constexpr const JsonSchemaKeys<Schema> &keys = kJsonSchemaKeys<Schema>;
+  static_assert(keys.load_words <= kMaxJsonKeyWords, "Schema key is too long");
+
+  u64 words[kMaxJsonKeyWords];
+  memcpy(words, key, keys.load_words * sizeof(u64));
+
+  u32 result = 0;
+  for (u32 field = 0; field < keys.kFieldCount; ++field) {
+    bool match = true;
+    for (u32 w = 0; w < keys.load_words; ++w) {
+      match &= (words[w] & keys.patterns[field].masks[w]) == keys.patterns[field].words[w];
+    }
+    result |= (u32)match << field;
+  }
+
+  return result;
+}
+
+// NOTE(chogan): The fast path. Parses consecutive records that are exactly the
+// schema's members into `out`, and leaves `*index` at the first token that
+// isn't one (or at the end of the tape). Returns the number of records parsed.
+template<typename Schema>
+u64 parseSchemaRecords(TokenArray *tokens, u32 *index, typename Schema::Record *out) {
+  constexpr const JsonSchemaKeys<Schema> &keys = kJsonSchemaKeys<Schema>;
+  constexpr u32 kFieldCount = keys.kFieldCount;
+  constexpr s64 kTokensPerSchemaRecord = 4 * kFieldCount + 1;
+  constexpr u32 kAllFields = (1u << kFieldCount) - 1;
+  constexpr u64 kKeyLoadBytes = keys.load_words * sizeof(u64);
+  static_assert(kFieldCount < 32, "Too many fields in the schema");
+
+  const char *base = tokens->base;
+  u64 size = tokens->size;
+  u64 offset = 0;
+
+  Token *at = tokens->head + *index;
+  Token *end = tokens->head + tokens->count;
+
+  // NOTE(chogan): Every key in a record comes before its closing brace, so if
+  // a full load from the brace stays in the buffer, so does every key's.
+  while (end - at >= kTokensPerSchemaRecord &&
+         getTokenType(at[0]) == TokenType::OpenCurlyBrace &&
+         getTokenType(at[kTokensPerSchemaRecord - 1]) == TokenType::CloseCurlyBrace &&
+         getTokenOffset(at[kTokensPerSchemaRecord - 1]) + kKeyLoadBytes <= size) {
+    // NOTE(chogan): One extra slot for a key that matched nothing
+    f64 values[kFieldCount + 1] = {};
+    u32 found = 0;
+    bool valid = true;
+
+    for (u32 i = 0; i < kFieldCount; ++i) {
+      Token key = at[1 + 4 * i];
+      Token number = at[3 + 4 * i];
+      u32 match = matchJsonKey<Schema>(base + getTokenOffset(key));
+      u32 field = countTrailingZeros(match | (1u << kFieldCount));
+      u64 number_offset = getTokenOffset(number);
+
+      valid &= ((getTokenType(key) == TokenType::String) &
+                (getTokenType(at[2 + 4 * i]) == TokenType::Colon) &
+                (getTokenType(number) == TokenType::Number) &
+                (i + 1 == kFieldCount || getTokenType(at[4 + 4 * i]) == TokenType::Comma));
+      found |= match;
+      values[field] = parseF64(base + number_offset, size - number_offset);
+    }
+
+    if (!valid || found != kAllFields) {
+      break;
+    }
+
+    at += kTokensPerSchemaRecord;
+    if (at < end && getTokenType(*at) == TokenType::Comma) {
+      ++at;  // ,
+    }
+
+    for (u32 field = 0; field < kFieldCount; ++field) {
+      out[offset].*(Schema::kFields[field].member) = values[field];
+    }
+    offset++;
+  }
+  *index = (u32)(at - tokens->head);
+
+  return offset;
+}
+
+// NOTE(chogan): Any object that has all of the schema's members as numbers, in
+// any order and with any escapes in the keys. Other members are skipped.
+// Leaves `*index` after the record.
+template<typename Schema>
+bool parseSchemaRecordGeneric(TokenArray *tokens, u32 *index, typename Schema::Record *out) {
+  constexpr u32 kFieldCount = JsonSchemaKeys<Schema>::kFieldCount;
+  constexpr u32 kAllFields = (1u << kFieldCount) - 1;
+
+  JsonValue record = {tokens, *index};
+  JsonIterator it = iterateJsonObject(record);
+  JsonString key = {};
+  JsonValue value = {};
+  f64 values[kFieldCount] = {};
+  u32 found = 0;
+
+  while (nextJsonField(&it, &key, &value)) {
+    for (u32 field = 0; field < kFieldCount; ++field) {
+      if (jsonStringEquals(&key, Schema::kFields[field].name) &&
+          getJsonNumber(value, &values[field])) {
+        found |= 1 << field;
+        break;
+      }
+    }
+  }
+
+  bool result = !it.failed && found == kAllFields;
+  if (result) {
+    for (u32 field = 0; field < kFieldCount; ++field) {
+      out->*(Schema::kFields[field].member) = values[field];
+    }
+    *index = it.next;
+  }
+
+  return result;
+}
+
+#endif  // PERFAWARE_JSON_SCHEMA_H_
@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "perfaware_json_writer.h"
+
+const char *kJsonLayoutNames[JsonLayout_Count] = {
+  "lines",
+  "minified",
+  "pretty",
+};
+
+const char *kNumberStyleNames[NumberStyle_Count] = {
+  "fixed16",
+  "variable",
+  "exponent",
+  "mixed",
+};
+
+static const char *kJsonKeys[4] = {"\"x0\"", "\"y0\"", "\"x1\"", "\"y1\""};
+// NOTE(chogan): Most characters one run of extra whitespace can add
+const u32 kMaxExtraWhitespace = 3 * 2;
+// NOTE(chogan): Before and after each key, colon and number, and around the
+// braces
+const u32 kWhitespaceSlotsPerRecord = 4 * 4 + 2;
+
+// NOTE(chogan): Hands out random bits a few at a time from mixBits(key +
+// counter), starting at a counter that belongs to one record.
+struct StyleRandom {
+  u64 key;
+  u64 counter;
+  u64 bits;
+  u32 available;
+};
+
+static u32 takeBits(StyleRandom *random, u32 count) {
+  if (random->available < count) {
+    random->bits = mixBits(random->key + random->counter++ * 0x9e3779b97f4a7c15ULL);
+    random->available = 64;
+  }
+  u32 result = (u32)(random->bits & ((1ULL << count) - 1));
+  random->bits >>= count;
+  random->available -= count;
+
+  return result;
+}
+
+static inline char *appendBytes(char *at, const char *bytes, u32 size) {
+  memcpy(at, bytes, size);
+
+  return at + size;
+}
+
+static inline char *appendNewline(char *at, JsonStyle *style) {
+  if (style->crlf) {
+    *at++ = '\r';
+  }
+  *at++ = '\n';
+
+  return at;
+}
+
+static inline char *appendIndent(char *at, JsonStyle *style, u32 level) {
+  u32 count = style->indent * level;
+  memset(at, ' ', count);
+
+  return at + count;
+}
+
+// NOTE(chogan): Zero to three of space, space, tab or newline
+static char *appendWhitespace(char *at, JsonStyle *style, StyleRandom *random) {
+  if (style->extra_whitespace) {
+    u32 count = takeBits(random, 2);
+    for (u32 i = 0; i < count; ++i) {
+      switch (takeBits(random, 2)) {
+        case 2: {
+          *at++ = '\t';
+          break;
+        }
+        case 3: {
+          at = appendNewline(at, style);
+          break;
+        }
+        default: {
+          *at++ = ' ';
+          break;
+        }
+      }
+    }
+  }
+
+  return at;
+}
+
+static u32 formatJsonNumber(char *dest, JsonStyle *style, StyleRandom *random, f64 *value) {
+  NumberStyle numbers = style->numbers;
+  if (numbers == NumberStyle_Mixed) {
+    u32 pick = takeBits(random, 2);
+    numbers = (NumberStyle)(pick == 3 ? 0 : pick);
+  }
+
+  char buffer[64];
+  int size = 0;
+  switch (numbers) {
+    case NumberStyle_Variable: {
+      int digits = 1 + (int)takeBits(random, 4);
+      size = snprintf(buffer, sizeof(buffer), "%.*f", digits, *value);
+      break;
+    }
+    case NumberStyle_Exponent: {
+      int precision = 5 + (int)(takeBits(random, 4) % 12);
+      size = snprintf(buffer, sizeof(buffer), "%.*e", precision, *value);
+      if (takeBits(random, 1) && size > 0) {
+        char *e = (char *)memchr(buffer, 'e', size);
+        if (e) {
+          *e = 'E';
+        }
+      }
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+
+  u32 result = 0;
+  // NOTE(chogan): fixed16 is as close as the default format ever was, so it
+  // isn't read back
+  if (size > 0 && (u32)size <= kMaxFormattedF64Size) {
+    memcpy(dest, buffer, size);
+    result = (u32)size;
+    *value = parseF64(dest, result);
+  } else {
+    result = formatF64Fixed16(dest, *value);
+  }
+
+  return result;
+}
+
+u64 getMaxJsonRecordSize(JsonStyle *style) {
+  u64 indent = style->layout == JsonLayout_Pretty ? style->indent : 0;
+  u64 result = (4 * (kMaxFormattedF64Size + 4 + 4) + 8 + 6 * (3 * indent + 2) +
+                kWhitespaceSlotsPerRecord * kMaxExtraWhitespace);
+
+  return result;
+}
+
+u32 formatJsonHeader(char *dest, JsonStyle *style) {
+  char *at = dest;
+
+  switch (style->layout) {
+    case JsonLayout_Pretty: {
+      at = appendBytes(at, "{", 1);
+      at = appendNewline(at, style);
+      at = appendIndent(at, style, 1);
+      at = appendBytes(at, "\"pairs\": [", 10);
+      at = appendNewline(at, style);
+      break;
+    }
+    case JsonLayout_Minified: {
+      at = appendBytes(at, "{\"pairs\":[", 10);
+      break;
+    }
+    default: {
+      at = appendBytes(at, "{\"pairs\":[", 10);
+      at = appendNewline(at, style);
+      break;
+    }
+  }
+
+  return (u32)(at - dest);
+}
+
+u32 formatJsonFooter(char *dest, JsonStyle *style) {
+  char *at = dest;
+
+  switch (style->layout) {
+    case JsonLayout_Pretty: {
+      at = appendIndent(at, style, 1);
+      at = appendBytes(at, "]", 1);
+      at = appendNewline(at, style);
+      at = appendBytes(at, "}", 1);
+      at = appendNewline(at, style);
+      break;
+    }
+    case JsonLayout_Minified: {
+      at = appendBytes(at, "]}", 2);
+      break;
+    }
+    default: {
+      at = appendBytes(at, "]}", 2);
+      at = appendNewline(at, style);
+      break;
+    }
+  }
+
+  return (u32)(at - dest);
+}
+
+u32 formatJsonRecord(char *dest, JsonStyle *style, Point *point, u64 index, bool is_last) {
+  StyleRandom random = {};
+  random.key = style->key;
+  random.counter = index * 8;
+  f64 *fields[4] = {&point->x0, &point->y0, &point->x1, &point->y1};
+  u32 order[4] = {0, 1, 2, 3};
+  JsonLayout layout = style->layout;
+  char *at = dest;
+
+  if (style->shuffle_keys) {
+    for (u32 i = 3; i > 0; --i) {
+      u32 j = takeBits(&random, 3) % (i + 1);
+      u32 temp = order[i];
+      order[i] = order[j];
+      order[j] = temp;
+    }
+  }
+
+  if (layout == JsonLayout_Pretty) {
+    at = appendIndent(at, style, 2);
+    at = appendBytes(at, "{", 1);
+    at = appendNewline(at, style);
+  } else if (layout == JsonLayout_Lines) {
+    at = appendBytes(at, "\t{", 2);
+  } else {
+    at = appendBytes(at, "{", 1);
+  }
+  at = appendWhitespace(at, style, &random);
+
+  for (u32 i = 0; i < 4; ++i) {
+    u32 field = order[i];
+    if (i > 0) {
+      at = appendBytes(at, ",", 1);
+      if (layout == JsonLayout_Lines) {
+        at = appendBytes(at, " ", 1);
+      } else if (layout == JsonLayout_Pretty) {
+        at = appendNewline(at, style);
+      }
+    }
+    if (layout == JsonLayout_Pretty) {
+      at = appendIndent(at, style, 3);
+    }
+    at = appendWhitespace(at, style, &random);
+    at = appendBytes(at, kJsonKeys[field], 4);
+    at = appendWhitespace(at, style, &random);
+    at = appendBytes(at, ": ", layout == JsonLayout_Pretty ? 2 : 1);
+    at = appendWhitespace(at, style, &random);
+    at += formatJsonNumber(at, style, &random, fields[field]);
+    at = appendWhitespace(at, style, &random);
+  }
+
+  if (layout == JsonLayout_Pretty) {
+    at = appendNewline(at, style);
+    at = appendIndent(at, style, 2);
+  }
+  at = appendBytes(at, "}", 1);
+  if (!is_last) {
+    at = appendBytes(at, ",", 1);
+  }
+  if (layout != JsonLayout_Minified) {
+    at = appendNewline(at, style);
+  }
+
+  return (u32)(at - dest);
+}
+
+bool parseJsonLayout(const char *name, JsonLayout *layout) {
+  bool result = false;
+
+  for (u32 i = 0; i < JsonLayout_Count; ++i) {
+    if (strcmp(name, kJsonLayoutNames[i]) == 0) {
+      *layout = (JsonLayout)i;
+      result = true;
+      break;
+    }
+  }
+
+  return result;
+}
+
+bool parseNumberStyle(const char *name, NumberStyle *numbers) {
+  bool result = false;
+
+  for (u32 i = 0; i < NumberStyle_Count; ++i) {
+    if (strcmp(name, kNumberStyleNames[i]) == 0) {
+      *numbers = (NumberStyle)i;
+      result = true;
+      break;
+    }
+  }
+
+  return result;
+}
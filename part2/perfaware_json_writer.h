@@ -0,0 +1,65 @@
+#ifndef PERFAWARE_JSON_WRITER_H_
+#define PERFAWARE_JSON_WRITER_H_
+
+// NOTE(chogan): Writes the {"pairs":[...]} format in layouts other than the
+// one record per line that haversine_processor was written against, so the
+// parsers can be measured (and checked) on input that looks like it came from
+// somewhere else.
+//
+//   lines     {"pairs":[ then one tab indented record per line (the default)
+//   minified  No whitespace at all
+//   pretty    One key per line, indented `indent` spaces per level
+//
+// Numbers are written with 16 fractional digits (fixed16), a random number of
+// fractional digits (variable), in exponent form with a random precision and
+// case (exponent), or a random one of those per number (mixed). Keys can be
+// shuffled per record, lines can end in CRLF, and random spaces, tabs and
+// newlines can be added anywhere JSON allows whitespace. Every random choice
+// depends only on `key` and the record's index.
+enum JsonLayout {
+  JsonLayout_Lines,
+  JsonLayout_Minified,
+  JsonLayout_Pretty,
+
+  JsonLayout_Count
+};
+
+enum NumberStyle {
+  NumberStyle_Fixed16,
+  NumberStyle_Variable,
+  NumberStyle_Exponent,
+  NumberStyle_Mixed,
+
+  NumberStyle_Count
+};
+
+extern const char *kJsonLayoutNames[JsonLayout_Count];
+extern const char *kNumberStyleNames[NumberStyle_Count];
+const u32 kDefaultJsonIndent = 8;
+const u32 kMaxJsonIndent = 32;
+const u32 kMaxJsonHeaderSize = 2 * kMaxJsonIndent + 32;
+
+struct JsonStyle {
+  JsonLayout layout;
+  NumberStyle numbers;
+  u32 indent;
+  bool shuffle_keys;
+  bool crlf;
+  bool extra_whitespace;
+  u64 key;
+};
+
+// NOTE(chogan): An upper bound on formatJsonRecord's output
+u64 getMaxJsonRecordSize(JsonStyle *style);
+u32 formatJsonHeader(char *dest, JsonStyle *style);
+u32 formatJsonFooter(char *dest, JsonStyle *style);
+// NOTE(chogan): Writes record `index`, followed by a comma unless it's the last
+// one. Numbers that are written with fewer digits than it takes to round trip
+// are parsed back into `point`, so answers computed from it match what a
+// parser will read. Returns the number of bytes written.
+u32 formatJsonRecord(char *dest, JsonStyle *style, Point *point, u64 index, bool is_last);
+
+bool parseJsonLayout(const char *name, JsonLayout *layout);
+bool parseNumberStyle(const char *name, NumberStyle *numbers);
+
+#endif  // PERFAWARE_JSON_WRITER_H_
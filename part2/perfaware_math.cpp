@@ -0,0 +1,164 @@
+#include "perfaware_cpu.h"
+#include "perfaware_math.h"
+
+// NOTE(chogan): Generated by interpolating (f(x)/x - 1)/z at Chebyshev nodes
+// in z with exact rational arithmetic, then rounding to double. That comes
+// within a few percent of the minimax error for these smooth functions.
+static const f64 kSinFull[] = {
+  -0.16666666666666666,
+  0.0083333333333333159,
+  -0.00019841269841254974,
+  2.7557319219163234e-06,
+  -2.5052107616996182e-08,
+  1.6058977312464087e-10,
+  -7.6439702967985717e-13,
+  2.7314447669863995e-15,
+};
+
+static const f64 kSin1e12[] = {
+  -0.16666666666658467,
+  0.0083333333309403654,
+  -0.0001984126870905615,
+  2.7557123174373272e-06,
+  -2.5036745008428295e-08,
+  1.550250902793809e-10,
+};
+
+static const f64 kSin1e8[] = {
+  -0.16666666663881236,
+  0.0083333327687535787,
+  -0.00019841086561478801,
+  2.75364635625748e-06,
+  -2.4080190432969638e-08,
+};
+
+static const f64 kAsinFull[] = {
+  0.16666666666666669,
+  0.074999999999984329,
+  0.044642857146355429,
+  0.030381944138531247,
+  0.022372172942149889,
+  0.017352392720869973,
+  0.013971212973552933,
+  0.011479177415184906,
+  0.010322814350185779,
+  0.0054575067186403573,
+  0.017400879442694025,
+  -0.014851887071247209,
+  0.02875785136742157,
+};
+
+static const f64 kAsin1e12[] = {
+  0.16666666666738633,
+  0.074999999534297118,
+  0.044642906474584965,
+  0.030379945210024933,
+  0.022412417726695433,
+  0.016902683886393575,
+  0.01686409027396012,
+  0.0010675063150363097,
+  0.02834674523183333,
+};
+
+static const f64 kAsin1e8[] = {
+  0.16666666337430908,
+  0.075000945434974237,
+  0.044599401528512182,
+  0.031100662735494569,
+  0.017149238357677253,
+  0.033690847202830124,
+};
+
+const MathPolynomial kSinPolynomials[MathAccuracy_Count] = {
+  {kSinFull, ArrayCount(kSinFull), 1.7e-16},
+  {kSin1e12, ArrayCount(kSin1e12), 3.2e-13},
+  {kSin1e8, ArrayCount(kSin1e8), 1.1e-10},
+};
+
+const MathPolynomial kAsinPolynomials[MathAccuracy_Count] = {
+  {kAsinFull, ArrayCount(kAsinFull), 1.1e-16},
+  {kAsin1e12, ArrayCount(kAsin1e12), 2.2e-13},
+  {kAsin1e8, ArrayCount(kAsin1e8), 1.0e-9},
+};
+
+const char *kMathAccuracyNames[MathAccuracy_Count] = {
+  "full",
+  "1e-12",
+  "1e-8",
+};
+
+bool parseMathAccuracy(const char *name, MathAccuracy *accuracy) {
+  bool result = false;
+
+  for (u32 i = 0; i < MathAccuracy_Count; ++i) {
+    if (strcmp(name, kMathAccuracyNames[i]) == 0) {
+      *accuracy = (MathAccuracy)i;
+      result = true;
+      break;
+    }
+  }
+
+  return result;
+}
+
+static inline f64 evaluatePolynomial(f64 x, const MathPolynomial *polynomial) {
+  f64 z = x * x;
+  f64 p = polynomial->coefficients[polynomial->count - 1];
+  for (s32 i = (s32)polynomial->count - 2; i >= 0; --i) {
+    p = p * z + polynomial->coefficients[i];
+  }
+  f64 result = x + x * z * p;
+
+  return result;
+}
+
+f64 sinRanged(f64 x, MathAccuracy accuracy) {
+  f64 abs_x = fabs(x);
+  f64 reduced = abs_x > kHalfPiHi ? (kPiHi - abs_x) + kPiLo : abs_x;
+  f64 result = evaluatePolynomial(reduced, kSinPolynomials + accuracy);
+
+  return x < 0 ? -result : result;
+}
+
+f64 cosRanged(f64 x, MathAccuracy accuracy) {
+  // NOTE(chogan): cos(x) = sin(pi/2 - |x|), and pi/2 - |x| is in [-pi/2, pi/2]
+  f64 reduced = (kHalfPiHi - fabs(x)) + kHalfPiLo;
+  f64 result = evaluatePolynomial(reduced, kSinPolynomials + accuracy);
+
+  return result;
+}
+
+f64 asinRanged(f64 x, MathAccuracy accuracy) {
+  // NOTE(chogan): asin(x) = pi/2 - 2*asin(sqrt((1 - x)/2)) for x > 1/2, where
+  // 1 - x is exact. Both sides are computed and selected, rather than
+  // branched on, since the haversine inputs land on either side at random.
+  f64 abs_x = fabs(x);
+  bool reflect = abs_x > 0.5;
+  f64 t = sqrtRanged((1.0 - abs_x) * 0.5, MathAccuracy_Full);
+  f64 p = evaluatePolynomial(reflect ? t : abs_x, kAsinPolynomials + accuracy);
+  f64 result = reflect ? (kHalfPiHi - 2.0 * p) + kHalfPiLo : p;
+
+  return x < 0 ? -result : result;
+}
+
+f64 sqrtRanged(f64 x, MathAccuracy accuracy) {
+  f64 result = 0;
+
+  if (accuracy == MathAccuracy_Full) {
+    result = _mm_cvtsd_f64(_mm_sqrt_sd(_mm_setzero_pd(), _mm_set_sd(x)));
+  } else if (x > 0) {
+    // NOTE(chogan): rsqrtss is good to 1.5 * 2^-12. One third order step
+    // (error ~ 5/16 r^3) gets to 1e-10; two Newton steps get to 6e-14.
+    f64 y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss((float)x)));
+    if (accuracy == MathAccuracy_1e8) {
+      f64 r = 1.0 - x * y * y;
+      y = y + y * r * (0.5 + 0.375 * r);
+    } else {
+      y = y * (1.5 - 0.5 * x * y * y);
+      y = y * (1.5 - 0.5 * x * y * y);
+    }
+    result = x * y;
+  }
+
+  return result;
+}
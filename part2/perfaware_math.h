@@ -0,0 +1,59 @@
+#ifndef PERFAWARE_MATH_H_
+#define PERFAWARE_MATH_H_
+
+// NOTE(chogan): Range limited replacements for the libm functions the
+// haversine formula uses. They only handle the inputs that longitudes in
+// [-180, 180] and latitudes in [-90, 90] can produce, so there's no general
+// argument reduction, errno, or NaN/infinity handling. Each function comes in
+// several accuracy tiers (max relative error over its whole domain):
+//
+//   MathAccuracy_Full  ~2e-16, within about an ulp of libm
+//   MathAccuracy_1e12  < 1e-12
+//   MathAccuracy_1e8   < 1e-8
+//
+// Lower tiers use shorter polynomials (or fewer Newton steps for sqrt).
+// math_tester.cpp sweeps each domain against libm and benchmarks every tier.
+
+enum MathAccuracy {
+  MathAccuracy_Full,
+  MathAccuracy_1e12,
+  MathAccuracy_1e8,
+
+  MathAccuracy_Count
+};
+
+// NOTE(chogan): Coefficients of P in f(x) = x + x*z*P(z), z = x^2, lowest
+// power first. `max_relative_error` is what the fit achieved in double
+// precision over the function's domain.
+struct MathPolynomial {
+  const f64 *coefficients;
+  u32 count;
+  f64 max_relative_error;
+};
+
+// NOTE(chogan): sin on |x| <= pi/2 and asin on |x| <= 1/2. The functions below
+// reduce their full domain to these.
+extern const MathPolynomial kSinPolynomials[MathAccuracy_Count];
+extern const MathPolynomial kAsinPolynomials[MathAccuracy_Count];
+extern const char *kMathAccuracyNames[MathAccuracy_Count];
+
+// NOTE(chogan): pi and pi/2 split into a double plus the rounding error of
+// that double, so reductions like pi - x stay accurate to the last bit.
+const f64 kPiHi = 3.141592653589793116;
+const f64 kPiLo = 1.2246467991473532e-16;
+const f64 kHalfPiHi = 1.5707963267948965580;
+const f64 kHalfPiLo = 6.123233995736766e-17;
+
+bool parseMathAccuracy(const char *name, MathAccuracy *accuracy);
+
+// NOTE(chogan): |x| <= pi
+f64 sinRanged(f64 x, MathAccuracy accuracy = MathAccuracy_Full);
+// NOTE(chogan): |x| <= pi
+f64 cosRanged(f64 x, MathAccuracy accuracy = MathAccuracy_Full);
+// NOTE(chogan): |x| <= 1
+f64 asinRanged(f64 x, MathAccuracy accuracy = MathAccuracy_Full);
+// NOTE(chogan): x == 0 or 1e-36 <= x <= 1e36. The reduced tiers start from
+// the single precision rsqrtss estimate, hence the range.
+f64 sqrtRanged(f64 x, MathAccuracy accuracy = MathAccuracy_Full);
+
+#endif  // PERFAWARE_MATH_H_
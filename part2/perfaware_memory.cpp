@@ -1,6 +1,10 @@
 #include <stdio.h>
 #include <stddef.h>
 
+#if !_WIN32
+#include <sys/mman.h>
+#endif
+
 #include "perfaware_memory.h"
 
 bool isPowerOfTwo(size_t val) {
@@ -44,11 +48,34 @@ void initArena(Arena *arena, size_t bytes, u8 *base) {
   arena->temp_count = 0;
 }
 
+// NOTE(chogan): On Linux this only reserves address space. Pages are backed
+// when they're first touched, so an arena can be sized for the worst case
+// without paying for it (or tripping the overcommit heuristic).
 Arena initArenaAndAllocate(size_t bytes) {
   TimeFunction;
   Arena result = {};
+#if _WIN32
   result.base = (u8 *)malloc(bytes);
-  result.capacity = bytes;
+#else
+  void *base = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  result.base = base == MAP_FAILED ? NULL : (u8 *)base;
+#endif
+
+  if (result.base) {
+    result.capacity = bytes;
+  } else {
+    fprintf(stderr, "ERROR: Couldn't allocate an arena of %zu bytes\n", bytes);
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Carves `bytes` out of `parent` for use as an independent arena,
+// e.g. one per thread. The memory is returned when `parent` is reset.
+Arena subArena(Arena *parent, size_t bytes) {
+  Arena result = {};
+  initArena(&result, bytes, pushSize(parent, bytes));
 
   return result;
 }
@@ -56,7 +83,13 @@ Arena initArenaAndAllocate(size_t bytes) {
 void destroyArena(Arena *arena) {
   TimeFunction;
   // TODO(chogan): Check for temp count?
+#if _WIN32
   free(arena->base);
+#else
+  if (arena->base) {
+    munmap(arena->base, arena->capacity);
+  }
+#endif
   arena->base = 0;
   arena->used = 0;
   arena->capacity = 0;
@@ -70,7 +103,14 @@ size_t getRemainingCapacity(Arena *arena) {
 
 void growArena(Arena *arena, size_t new_size) {
   if (new_size > arena->capacity) {
+#if _WIN32
     void *new_base = (u8 *)realloc(arena->base, new_size);
+#else
+    void *new_base = mremap(arena->base, arena->capacity, new_size, MREMAP_MAYMOVE);
+    if (new_base == MAP_FAILED) {
+      new_base = NULL;
+    }
+#endif
     if (new_base) {
       arena->base = (u8 *)new_base;
       arena->capacity = new_size;
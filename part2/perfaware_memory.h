@@ -54,6 +54,7 @@ void endTemporaryMemory(TemporaryMemory *temp_memory);
 
 void initArena(Arena *arena, size_t bytes, u8 *base);
 Arena initArenaAndAllocate(size_t bytes);
+Arena subArena(Arena *parent, size_t bytes);
 void destroyArena(Arena *arena);
 size_t getRemainingCapacity(Arena *arena);
 void growArena(Arena *arena, size_t new_size);
@@ -0,0 +1,176 @@
+#include <stdio.h>
+
+#include <semaphore>
+#include <thread>
+
+#include "perfaware_pipeline.h"
+
+// NOTE(chogan): The most bytes of a partial record we'll carry from one buffer
+// to the next. A record is ~100 bytes, so running out of this means the input
+// isn't a pairs file.
+const u64 kMaxCarrySize = KILOBYTES(64);
+
+struct PipelineBuffer {
+  u8 *base;
+  u64 size;
+  // NOTE(chogan): Counted by the reader, so the parsing thread can keep track
+  // of lines for error messages without another pass over the data
+  u64 newline_count;
+  bool eof;
+};
+
+struct ReadPipeline {
+  FILE *file;
+  PipelineBuffer buffers[2];
+  u64 buffer_size;
+  bool read_error;
+  // NOTE(chogan): Set by the parsing thread to make the reader quit. Like the
+  // buffers, it's handed over by the semaphores.
+  bool stop;
+  std::counting_semaphore<2> empty_buffers{2};
+  std::counting_semaphore<2> full_buffers{0};
+};
+
+// NOTE(chogan): Data goes after the carry region, so the carried bytes and the
+// new bytes end up contiguous.
+static u8 *getBufferData(PipelineBuffer *buffer) {
+  u8 *result = buffer->base + kMaxCarrySize;
+
+  return result;
+}
+
+static void readerThread(ReadPipeline *pipeline) {
+  for (u32 i = 0;; ++i) {
+    PipelineBuffer *buffer = &pipeline->buffers[i % 2];
+    pipeline->empty_buffers.acquire();
+    if (pipeline->stop) {
+      break;
+    }
+
+    size_t bytes_read = fread(getBufferData(buffer), 1, pipeline->buffer_size,
+                              pipeline->file);
+    buffer->size = bytes_read;
+    buffer->newline_count = countNewlines(getBufferData(buffer), bytes_read);
+    buffer->eof = bytes_read < pipeline->buffer_size;
+    if (buffer->eof && ferror(pipeline->file)) {
+      pipeline->read_error = true;
+    }
+
+    pipeline->full_buffers.release();
+
+    if (buffer->eof) {
+      break;
+    }
+  }
+}
+
+bool runReadPipeline(Arena *scratch, const char *path, u64 buffer_size,
+                     ConsumeRecordsFunc *consume, void *context,
+                     ReadPipelineStats *stats, u64 records_offset, u32 records_line) {
+  bool result = true;
+  FILE *file = fopen(path, "rb");
+
+  if (file && records_offset > 0 && !seekFile(file, records_offset)) {
+    fprintf(stderr, "ERROR: Couldn't seek to %llu in %s\n", (unsigned long long)records_offset,
+            path);
+    fclose(file);
+    file = NULL;
+    result = false;
+  } else if (file) {
+    ScopedTemporaryMemory buffer_memory(scratch);
+    ReadPipeline pipeline;
+    pipeline.file = file;
+    pipeline.buffer_size = buffer_size;
+    pipeline.read_error = false;
+    pipeline.stop = false;
+    for (u32 i = 0; i < ArrayCount(pipeline.buffers); ++i) {
+      pipeline.buffers[i].base = pushSize(buffer_memory, kMaxCarrySize + buffer_size);
+      pipeline.buffers[i].size = 0;
+      pipeline.buffers[i].newline_count = 0;
+      pipeline.buffers[i].eof = false;
+    }
+
+    std::thread reader(readerThread, &pipeline);
+
+    u64 carry_size = 0;
+    u64 carry_newlines = 0;
+    // NOTE(chogan): The line the carry (or the buffer, if there's none) starts on
+    u32 line = records_offset > 0 ? records_line : 1;
+    bool in_records = records_offset > 0;
+    for (u32 i = 0;; ++i) {
+      PipelineBuffer *buffer = &pipeline.buffers[i % 2];
+      PipelineBuffer *next_buffer = &pipeline.buffers[(i + 1) % 2];
+
+      u64 wait_start = readCpuTimer();
+      pipeline.full_buffers.acquire();
+      if (stats) {
+        stats->parse_wait_cycles += readCpuTimer() - wait_start;
+        stats->bytes_read += buffer->size;
+        stats->buffer_count++;
+      }
+
+      u8 *data = getBufferData(buffer) - carry_size;
+      u8 *end = getBufferData(buffer) + buffer->size;
+      bool is_last = buffer->eof;
+
+      u8 *records = data;
+      if (!in_records) {
+        // NOTE(chogan): Skip the `{"pairs":[` header
+        u8 *open_brace = (u8 *)memchr(data, '[', end - data);
+        if (open_brace) {
+          records = open_brace + 1;
+          in_records = true;
+        } else {
+          records = end;
+        }
+      }
+
+      // NOTE(chogan): Only the parser can tell where a record really ends,
+      // since a `{` or `}` could be in a string or a nested object.
+      u8 *records_end = end;
+      if (in_records) {
+        EntireFile run = {};
+        run.data = records;
+        run.size = end - records;
+        u32 first_line = line + (u32)countNewlines(data, records - data);
+        records_end = records + consume(context, &run, first_line, is_last);
+      }
+
+      if (is_last) {
+        pipeline.empty_buffers.release();
+        break;
+      }
+
+      // NOTE(chogan): The reader only writes past the carry region, so we can
+      // fill in the next buffer's carry while it's still being read into.
+      carry_size = end - records_end;
+      if (carry_size > kMaxCarrySize) {
+        fprintf(stderr, "ERROR: No complete record in %llu bytes of %s\n",
+                (unsigned long long)kMaxCarrySize, path);
+        result = false;
+        pipeline.stop = true;
+        pipeline.empty_buffers.release();
+        break;
+      }
+      memcpy(getBufferData(next_buffer) - carry_size, records_end, carry_size);
+      u64 next_carry_newlines = countNewlines(records_end, carry_size);
+      line += (u32)(carry_newlines + buffer->newline_count - next_carry_newlines);
+      carry_newlines = next_carry_newlines;
+
+      pipeline.empty_buffers.release();
+    }
+
+    reader.join();
+
+    if (pipeline.read_error) {
+      fprintf(stderr, "ERROR: Failed reading %s\n", path);
+      result = false;
+    }
+    fclose(file);
+  } else if (result) {
+    fprintf(stderr, "ERROR: Couldn't open file %s\n", path);
+    result = false;
+  }
+
+  return result;
+}
@@ -0,0 +1,32 @@
+#ifndef PERFAWARE_PIPELINE_H_
+#define PERFAWARE_PIPELINE_H_
+
+// NOTE(chogan): Called on the parsing thread with a run of pair records (no
+// header) that starts on a record, or on the `,` before one. It may end partway
+// into a record. Returns the offset in `records` just past the last complete
+// record it took, or 0 if there wasn't one, and the rest is handed over again
+// at the front of the next run. `first_line` is the line of the file the run
+// starts on. `is_last` is set for the final run, which also contains whatever
+// trails the last record.
+typedef u64 ConsumeRecordsFunc(void *context, EntireFile *records, u32 first_line,
+                               bool is_last);
+
+struct ReadPipelineStats {
+  u64 bytes_read;
+  u64 buffer_count;
+  u64 parse_wait_cycles;
+};
+
+// NOTE(chogan): Streams a pairs file through two `buffer_size` buffers. A
+// reader thread fills one buffer while `consume` runs on the other, so I/O and
+// parsing overlap. Whatever `consume` didn't take is carried over to the
+// front of the next buffer, so the runs are contiguous in the file and a
+// record that straddles two buffers is seen whole in the second one. If
+// `records_offset` isn't 0, reading starts there, already past the header, on
+// line `records_line`.
+bool runReadPipeline(Arena *scratch, const char *path, u64 buffer_size,
+                     ConsumeRecordsFunc *consume, void *context,
+                     ReadPipelineStats *stats = 0, u64 records_offset = 0,
+                     u32 records_line = 1);
+
+#endif  // PERFAWARE_PIPELINE_H_
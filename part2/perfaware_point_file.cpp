@@ -0,0 +1,300 @@
+#include <stdio.h>
+
+#include "perfaware_file.h"
+#include "perfaware_hash.h"
+#include "perfaware_haversine.h"
+#include "perfaware_point_file.h"
+
+static u64 getColumnStride(u64 num_points) {
+  u64 result = alignForward(num_points * sizeof(f64), kPointFileAlignment);
+
+  return result;
+}
+
+static bool writePadding(FILE *file, u64 size) {
+  static const u8 zeros[kPointFileAlignment] = {};
+  u64 padding = alignForward(size, kPointFileAlignment) - size;
+  bool result = padding == 0 || fwrite(zeros, padding, 1, file) == 1;
+
+  return result;
+}
+
+PointFileHeader initPointFileHeader(u64 num_points) {
+  PointFileHeader result = {};
+  result.magic = kPointFileMagic;
+  result.version = kPointFileVersion;
+  result.num_points = num_points;
+
+  u64 stride = getColumnStride(num_points);
+  for (u32 i = 0; i < kPointFileColumnCount; ++i) {
+    result.column_offsets[i] = kPointFileAlignment + i * stride;
+  }
+
+  return result;
+}
+
+u64 getPointFileSize(u64 num_points) {
+  u64 result = kPointFileAlignment + kPointFileColumnCount * getColumnStride(num_points);
+
+  return result;
+}
+
+u64 getChecksumBlockCount(u64 num_points) {
+  u64 result = (num_points + kPointFileChecksumBlockSize - 1) / kPointFileChecksumBlockSize;
+
+  return result;
+}
+
+u64 combineBlockHashes(u64 *block_hashes, u64 num_points) {
+  u64 count = kPointFileColumnCount * getChecksumBlockCount(num_points);
+  u64 result = hashBytes(block_hashes, count * sizeof(u64));
+
+  return result;
+}
+
+bool writePointFile(Arena *scratch, const char *path, Point *points, u64 num_points) {
+  TimeBandwidth(__func__, num_points * sizeof(Point));
+  ScopedTemporaryMemory scratch_memory(scratch);
+  bool result = false;
+  FILE *file = fopen(path, "wb");
+
+  if (file) {
+    PointFileHeader header = initPointFileHeader(num_points);
+
+    // NOTE(chogan): Transpose one checksum block of a column at a time,
+    // hashing as we go.
+    const u64 kChunkCount = kPointFileChecksumBlockSize;
+    f64 *chunk = pushArray<f64>(scratch_memory, kChunkCount);
+    u64 block_count = getChecksumBlockCount(num_points);
+    u64 *block_hashes = pushArray<u64>(scratch_memory, kPointFileColumnCount * block_count);
+    bool ok = fseek(file, (long)kPointFileAlignment, SEEK_SET) == 0;
+
+    for (u32 column = 0; column < kPointFileColumnCount && ok; ++column) {
+      for (u64 block = 0; block < block_count && ok; ++block) {
+        u64 first = block * kChunkCount;
+        u64 count = num_points - first < kChunkCount ? num_points - first : kChunkCount;
+        const f64 *src = &points[first].x0 + column;
+        for (u64 i = 0; i < count; ++i) {
+          chunk[i] = src[i * kPointFileColumnCount];
+        }
+        block_hashes[column * block_count + block] = hashBytes(chunk, count * sizeof(f64));
+        ok = fwrite(chunk, count * sizeof(f64), 1, file) == 1;
+      }
+      ok = ok && writePadding(file, num_points * sizeof(f64));
+    }
+
+    header.checksum = combineBlockHashes(block_hashes, num_points);
+    ok = ok && fseek(file, 0, SEEK_SET) == 0;
+    ok = ok && fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && writePadding(file, sizeof(header));
+    result = fclose(file) == 0 && ok;
+
+    if (!result) {
+      fprintf(stderr, "ERROR: Failed writing %s\n", path);
+    }
+  } else {
+    fprintf(stderr, "ERROR: Couldn't open file %s\n", path);
+  }
+
+  return result;
+}
+
+bool isPointFile(const char *path) {
+  bool result = false;
+  FILE *file = fopen(path, "rb");
+
+  if (file) {
+    u32 magic = 0;
+    result = fread(&magic, sizeof(magic), 1, file) == 1 && magic == kPointFileMagic;
+    fclose(file);
+  }
+
+  return result;
+}
+
+static bool validatePointFileHeader(const char *path, PointFileHeader *header, u64 file_size) {
+  bool result = false;
+
+  if (file_size < kPointFileAlignment || header->magic != kPointFileMagic) {
+    fprintf(stderr, "ERROR: %s isn't a point file\n", path);
+  } else if (header->version != kPointFileVersion) {
+    fprintf(stderr, "ERROR: %s is point file version %u, expected %u\n", path,
+            header->version, kPointFileVersion);
+  } else if (header->num_points > file_size / sizeof(f64)) {
+    // NOTE(chogan): Checked before the multiply below, which could wrap
+    fprintf(stderr, "ERROR: %s is truncated or corrupt (%llu points)\n", path,
+            (unsigned long long)header->num_points);
+  } else {
+    result = true;
+    u64 column_size = header->num_points * sizeof(f64);
+    for (u32 i = 0; i < kPointFileColumnCount; ++i) {
+      u64 offset = header->column_offsets[i];
+      if (offset % kPointFileAlignment != 0 || offset > file_size ||
+          file_size - offset < column_size) {
+        fprintf(stderr, "ERROR: %s is truncated or corrupt (column %u)\n", path, i);
+        result = false;
+        break;
+      }
+    }
+  }
+
+  return result;
+}
+
+bool readPointFileHeader(const char *path, PointFileHeader *header) {
+  bool result = false;
+  FILE *file = fopen(path, "rb");
+  *header = {};
+
+  if (file) {
+    u64 file_size = 0;
+    result = (getFileSize(path, &file_size) && fread(header, sizeof(*header), 1, file) == 1 &&
+              validatePointFileHeader(path, header, file_size));
+    fclose(file);
+    // NOTE(chogan): Callers size memory from it, so don't leave a bad count
+    if (!result) {
+      *header = {};
+    }
+  } else {
+    fprintf(stderr, "ERROR: Couldn't open file %s\n", path);
+  }
+
+  return result;
+}
+
+static void hashColumnBlocks(f64 *column, u64 first, u64 count, u64 *block_hashes) {
+  for (u64 offset = 0; offset < count; offset += kPointFileChecksumBlockSize) {
+    u64 size = count - offset < kPointFileChecksumBlockSize ? count - offset
+                                                            : kPointFileChecksumBlockSize;
+    u64 block = (first + offset) / kPointFileChecksumBlockSize;
+    block_hashes[block] = hashBytes(column + offset, size * sizeof(f64));
+  }
+}
+
+static bool checkChecksum(const char *path, PointFileHeader *header, u64 *block_hashes) {
+  u64 checksum = combineBlockHashes(block_hashes, header->num_points);
+  bool result = checksum == header->checksum;
+
+  if (!result) {
+    fprintf(stderr, "ERROR: %s checksum mismatch (%016llx != %016llx)\n", path,
+            (unsigned long long)checksum, (unsigned long long)header->checksum);
+  }
+
+  return result;
+}
+
+bool openPointFile(Arena *arena, const char *path, FileReadOptions *options,
+                   bool verify_checksum, PointFile *result) {
+  TimeFunction;
+  bool success = false;
+  *result = {};
+  result->file = readEntireFile(arena, path, options);
+  PointFileHeader *header = (PointFileHeader *)result->file.data;
+
+  if (!header || !validatePointFileHeader(path, header, result->file.size)) {
+    // NOTE(chogan): Already reported
+  } else if ((uintptr_t)result->file.data % sizeof(f64) != 0) {
+    fprintf(stderr, "ERROR: %s was loaded at a misaligned address\n", path);
+  } else {
+    f64 *columns[kPointFileColumnCount] = {};
+    for (u32 i = 0; i < kPointFileColumnCount; ++i) {
+      columns[i] = (f64 *)(result->file.data + header->column_offsets[i]);
+    }
+
+    result->points.x0 = columns[0];
+    result->points.y0 = columns[1];
+    result->points.x1 = columns[2];
+    result->points.y1 = columns[3];
+    result->points.num_points = header->num_points;
+    success = true;
+
+    if (verify_checksum) {
+      TimeBandwidth("verifyChecksum", kPointFileColumnCount * header->num_points * sizeof(f64));
+      ScopedTemporaryMemory hash_memory(arena);
+      u64 block_count = getChecksumBlockCount(header->num_points);
+      u64 *block_hashes = pushArray<u64>(hash_memory, kPointFileColumnCount * block_count);
+      for (u32 i = 0; i < kPointFileColumnCount; ++i) {
+        hashColumnBlocks(columns[i], 0, header->num_points, block_hashes + i * block_count);
+      }
+      success = checkChecksum(path, header, block_hashes);
+    }
+  }
+
+  if (!success) {
+    closePointFile(result);
+  }
+
+  return success;
+}
+
+void closePointFile(PointFile *point_file) {
+  releaseEntireFile(&point_file->file);
+  point_file->points = {};
+}
+
+bool openPointFileReader(Arena *arena, const char *path, u64 window_size,
+                         bool verify_checksum, PointFileReader *reader) {
+  *reader = {};
+  reader->path = path;
+  bool result = readPointFileHeader(path, &reader->header) && openInputFile(path, &reader->file);
+
+  if (result) {
+    u64 blocks = (window_size + kPointFileChecksumBlockSize - 1) / kPointFileChecksumBlockSize;
+    reader->window_size = (blocks > 0 ? blocks : 1) * kPointFileChecksumBlockSize;
+    for (u32 i = 0; i < kPointFileColumnCount; ++i) {
+      reader->buffers[i] = pushArray<f64>(arena, reader->window_size);
+    }
+    if (verify_checksum) {
+      u64 block_count = getChecksumBlockCount(reader->header.num_points);
+      reader->block_hashes = pushArray<u64>(arena, kPointFileColumnCount * block_count);
+    }
+  }
+
+  return result;
+}
+
+bool readPointWindow(PointFileReader *reader) {
+  TimeFunction;
+  PointFileHeader *header = &reader->header;
+  u64 first = reader->next;
+  u64 remaining = header->num_points - first;
+  u64 count = remaining < reader->window_size ? remaining : reader->window_size;
+  bool result = count > 0 && !reader->failed;
+
+  for (u32 i = 0; i < kPointFileColumnCount && result; ++i) {
+    u64 offset = header->column_offsets[i] + first * sizeof(f64);
+    result = readFileAt(&reader->file, offset, reader->buffers[i], count * sizeof(f64));
+    if (!result) {
+      fprintf(stderr, "ERROR: Failed reading points %llu to %llu of %s\n",
+              (unsigned long long)first, (unsigned long long)(first + count), reader->path);
+      reader->failed = true;
+    } else if (reader->block_hashes) {
+      u64 *column_hashes = reader->block_hashes + i * getChecksumBlockCount(header->num_points);
+      hashColumnBlocks(reader->buffers[i], first, count, column_hashes);
+    }
+  }
+
+  if (result) {
+    reader->window.x0 = reader->buffers[0];
+    reader->window.y0 = reader->buffers[1];
+    reader->window.x1 = reader->buffers[2];
+    reader->window.y1 = reader->buffers[3];
+    reader->window.num_points = count;
+    reader->next += count;
+  }
+
+  return result;
+}
+
+bool closePointFileReader(PointFileReader *reader) {
+  bool result = !reader->failed;
+
+  // NOTE(chogan): The checksum only means something if every point was read
+  if (result && reader->block_hashes && reader->next == reader->header.num_points) {
+    result = checkChecksum(reader->path, &reader->header, reader->block_hashes);
+  }
+  closeInputFile(&reader->file);
+  *reader = {};
+
+  return result;
+}
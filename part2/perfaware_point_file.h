@@ -0,0 +1,81 @@
+#ifndef PERFAWARE_POINT_FILE_H_
+#define PERFAWARE_POINT_FILE_H_
+
+// NOTE(chogan): Binary point file (.pts). A header page followed by the x0,
+// y0, x1 and y1 columns, each starting on its own page, so a mapping of the
+// file can be used as a PointColumns without any parsing or copying.
+//
+//   [PointFileHeader, zero padded to kPointFileAlignment]
+//   [x0 * num_points, zero padded to kPointFileAlignment]
+//   [y0 ...] [x1 ...] [y1 ...]
+//
+// All fields are little endian. Each column is hashed (hashBytes) in blocks of
+// kPointFileChecksumBlockSize values, and `checksum` is hashBytes over those
+// block hashes, all of x0's blocks first, then y0's and so on. Blocks can be
+// hashed in any order, so the file can be written or checked a piece at a time.
+
+const u32 kPointFileMagic = 0x53545048;  // "HPTS"
+const u32 kPointFileVersion = 2;
+const u64 kPointFileAlignment = KILOBYTES(4);
+const u32 kPointFileColumnCount = 4;
+const u64 kPointFileChecksumBlockSize = KILOBYTES(16);
+
+struct PointFileHeader {
+  u32 magic;
+  u32 version;
+  u64 num_points;
+  u64 column_offsets[kPointFileColumnCount];
+  u64 checksum;
+};
+
+struct PointFile {
+  EntireFile file;
+  PointColumns points;
+};
+
+// NOTE(chogan): Reads a point file a window of points at a time with
+// positional reads, for when it shouldn't (or can't) be mapped whole.
+struct PointFileReader {
+  const char *path;
+  InputFile file;
+  PointFileHeader header;
+  u64 window_size;
+  u64 next;
+  f64 *buffers[kPointFileColumnCount];
+  // NOTE(chogan): NULL unless the checksum is being verified
+  u64 *block_hashes;
+  PointColumns window;
+  bool failed;
+};
+
+// NOTE(chogan): Everything but the checksum
+PointFileHeader initPointFileHeader(u64 num_points);
+// NOTE(chogan): Total size, including the last column's padding
+u64 getPointFileSize(u64 num_points);
+u64 getChecksumBlockCount(u64 num_points);
+// NOTE(chogan): `block_hashes[column * getChecksumBlockCount(num_points) + block]`
+// holds the hash of that block's values.
+u64 combineBlockHashes(u64 *block_hashes, u64 num_points);
+
+bool writePointFile(Arena *scratch, const char *path, Point *points, u64 num_points);
+bool isPointFile(const char *path);
+// NOTE(chogan): Reads and checks just the header
+bool readPointFileHeader(const char *path, PointFileHeader *header);
+// NOTE(chogan): Maps (or reads, depending on `options`) `path` and points
+// `result->points` into it. The checksum pass touches every byte, so it's
+// optional for quick reruns. Call `closePointFile` when done.
+bool openPointFile(Arena *arena, const char *path, FileReadOptions *options,
+                   bool verify_checksum, PointFile *result);
+void closePointFile(PointFile *point_file);
+
+// NOTE(chogan): `window_size` is rounded up to a whole number of checksum
+// blocks. Needs about 32 bytes per window point from `arena`.
+bool openPointFileReader(Arena *arena, const char *path, u64 window_size,
+                         bool verify_checksum, PointFileReader *reader);
+// NOTE(chogan): Reads the next window into `reader->window`. Returns false
+// once every point has been read, or on a read error (which sets `failed`).
+bool readPointWindow(PointFileReader *reader);
+// NOTE(chogan): Returns false if a read failed or the checksum didn't match
+bool closePointFileReader(PointFileReader *reader);
+
+#endif  // PERFAWARE_POINT_FILE_H_
@@ -0,0 +1,223 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "perfaware_query.h"
+
+const char *kQueryOpNames[QueryOp_Count] = {
+  "info",
+  "sum",
+  "answers",
+  "pairs",
+  "within",
+  "nearest",
+  "shutdown",
+};
+
+const char *kQueryStatusNames[QueryStatus_Count] = {
+  "ok",
+  "unknown op",
+  "unknown dataset",
+  "out of range",
+  "too many items",
+  "no index",
+};
+
+bool parseQueryOp(const char *name, QueryOp *op) {
+  bool result = false;
+
+  for (u32 i = 0; i < QueryOp_Count; ++i) {
+    if (strcmp(name, kQueryOpNames[i]) == 0) {
+      *op = (QueryOp)i;
+      result = true;
+      break;
+    }
+  }
+
+  return result;
+}
+
+static bool initQueryAddress(const char *path, sockaddr_un *address) {
+  bool result = strlen(path) < sizeof(address->sun_path);
+
+  if (result) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, path);
+  } else {
+    fprintf(stderr, "ERROR: Socket path %s is too long\n", path);
+  }
+
+  return result;
+}
+
+bool openQueryListener(const char *path, QuerySocket *listener) {
+  sockaddr_un address = {};
+  bool result = initQueryAddress(path, &address);
+
+  struct stat info = {};
+  if (result && stat(path, &info) == 0) {
+    if (S_ISSOCK(info.st_mode)) {
+      unlink(path);
+    } else {
+      fprintf(stderr, "ERROR: %s exists and isn't a socket\n", path);
+      result = false;
+    }
+  }
+
+  if (result) {
+    listener->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    result = (listener->fd != -1 &&
+              bind(listener->fd, (sockaddr *)&address, sizeof(address)) == 0 &&
+              listen(listener->fd, kQueryBacklog) == 0 &&
+              fcntl(listener->fd, F_SETFL, fcntl(listener->fd, F_GETFL) | O_NONBLOCK) == 0);
+    if (!result) {
+      fprintf(stderr, "ERROR: Couldn't listen on %s: %s\n", path, strerror(errno));
+      if (listener->fd != -1) {
+        close(listener->fd);
+        listener->fd = -1;
+      }
+    }
+  }
+
+  return result;
+}
+
+bool acceptQueryConnection(QuerySocket *listener, QuerySocket *connection) {
+  do {
+    connection->fd = accept(listener->fd, NULL, NULL);
+  } while (connection->fd == -1 && errno == EINTR);
+
+  bool result = connection->fd != -1;
+
+  return result;
+}
+
+bool openQuerySocketPair(QuerySocket *first, QuerySocket *second) {
+  int fds[2] = {-1, -1};
+  bool result = socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0;
+
+  if (result) {
+    first->fd = fds[0];
+    second->fd = fds[1];
+  } else {
+    fprintf(stderr, "ERROR: Couldn't create a socket pair: %s\n", strerror(errno));
+  }
+
+  return result;
+}
+
+bool waitForQuerySockets(QuerySocket *sockets, u32 count, bool *ready) {
+  assert(count <= kMaxQueryWaitCount);
+  pollfd fds[kMaxQueryWaitCount];
+  for (u32 i = 0; i < count; ++i) {
+    fds[i].fd = sockets[i].fd;
+    fds[i].events = POLLIN;
+    fds[i].revents = 0;
+  }
+
+  int polled = 0;
+  do {
+    polled = poll(fds, count, -1);
+  } while (polled == -1 && errno == EINTR);
+
+  bool result = polled > 0;
+  for (u32 i = 0; i < count; ++i) {
+    ready[i] = result && fds[i].revents != 0;
+  }
+
+  return result;
+}
+
+bool connectQuerySocket(const char *path, QuerySocket *connection) {
+  sockaddr_un address = {};
+  bool result = initQueryAddress(path, &address);
+
+  if (result) {
+    connection->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    result = (connection->fd != -1 &&
+              connect(connection->fd, (sockaddr *)&address, sizeof(address)) == 0);
+    if (!result) {
+      fprintf(stderr, "ERROR: Couldn't connect to %s: %s\n", path, strerror(errno));
+      if (connection->fd != -1) {
+        close(connection->fd);
+        connection->fd = -1;
+      }
+    }
+  }
+
+  return result;
+}
+
+void shutdownQuerySocket(QuerySocket *socket) {
+  if (socket->fd != -1) {
+    shutdown(socket->fd, SHUT_RDWR);
+  }
+}
+
+void closeQuerySocket(QuerySocket *socket) {
+  if (socket->fd != -1) {
+    close(socket->fd);
+    socket->fd = -1;
+  }
+}
+
+bool sendQueryBytes(QuerySocket *socket, const void *data, u64 size) {
+  const u8 *at = (const u8 *)data;
+  bool result = true;
+
+  while (size > 0 && result) {
+    // NOTE(chogan): A client that went away is an error, not a SIGPIPE
+    ssize_t sent = send(socket->fd, at, size, MSG_NOSIGNAL);
+    if (sent > 0) {
+      at += sent;
+      size -= sent;
+    } else if (sent == -1 && errno == EINTR) {
+      continue;
+    } else {
+      result = false;
+    }
+  }
+
+  return result;
+}
+
+bool receiveQueryBytes(QuerySocket *socket, void *dest, u64 size) {
+  u8 *at = (u8 *)dest;
+  bool result = true;
+
+  while (size > 0 && result) {
+    ssize_t received = recv(socket->fd, at, size, 0);
+    if (received > 0) {
+      at += received;
+      size -= received;
+    } else if (received == -1 && errno == EINTR) {
+      continue;
+    } else {
+      result = false;
+    }
+  }
+
+  return result;
+}
+
+bool runQuery(QuerySocket *socket, QueryRequest *request, Arena *arena,
+              QueryResponse *response, void **items) {
+  bool result = (sendQueryBytes(socket, request, sizeof(*request)) &&
+                 receiveQueryBytes(socket, response, sizeof(*response)));
+  *items = NULL;
+
+  if (result && response->count > 0) {
+    u64 size = response->count * response->item_size;
+    *items = pushSize(arena, size);
+    result = receiveQueryBytes(socket, *items, size);
+  }
+
+  return result;
+}
@@ -0,0 +1,116 @@
+#ifndef PERFAWARE_QUERY_H_
+#define PERFAWARE_QUERY_H_
+
+// NOTE(chogan): Binary protocol between query_server and its clients, over a
+// Unix domain socket (Linux only). A client sends fixed size QueryRequests and
+// gets one reply per request, in order:
+//
+//   [QueryResponse][count items of item_size bytes]
+//
+// Both are sent as the raw structs, so everything is little endian. What the
+// fields mean depends on the op:
+//
+//   op         request                    reply
+//   info       dataset                    total = pairs, value = average
+//   sum        dataset, first, count      total = count, value = sum of answers
+//   answers    dataset, first, count      the f64 answers
+//   pairs      dataset, first, count      the Points
+//   within     dataset, x, y, radius,     total = matches, the first `count` of
+//              count = most to send       them as SpatialMatches, in index order
+//   nearest    dataset, x, y, count = k   SpatialMatches, nearest first
+//   shutdown                              empty, then the server stops
+//
+// Ranges are [first, first + count) of the dataset's pairs. A request for more
+// than kMaxQueryItems items is refused rather than cut short.
+
+enum QueryOp {
+  QueryOp_Info,
+  QueryOp_Sum,
+  QueryOp_Answers,
+  QueryOp_Pairs,
+  QueryOp_Within,
+  QueryOp_Nearest,
+  QueryOp_Shutdown,
+
+  QueryOp_Count
+};
+
+enum QueryStatus {
+  QueryStatus_Ok,
+  QueryStatus_UnknownOp,
+  QueryStatus_UnknownDataset,
+  QueryStatus_OutOfRange,
+  QueryStatus_TooMany,
+  QueryStatus_NoIndex,
+
+  QueryStatus_Count
+};
+
+extern const char *kQueryOpNames[QueryOp_Count];
+extern const char *kQueryStatusNames[QueryStatus_Count];
+
+const char *const kDefaultQuerySocketPath = "haversine_query.sock";
+const u32 kMaxQueryDatasets = 16;
+const u64 kMaxQueryItems = 1 << 16;
+const int kQueryBacklog = 64;
+// NOTE(chogan): The most sockets one waitForQuerySockets call can watch
+const u32 kMaxQueryWaitCount = 128;
+
+struct QueryRequest {
+  u32 op;
+  u32 dataset;
+  u64 first;
+  u64 count;
+  f64 x;
+  f64 y;
+  f64 radius;
+};
+
+struct QueryResponse {
+  u32 status;
+  u32 item_size;
+  u64 count;
+  u64 total;
+  f64 value;
+};
+
+static_assert(sizeof(QueryRequest) == 48, "QueryRequest is part of the protocol");
+static_assert(sizeof(QueryResponse) == 32, "QueryResponse is part of the protocol");
+
+struct QuerySocket {
+  int fd;
+};
+
+bool parseQueryOp(const char *name, QueryOp *op);
+
+// NOTE(chogan): Replaces a stale socket left at `path` by a server that didn't
+// shut down cleanly, but not any other kind of file. The listener doesn't
+// block, so wait for it with waitForQuerySockets.
+bool openQueryListener(const char *path, QuerySocket *listener);
+// NOTE(chogan): Fails if there's no connection waiting (another thread may
+// have taken it), or once the listener has been shut down. The connection
+// blocks as usual.
+bool acceptQueryConnection(QuerySocket *listener, QuerySocket *connection);
+// NOTE(chogan): Two connected sockets, for waking threads in
+// waitForQuerySockets: shutting one down makes the other readable for good.
+bool openQuerySocketPair(QuerySocket *first, QuerySocket *second);
+// NOTE(chogan): Waits until at least one of `sockets` has something to read,
+// or has been closed or shut down, and sets `ready` for each that has. Sockets
+// whose fd is -1 are skipped. Fails on an error.
+bool waitForQuerySockets(QuerySocket *sockets, u32 count, bool *ready);
+bool connectQuerySocket(const char *path, QuerySocket *connection);
+// NOTE(chogan): Wakes anything blocked on `socket` in another thread. Safe to
+// call from a signal handler.
+void shutdownQuerySocket(QuerySocket *socket);
+void closeQuerySocket(QuerySocket *socket);
+
+bool sendQueryBytes(QuerySocket *socket, const void *data, u64 size);
+// NOTE(chogan): Fails on an error, or if the other end closes first
+bool receiveQueryBytes(QuerySocket *socket, void *dest, u64 size);
+
+// NOTE(chogan): Sends `request` and waits for its reply. The items go in
+// `arena`, and `items` is NULL if there are none.
+bool runQuery(QuerySocket *socket, QueryRequest *request, Arena *arena,
+              QueryResponse *response, void **items);
+
+#endif  // PERFAWARE_QUERY_H_
@@ -0,0 +1,379 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "perfaware_cpu.h"
+#include "perfaware_haversine.h"
+#include "perfaware_roofline.h"
+#include "perfaware_thread.h"
+
+const char *kLibmFunctionNames[LibmFunction_Count] = {
+  "sin",
+  "cos",
+  "asin",
+  "sqrt",
+};
+
+static const char *kRooflineLimitNames[RooflineLimit_Count] = {
+  "read",
+  "all-core read",
+  "haversine",
+  "all-core haversine",
+};
+
+const u32 kRooflineRuns = 5;
+// NOTE(chogan): Far bigger than any last level cache
+const u64 kRooflineReadSize = MEGABYTES(256);
+// NOTE(chogan): 16kb of columns and 4kb of answers, comfortably in L1
+const u64 kRooflinePointCount = 512;
+const u32 kRooflineKernelRepeats = 2000;
+const u64 kRooflineLibmCount = 1024;
+const u32 kRooflineLibmRepeats = 2000;
+// NOTE(chogan): The columns in, the answer out
+const u64 kHaversineBytesPerPair = 4 * sizeof(f64) + sizeof(f64);
+
+typedef u64 SumBytesFunc(u8 *data, u64 size);
+
+struct RooflineWork {
+  u8 *data;
+  u64 size;
+  SumBytesFunc *sum_bytes;
+  HaversineKernelFunc *kernel;
+  PointColumns points;
+  f64 *answers;
+  f64 sink;
+};
+
+PERFAWARE_TARGET("avx2")
+static u64 sumBytesAvx2(u8 *data, u64 size) {
+  __m256i sums[4] = {};
+
+  for (u64 i = 0; i + 128 <= size; i += 128) {
+    for (u32 j = 0; j < 4; ++j) {
+      __m256i value = _mm256_loadu_si256((const __m256i *)(data + i + 32 * j));
+      sums[j] = _mm256_add_epi64(sums[j], value);
+    }
+  }
+
+  __m256i sum = _mm256_add_epi64(_mm256_add_epi64(sums[0], sums[1]),
+                                 _mm256_add_epi64(sums[2], sums[3]));
+  u64 lanes[4];
+  _mm256_storeu_si256((__m256i *)lanes, sum);
+  u64 result = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+  return result;
+}
+
+PERFAWARE_TARGET("avx512f")
+static u64 sumBytesAvx512(u8 *data, u64 size) {
+  __m512i sums[2] = {};
+
+  for (u64 i = 0; i + 128 <= size; i += 128) {
+    for (u32 j = 0; j < 2; ++j) {
+      __m512i value = _mm512_loadu_si512((const void *)(data + i + 64 * j));
+      sums[j] = _mm512_add_epi64(sums[j], value);
+    }
+  }
+
+  u64 lanes[8];
+  _mm512_storeu_si512((void *)lanes, _mm512_add_epi64(sums[0], sums[1]));
+  u64 result = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) +
+                ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7])));
+
+  return result;
+}
+
+static u64 sumBytesScalar(u8 *data, u64 size) {
+  u64 sums[4] = {};
+  u64 *words = (u64 *)data;
+
+  for (u64 i = 0; i + 4 <= size / sizeof(u64); i += 4) {
+    sums[0] += words[i + 0];
+    sums[1] += words[i + 1];
+    sums[2] += words[i + 2];
+    sums[3] += words[i + 3];
+  }
+  u64 result = sums[0] + sums[1] + sums[2] + sums[3];
+
+  return result;
+}
+
+static SumBytesFunc *getSumBytesFunc() {
+  CpuFeatures *features = getCpuFeatures();
+  SumBytesFunc *result = sumBytesScalar;
+
+  if (features->avx512f) {
+    result = sumBytesAvx512;
+  } else if (features->avx2) {
+    result = sumBytesAvx2;
+  }
+
+  return result;
+}
+
+static void readRooflineSlice(RooflineWork *work) {
+  u64 sum = work->sum_bytes(work->data, work->size);
+  work->sink += (f64)sum;
+}
+
+static void runRooflineKernel(RooflineWork *work) {
+  f64 sum = 0;
+  for (u32 i = 0; i < kRooflineKernelRepeats; ++i) {
+    sum += work->kernel(&work->points, 0, work->points.num_points, work->answers);
+  }
+  work->sink += sum;
+}
+
+// NOTE(chogan): Best of kRooflineRuns, in seconds, of `proc` on `count` threads
+static f64 timeOnThreads(void (*proc)(RooflineWork *), RooflineWork *work, u32 count) {
+  u64 os_freq = getOsTimerFreq();
+  f64 result = 0;
+
+  for (u32 run = 0; run < kRooflineRuns; ++run) {
+    u64 start = readOsTimer();
+    runOnThreads(proc, work, count);
+    f64 seconds = (f64)(readOsTimer() - start) / (f64)os_freq;
+
+    if (run == 0 || seconds < result) {
+      result = seconds;
+    }
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Splits the buffer into one aligned slice per thread
+static f64 measureReadBandwidth(RooflineWork *work, u8 *data, u32 thread_count) {
+  u64 slice_size = kRooflineReadSize / thread_count / 128 * 128;
+
+  for (u32 i = 0; i < thread_count; ++i) {
+    work[i].data = data + i * slice_size;
+    work[i].size = slice_size;
+    work[i].sum_bytes = getSumBytesFunc();
+  }
+  f64 seconds = timeOnThreads(readRooflineSlice, work, thread_count);
+  f64 result = (f64)(slice_size * thread_count) / seconds;
+
+  return result;
+}
+
+static f64 measureKernelRate(RooflineWork *work, u32 thread_count) {
+  f64 seconds = timeOnThreads(runRooflineKernel, work, thread_count);
+  f64 result = (f64)(kRooflinePointCount * kRooflineKernelRepeats * thread_count) / seconds;
+
+  return result;
+}
+
+static f64 callLibm(LibmFunction function, f64 x) {
+  f64 result = 0;
+
+  switch (function) {
+    case LibmFunction_Sin: result = sin(x); break;
+    case LibmFunction_Cos: result = cos(x); break;
+    case LibmFunction_Asin: result = asin(x); break;
+    case LibmFunction_Sqrt: result = sqrt(x); break;
+    default: break;
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Independent calls, so this is throughput rather than latency
+static f64 measureLibmRate(LibmFunction function, f64 *inputs) {
+  u64 os_freq = getOsTimerFreq();
+  f64 best = 0;
+  volatile f64 sink = 0;
+
+  for (u32 run = 0; run < kRooflineRuns; ++run) {
+    f64 sum = 0;
+    u64 start = readOsTimer();
+    for (u32 repeat = 0; repeat < kRooflineLibmRepeats; ++repeat) {
+      for (u64 i = 0; i < kRooflineLibmCount; ++i) {
+        sum += callLibm(function, inputs[i]);
+      }
+    }
+    f64 seconds = (f64)(readOsTimer() - start) / (f64)os_freq;
+    sink = sink + sum;
+
+    if (run == 0 || seconds < best) {
+      best = seconds;
+    }
+  }
+  f64 result = (f64)(kRooflineLibmCount * kRooflineLibmRepeats) / best;
+
+  return result;
+}
+
+u64 getRooflineScratchSize(u32 thread_count) {
+  u64 per_thread = sizeof(RooflineWork) + kRooflinePointCount * kHaversineBytesPerPair;
+  u64 result = kRooflineReadSize + kRooflineLibmCount * sizeof(f64) + thread_count * per_thread;
+
+  return result;
+}
+
+Roofline measureRoofline(Arena *scratch, HaversineKernel kernel, u32 thread_count) {
+  TimeFunction;
+  ScopedTemporaryMemory scratch_memory(scratch);
+  Roofline result = {};
+  result.kernel = kernel;
+  result.thread_count = thread_count;
+
+  RooflineWork *work = pushClearedArray<RooflineWork>(scratch_memory, thread_count);
+
+  // NOTE(chogan): Written first so the reads don't measure page faults
+  u8 *data = pushSize(scratch_memory, kRooflineReadSize);
+  memset(data, 1, kRooflineReadSize);
+  result.read_bandwidth = measureReadBandwidth(work, data, 1);
+  result.all_core_read_bandwidth = (thread_count > 1 ?
+                                    measureReadBandwidth(work, data, thread_count) :
+                                    result.read_bandwidth);
+
+  f64 *inputs = pushArray<f64>(scratch_memory, kRooflineLibmCount);
+  for (u32 function = 0; function < LibmFunction_Count; ++function) {
+    for (u64 i = 0; i < kRooflineLibmCount; ++i) {
+      f64 unit = (f64)i / (f64)kRooflineLibmCount;
+      inputs[i] = function == LibmFunction_Asin || function == LibmFunction_Sqrt ?
+                  unit : 2.0 * kPiHi * unit - kPiHi;
+    }
+    result.libm_rates[function] = measureLibmRate((LibmFunction)function, inputs);
+  }
+
+  for (u32 i = 0; i < thread_count; ++i) {
+    PointColumns *points = &work[i].points;
+    points->num_points = kRooflinePointCount;
+    points->x0 = pushArray<f64>(scratch_memory, kRooflinePointCount);
+    points->y0 = pushArray<f64>(scratch_memory, kRooflinePointCount);
+    points->x1 = pushArray<f64>(scratch_memory, kRooflinePointCount);
+    points->y1 = pushArray<f64>(scratch_memory, kRooflinePointCount);
+    work[i].answers = pushArray<f64>(scratch_memory, kRooflinePointCount);
+    work[i].kernel = getHaversineKernelFunc(kernel);
+
+    for (u64 j = 0; j < kRooflinePointCount; ++j) {
+      f64 unit = (f64)j / (f64)kRooflinePointCount;
+      points->x0[j] = -180.0 + 360.0 * unit;
+      points->y0[j] = -90.0 + 180.0 * fmod(unit * 7.0, 1.0);
+      points->x1[j] = -180.0 + 360.0 * fmod(unit * 13.0, 1.0);
+      points->y1[j] = -90.0 + 180.0 * fmod(unit * 29.0, 1.0);
+    }
+  }
+  result.kernel_rate = measureKernelRate(work, 1);
+  result.all_core_kernel_rate = (thread_count > 1 ? measureKernelRate(work, thread_count) :
+                                 result.kernel_rate);
+
+  return result;
+}
+
+static f64 toGigabytes(f64 bytes) {
+  f64 result = bytes / (1024.0 * 1024.0 * 1024.0);
+
+  return result;
+}
+
+void printRoofline(Roofline *roofline) {
+  printf("Roofline (%s kernel, %u threads):\n", kHaversineKernelNames[roofline->kernel],
+         roofline->thread_count);
+  printf("  read       %8.2fgb/s one core, %8.2fgb/s all cores\n",
+         toGigabytes(roofline->read_bandwidth), toGigabytes(roofline->all_core_read_bandwidth));
+  printf("  libm      ");
+  for (u32 i = 0; i < LibmFunction_Count; ++i) {
+    printf(" %s %.1fM/s", kLibmFunctionNames[i], roofline->libm_rates[i] / 1e6);
+  }
+  printf(" (one core)\n");
+  printf("  haversine  %8.1fM pairs/s one core, %8.1fM pairs/s all cores\n",
+         roofline->kernel_rate / 1e6, roofline->all_core_kernel_rate / 1e6);
+}
+
+#ifdef PERFAWARE_PROFILE
+
+static ProfileEntry *findProfileEntry(const char *label) {
+  ProfileEntry *result = NULL;
+
+  for (u32 i = 1; i < ArrayCount(global_profiler_.entries); ++i) {
+    ProfileEntry *entry = global_profiler_.entries + i;
+    if (entry->label && entry->hit_count && strcmp(entry->label, label) == 0) {
+      result = entry;
+      break;
+    }
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Haversine stages have two roofs, and the lower one applies
+static f64 getStageRoof(Roofline *roofline, RooflineStage *stage, bool *compute_bound) {
+  f64 result = 0;
+  *compute_bound = false;
+
+  switch (stage->limit) {
+    case RooflineLimit_Read: {
+      result = roofline->read_bandwidth;
+      break;
+    }
+    case RooflineLimit_AllCoreRead: {
+      result = roofline->all_core_read_bandwidth;
+      break;
+    }
+    case RooflineLimit_Haversine:
+    case RooflineLimit_AllCoreHaversine: {
+      bool all_cores = stage->limit == RooflineLimit_AllCoreHaversine;
+      f64 compute = all_cores ? roofline->all_core_kernel_rate : roofline->kernel_rate;
+      f64 bandwidth = all_cores ? roofline->all_core_read_bandwidth : roofline->read_bandwidth;
+      f64 feed = bandwidth / (f64)kHaversineBytesPerPair;
+      *compute_bound = compute < feed;
+      result = *compute_bound ? compute : feed;
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+
+  return result;
+}
+
+void printRooflineReport(Roofline *roofline, RooflineStage *stages, u32 stage_count) {
+  printRoofline(roofline);
+  printf("Stages:\n");
+
+  for (u32 i = 0; i < stage_count; ++i) {
+    RooflineStage *stage = stages + i;
+    ProfileEntry *entry = findProfileEntry(stage->label);
+
+    if (!entry) {
+      printf("  %-20s not run\n", stage->label);
+      continue;
+    }
+
+    // NOTE(chogan): Stages run more than once (--scaling, --compare-reads) do
+    // the same work each time
+    f64 seconds = (f64)entry->elapsed_inclusive / (f64)global_profiler_.cpu_freq;
+    f64 work_scale = (f64)entry->hit_count;
+    bool compute_bound = false;
+    f64 roof = getStageRoof(roofline, stage, &compute_bound);
+    bool is_haversine = (stage->limit == RooflineLimit_Haversine ||
+                         stage->limit == RooflineLimit_AllCoreHaversine);
+
+    printf("  %-20s %9.3fms ", stage->label, 1000.0 * seconds);
+    if (is_haversine) {
+      f64 rate = work_scale * (f64)stage->pairs / seconds;
+      printf("%8.1fM pairs/s %6.1f%% of %s (%s bound, %.1fM pairs/s)\n", rate / 1e6,
+             100.0 * rate / roof, kRooflineLimitNames[stage->limit],
+             compute_bound ? "compute" : "bandwidth", roof / 1e6);
+    } else {
+      f64 rate = work_scale * (f64)stage->bytes / seconds;
+      printf("%8.2fgb/s      %6.1f%% of %s (%.2fgb/s)\n", toGigabytes(rate),
+             100.0 * rate / roof, kRooflineLimitNames[stage->limit], toGigabytes(roof));
+    }
+  }
+}
+
+#else
+
+void printRooflineReport(Roofline *roofline, RooflineStage *stages, u32 stage_count) {
+  (void)stages;
+  (void)stage_count;
+  printRoofline(roofline);
+  printf("Stage timings need a PERFAWARE_PROFILE build\n");
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef PERFAWARE_ROOFLINE_H_
+#define PERFAWARE_ROOFLINE_H_
+
+// NOTE(chogan): The machine limits --roofline compares a run's stages against,
+// measured with built in kernels right before the run:
+//
+//   read       Summing a buffer much bigger than the caches, on one core and
+//              then on every thread the run uses
+//   libm       sin, cos, asin and sqrt calls per second on cached inputs, for
+//              reference (the reference kernel makes 6 calls per pair)
+//   haversine  Pairs per second through the run's kernel with the points in
+//              L1, on one core and then on every thread
+//
+// A stage that streams through the input or the answers is held to read
+// bandwidth. calculateHaversine is held to the lower of its two roofs: the
+// kernel's cached throughput, and how fast memory can feed it the columns and
+// take the answers. Each number is the best of a few runs.
+
+enum RooflineLimit {
+  RooflineLimit_Read,
+  RooflineLimit_AllCoreRead,
+  RooflineLimit_Haversine,
+  RooflineLimit_AllCoreHaversine,
+
+  RooflineLimit_Count
+};
+
+enum LibmFunction {
+  LibmFunction_Sin,
+  LibmFunction_Cos,
+  LibmFunction_Asin,
+  LibmFunction_Sqrt,
+
+  LibmFunction_Count
+};
+
+extern const char *kLibmFunctionNames[LibmFunction_Count];
+
+struct Roofline {
+  HaversineKernel kernel;
+  u32 thread_count;
+  // NOTE(chogan): Bytes per second
+  f64 read_bandwidth;
+  f64 all_core_read_bandwidth;
+  // NOTE(chogan): Calls per second, one core
+  f64 libm_rates[LibmFunction_Count];
+  // NOTE(chogan): Pairs per second
+  f64 kernel_rate;
+  f64 all_core_kernel_rate;
+};
+
+// NOTE(chogan): One stage of a run, found in the profile by `label`. `bytes`
+// is what it reads (for the read limits) and `pairs` what it computes (for the
+// haversine ones).
+struct RooflineStage {
+  const char *label;
+  RooflineLimit limit;
+  u64 bytes;
+  u64 pairs;
+};
+
+u64 getRooflineScratchSize(u32 thread_count);
+Roofline measureRoofline(Arena *scratch, HaversineKernel kernel, u32 thread_count);
+void printRoofline(Roofline *roofline);
+// NOTE(chogan): Stage timings come from the profiler, so they're only printed
+// in a PERFAWARE_PROFILE build, and only for stages the main thread ran.
+void printRooflineReport(Roofline *roofline, RooflineStage *stages, u32 stage_count);
+
+#endif  // PERFAWARE_ROOFLINE_H_
@@ -0,0 +1,437 @@
+#include <math.h>
+
+#include "perfaware_distance.h"
+#include "perfaware_haversine.h"
+#include "perfaware_spatial.h"
+#include "perfaware_thread.h"
+
+// NOTE(chogan): Runs the row kernels from perfaware_distance.cpp, so it has to
+// come after it in the build.
+
+const char *kSpatialEndpointNames[SpatialEndpoint_Count] = {
+  "first",
+  "second",
+  "both",
+};
+
+// NOTE(chogan): Added to every bound on which cells a circle reaches, so
+// rounding can't leave out a cell it just touches
+const f64 kSpatialMarginDegrees = 1e-6;
+
+bool parseSpatialEndpoint(const char *name, SpatialEndpoint *endpoint) {
+  bool result = false;
+
+  for (u32 i = 0; i < SpatialEndpoint_Count; ++i) {
+    if (strcmp(name, kSpatialEndpointNames[i]) == 0) {
+      *endpoint = (SpatialEndpoint)i;
+      result = true;
+      break;
+    }
+  }
+
+  return result;
+}
+
+static u32 getSpatialRow(SpatialIndex *index, f64 y) {
+  f64 row = floor((y + 90.0) / 180.0 * index->rows);
+  u32 result = row < 0 ? 0 : row >= index->rows ? index->rows - 1 : (u32)row;
+
+  return result;
+}
+
+// NOTE(chogan): Not wrapped, so the ends of a range across the antimeridian
+// stay in order
+static s64 getUnwrappedColumn(SpatialIndex *index, f64 x) {
+  s64 result = (s64)floor((x + 180.0) / 360.0 * index->columns);
+
+  return result;
+}
+
+static u32 wrapColumn(SpatialIndex *index, s64 column) {
+  s64 columns = index->columns;
+  u32 result = (u32)(((column % columns) + columns) % columns);
+
+  return result;
+}
+
+static u64 getSpatialCell(SpatialIndex *index, f64 x, f64 y) {
+  u64 result = ((u64)getSpatialRow(index, y) * index->columns +
+                wrapColumn(index, getUnwrappedColumn(index, x)));
+
+  return result;
+}
+
+static void getEndpoint(PointColumns *points, SpatialEndpoint endpoint, u64 id, f64 *x, f64 *y) {
+  u64 at = id;
+  bool second = endpoint == SpatialEndpoint_Second;
+
+  if (endpoint == SpatialEndpoint_Both) {
+    at = id / 2;
+    second = id & 1;
+  }
+  *x = second ? points->x1[at] : points->x0[at];
+  *y = second ? points->y1[at] : points->y0[at];
+}
+
+struct SpatialBuildWork {
+  SpatialIndex *index;
+  PointColumns *points;
+  SpatialEndpoint endpoint;
+  u64 first;
+  u64 count;
+  u32 *cells;
+  // NOTE(chogan): This thread's count per cell, then where its next point in
+  // each cell goes
+  u64 *offsets;
+};
+
+static void binSpatialPoints(SpatialBuildWork *work) {
+  for (u64 id = work->first; id < work->first + work->count; ++id) {
+    f64 x = 0;
+    f64 y = 0;
+    getEndpoint(work->points, work->endpoint, id, &x, &y);
+    u32 cell = (u32)getSpatialCell(work->index, x, y);
+    work->cells[id] = cell;
+    work->offsets[cell]++;
+  }
+}
+
+static void scatterSpatialPoints(SpatialBuildWork *work) {
+  SpatialIndex *index = work->index;
+
+  for (u64 id = work->first; id < work->first + work->count; ++id) {
+    u64 at = work->offsets[work->cells[id]]++;
+    getEndpoint(work->points, work->endpoint, id, index->x + at, index->y + at);
+    index->ids[at] = id;
+  }
+}
+
+// NOTE(chogan): Fills the terms for this thread's range of the sorted points,
+// which other threads may have scattered, so it runs as its own pass
+static void fillSpatialTerms(SpatialBuildWork *work) {
+  SpatialIndex *index = work->index;
+  fillHaversineTerms(&index->terms, work->first, index->x + work->first,
+                     index->y + work->first, work->count);
+}
+
+static u32 getSpatialRowCount(u64 count) {
+  u64 rows = (u64)sqrt((f64)(count / kSpatialPointsPerCell) / 2.0);
+  u32 result = rows < 1 ? 1 : rows > kMaxSpatialRows ? kMaxSpatialRows : (u32)rows;
+
+  return result;
+}
+
+u64 getSpatialBuildScratchSize(u64 count, u32 thread_count) {
+  u64 rows = getSpatialRowCount(count);
+  u64 result = count * sizeof(u32) + thread_count * 2 * rows * rows * sizeof(u64);
+
+  return result;
+}
+
+SpatialIndex buildSpatialIndex(Arena *arena, Arena *scratch, PointColumns *points,
+                               SpatialEndpoint endpoint, HaversineKernel kernel,
+                               u32 thread_count) {
+  TimeFunction;
+  assert(isHaversineKernelSupported(kernel));
+  assert(thread_count >= 1 && thread_count <= kMaxThreads);
+  ScopedTemporaryMemory scratch_memory(scratch);
+  SpatialIndex result = {};
+  result.kernel = kernel;
+  result.count = (endpoint == SpatialEndpoint_Both ? 2 : 1) * points->num_points;
+
+  result.rows = getSpatialRowCount(result.count);
+  result.columns = 2 * result.rows;
+  u64 cell_count = (u64)result.rows * result.columns;
+
+  result.cell_starts = pushArray<u64>(arena, cell_count + 1);
+  result.ids = pushArray<u64>(arena, result.count);
+  result.x = pushArray<f64>(arena, result.count);
+  result.y = pushArray<f64>(arena, result.count);
+  result.terms = pushHaversineTerms(arena, result.count);
+
+  if (thread_count > result.count) {
+    thread_count = result.count > 0 ? (u32)result.count : 1;
+  }
+
+  SpatialBuildWork work[kMaxThreads] = {};
+  u32 *cells = pushArray<u32>(scratch_memory, result.count);
+  u64 per_thread = result.count / thread_count;
+  u64 extra = result.count % thread_count;
+  u64 next = 0;
+
+  for (u32 i = 0; i < thread_count; ++i) {
+    work[i].index = &result;
+    work[i].points = points;
+    work[i].endpoint = endpoint;
+    work[i].first = next;
+    work[i].count = per_thread + (i < extra ? 1 : 0);
+    work[i].cells = cells;
+    work[i].offsets = pushClearedArray<u64>(scratch_memory, (int)cell_count);
+    next += work[i].count;
+  }
+  runOnThreads(binSpatialPoints, work, thread_count);
+
+  // NOTE(chogan): Cell major, then thread, which keeps each cell in input order
+  u64 at = 0;
+  for (u64 cell = 0; cell < cell_count; ++cell) {
+    result.cell_starts[cell] = at;
+    for (u32 i = 0; i < thread_count; ++i) {
+      u64 count = work[i].offsets[cell];
+      work[i].offsets[cell] = at;
+      at += count;
+    }
+  }
+  result.cell_starts[cell_count] = at;
+
+  runOnThreads(scatterSpatialPoints, work, thread_count);
+  runOnThreads(fillSpatialTerms, work, thread_count);
+
+  return result;
+}
+
+// NOTE(chogan): Which cells a circle can reach: rows [first_row, last_row]
+// and, unless `all_columns`, columns [first_column, last_column] unwrapped.
+struct SpatialQuery {
+  f64 origin_terms[5];
+  HaversineTerms origin;
+  u32 first_row;
+  u32 last_row;
+  bool all_columns;
+  s64 first_column;
+  s64 last_column;
+};
+
+struct SpatialSpan {
+  u64 first;
+  u64 count;
+};
+
+static void initSpatialOrigin(SpatialQuery *query, f64 x, f64 y) {
+  query->origin.sin_half_lat = query->origin_terms + 0;
+  query->origin.cos_half_lat = query->origin_terms + 1;
+  query->origin.sin_half_lon = query->origin_terms + 2;
+  query->origin.cos_half_lon = query->origin_terms + 3;
+  query->origin.cos_lat = query->origin_terms + 4;
+  query->origin.count = 1;
+  fillHaversineTerms(&query->origin, 0, &x, &y, 1);
+}
+
+// NOTE(chogan): A circle that doesn't reach a pole spans at most
+// asin(sin(r) / cos(y)) of longitude either side of its center.
+static void setSpatialQueryRadius(SpatialQuery *query, SpatialIndex *index, f64 x, f64 y,
+                                  f64 radius) {
+  f64 angle = radius / kEarthRadius;
+  f64 angle_degrees = angle / kDegreesToRadians + kSpatialMarginDegrees;
+  f64 min_lat = y - angle_degrees;
+  f64 max_lat = y + angle_degrees;
+
+  query->first_row = getSpatialRow(index, min_lat);
+  query->last_row = getSpatialRow(index, max_lat);
+  query->all_columns = angle >= kHalfPiHi || min_lat <= -90.0 || max_lat >= 90.0;
+
+  if (!query->all_columns) {
+    f64 ratio = sin(angle) / cos(y * kDegreesToRadians);
+    f64 lon_degrees = ratio < 1.0 ? asin(ratio) / kDegreesToRadians + kSpatialMarginDegrees : 180;
+    query->first_column = getUnwrappedColumn(index, x - lon_degrees);
+    query->last_column = getUnwrappedColumn(index, x + lon_degrees);
+    query->all_columns = query->last_column - query->first_column + 1 >= index->columns;
+  }
+}
+
+// NOTE(chogan): The one or two (across the antimeridian) runs of points in
+// `row` that the query reaches
+static u32 getSpatialSpans(SpatialIndex *index, SpatialQuery *query, u32 row,
+                           SpatialSpan *spans) {
+  u64 row_cell = (u64)row * index->columns;
+  u64 ranges[2][2] = {};
+  u32 range_count = 0;
+
+  if (query->all_columns) {
+    ranges[range_count][0] = row_cell;
+    ranges[range_count++][1] = row_cell + index->columns;
+  } else {
+    u32 first = wrapColumn(index, query->first_column);
+    u32 last = wrapColumn(index, query->last_column);
+    if (first <= last) {
+      ranges[range_count][0] = row_cell + first;
+      ranges[range_count++][1] = row_cell + last + 1;
+    } else {
+      ranges[range_count][0] = row_cell + first;
+      ranges[range_count++][1] = row_cell + index->columns;
+      ranges[range_count][0] = row_cell;
+      ranges[range_count++][1] = row_cell + last + 1;
+    }
+  }
+
+  u32 result = 0;
+  for (u32 i = 0; i < range_count; ++i) {
+    u64 first = index->cell_starts[ranges[i][0]];
+    u64 end = index->cell_starts[ranges[i][1]];
+    if (end > first) {
+      spans[result].first = first;
+      spans[result++].count = end - first;
+    }
+  }
+
+  return result;
+}
+
+static u64 countSpatialCandidates(SpatialIndex *index, SpatialQuery *query) {
+  u64 result = 0;
+
+  for (u32 row = query->first_row; row <= query->last_row; ++row) {
+    SpatialSpan spans[2];
+    u32 span_count = getSpatialSpans(index, query, row, spans);
+    for (u32 i = 0; i < span_count; ++i) {
+      result += spans[i].count;
+    }
+  }
+
+  return result;
+}
+
+static bool isFartherMatch(SpatialMatch *a, SpatialMatch *b) {
+  bool result = a->distance > b->distance || (a->distance == b->distance && a->id > b->id);
+
+  return result;
+}
+
+// NOTE(chogan): Max heap on (distance, id), so the farthest kept match is on top
+static void siftDownMatch(SpatialMatch *heap, u64 count, u64 at) {
+  for (;;) {
+    u64 largest = at;
+    u64 left = 2 * at + 1;
+    u64 right = left + 1;
+    if (left < count && isFartherMatch(heap + left, heap + largest)) {
+      largest = left;
+    }
+    if (right < count && isFartherMatch(heap + right, heap + largest)) {
+      largest = right;
+    }
+    if (largest == at) {
+      break;
+    }
+    SpatialMatch swap = heap[at];
+    heap[at] = heap[largest];
+    heap[largest] = swap;
+    at = largest;
+  }
+}
+
+static void pushMatch(SpatialMatch *heap, u64 *count, u64 capacity, SpatialMatch match) {
+  if (*count < capacity) {
+    u64 at = (*count)++;
+    heap[at] = match;
+    while (at > 0 && isFartherMatch(heap + at, heap + (at - 1) / 2)) {
+      u64 parent = (at - 1) / 2;
+      SpatialMatch swap = heap[at];
+      heap[at] = heap[parent];
+      heap[parent] = swap;
+      at = parent;
+    }
+  } else if (isFartherMatch(heap, &match)) {
+    heap[0] = match;
+    siftDownMatch(heap, *count, 0);
+  }
+}
+
+// NOTE(chogan): Runs the index's distance kernel over every candidate a tile
+// at a time. With `k` set it keeps the k nearest in a heap, otherwise it keeps
+// the ones within `radius`.
+struct SpatialCollector {
+  SpatialMatch *data;
+  u64 count;
+  u64 k;
+  f64 radius;
+};
+
+static void collectSpatialCandidates(SpatialIndex *index, SpatialQuery *query,
+                                     SpatialCollector *collector) {
+  DistanceRowFunc *row_func = getDistanceRowFunc(index->kernel);
+  f64 distances[kDistanceTileColumns];
+
+  for (u32 row = query->first_row; row <= query->last_row; ++row) {
+    SpatialSpan spans[2];
+    u32 span_count = getSpatialSpans(index, query, row, spans);
+
+    for (u32 i = 0; i < span_count; ++i) {
+      u64 end = spans[i].first + spans[i].count;
+
+      for (u64 first = spans[i].first; first < end; first += kDistanceTileColumns) {
+        u64 count = end - first < kDistanceTileColumns ? end - first : kDistanceTileColumns;
+        row_func(&query->origin, 0, &index->terms, first, count, distances);
+
+        for (u64 j = 0; j < count; ++j) {
+          SpatialMatch match = {index->ids[first + j], distances[j]};
+          if (collector->k) {
+            pushMatch(collector->data, &collector->count, collector->k, match);
+          } else if (match.distance <= collector->radius) {
+            collector->data[collector->count++] = match;
+          }
+        }
+      }
+    }
+  }
+}
+
+SpatialMatches findPointsWithin(Arena *arena, SpatialIndex *index, f64 x, f64 y, f64 radius) {
+  SpatialQuery query = {};
+  initSpatialOrigin(&query, x, y);
+  setSpatialQueryRadius(&query, index, x, y, radius);
+
+  SpatialCollector collector = {};
+  collector.data = pushArray<SpatialMatch>(arena, countSpatialCandidates(index, &query));
+  collector.radius = radius;
+  collectSpatialCandidates(index, &query, &collector);
+
+  SpatialMatches result = {};
+  result.data = collector.data;
+  result.count = collector.count;
+
+  return result;
+}
+
+// NOTE(chogan): Searches a circle that starts around the size that should hold
+// `k` points and doubles until the k-th nearest is inside it, at which point
+// everything that could be nearer has been looked at.
+SpatialMatches findNearestPoints(Arena *arena, SpatialIndex *index, f64 x, f64 y, u64 k) {
+  SpatialMatches result = {};
+  k = k < index->count ? k : index->count;
+
+  if (k > 0) {
+    result.data = pushArray<SpatialMatch>(arena, k);
+    SpatialQuery query = {};
+    initSpatialOrigin(&query, x, y);
+
+    f64 cell_height = 180.0 / index->rows * kDegreesToRadians * kEarthRadius;
+    f64 radius = cell_height * sqrt((f64)k / (f64)kSpatialPointsPerCell + 1.0);
+    f64 max_radius = kPiHi * kEarthRadius;
+
+    SpatialCollector collector = {};
+    collector.data = result.data;
+    collector.k = k;
+
+    for (;;) {
+      setSpatialQueryRadius(&query, index, x, y, radius);
+      collector.count = 0;
+      collectSpatialCandidates(index, &query, &collector);
+
+      if ((collector.count == k && collector.data[0].distance <= radius) ||
+          radius >= max_radius) {
+        break;
+      }
+      radius *= 2;
+    }
+    result.count = collector.count;
+
+    // NOTE(chogan): Heap sort, nearest first
+    for (u64 end = result.count; end > 1; --end) {
+      SpatialMatch swap = result.data[0];
+      result.data[0] = result.data[end - 1];
+      result.data[end - 1] = swap;
+      siftDownMatch(result.data, end - 1, 0);
+    }
+  }
+
+  return result;
+}
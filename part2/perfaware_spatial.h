@@ -0,0 +1,71 @@
+#ifndef PERFAWARE_SPATIAL_H_
+#define PERFAWARE_SPATIAL_H_
+
+// NOTE(chogan): A latitude/longitude grid over one endpoint (or both) of a
+// PointColumns' pairs, for radius and nearest neighbour queries. Cells are
+// kSpatialPointsPerCell points on average, twice as many columns as rows so
+// they're square at the equator.
+//
+// The points are stored sorted by cell (row major), so a run of cells in one
+// row is one contiguous range of points, with their HaversineTerms (see
+// perfaware_distance.h) alongside. A query works out which cells its circle
+// can reach, row by row, and runs the distance kernels over just those ranges.
+// The build is a counting sort: threads bin their slice of the points, and
+// then each scatters its slice to where the prefix sums put it, so the order
+// within a cell is the input order no matter how many threads there are.
+//
+// Point ids are pair indices, or pair * 2 + endpoint when both endpoints are
+// indexed.
+
+enum SpatialEndpoint {
+  SpatialEndpoint_First,
+  SpatialEndpoint_Second,
+  SpatialEndpoint_Both,
+
+  SpatialEndpoint_Count
+};
+
+extern const char *kSpatialEndpointNames[SpatialEndpoint_Count];
+
+const u64 kSpatialPointsPerCell = 8;
+const u32 kMaxSpatialRows = 4096;
+
+struct SpatialIndex {
+  HaversineKernel kernel;
+  u32 rows;
+  u32 columns;
+  u64 count;
+  // NOTE(chogan): rows * columns + 1 offsets into the points
+  u64 *cell_starts;
+  u64 *ids;
+  f64 *x;
+  f64 *y;
+  HaversineTerms terms;
+};
+
+struct SpatialMatch {
+  u64 id;
+  f64 distance;
+};
+
+struct SpatialMatches {
+  SpatialMatch *data;
+  u64 count;
+};
+
+bool parseSpatialEndpoint(const char *name, SpatialEndpoint *endpoint);
+// NOTE(chogan): `scratch` holds the per thread bins while building, at most
+// getSpatialBuildScratchSize bytes
+u64 getSpatialBuildScratchSize(u64 count, u32 thread_count);
+SpatialIndex buildSpatialIndex(Arena *arena, Arena *scratch, PointColumns *points,
+                               SpatialEndpoint endpoint, HaversineKernel kernel,
+                               u32 thread_count);
+// NOTE(chogan): Every point within `radius` km of (x, y), in index order. The
+// array has room for every candidate looked at, so it can be bigger than
+// `count`.
+SpatialMatches findPointsWithin(Arena *arena, SpatialIndex *index, f64 x, f64 y, f64 radius);
+// NOTE(chogan): The `k` points closest to (x, y) (fewer if the index is
+// smaller), nearest first, and the lower id first on a tie.
+SpatialMatches findNearestPoints(Arena *arena, SpatialIndex *index, f64 x, f64 y, u64 k);
+
+#endif  // PERFAWARE_SPATIAL_H_
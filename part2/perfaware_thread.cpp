@@ -0,0 +1,33 @@
+#include <thread>
+
+#include "perfaware_thread.h"
+
+void runOnThreads(ThreadProc *proc, void *data, size_t stride, u32 count) {
+  assert(count <= kMaxThreads);
+  std::thread threads[kMaxThreads];
+  u8 *at = (u8 *)data;
+
+  for (u32 i = 1; i < count; ++i) {
+    threads[i] = std::thread(proc, at + i * stride);
+  }
+
+  if (count > 0) {
+    proc(at);
+  }
+
+  for (u32 i = 1; i < count; ++i) {
+    threads[i].join();
+  }
+}
+
+u32 getCoreCount() {
+  u32 result = std::thread::hardware_concurrency();
+
+  if (result == 0) {
+    result = 1;
+  } else if (result > kMaxThreads) {
+    result = kMaxThreads;
+  }
+
+  return result;
+}
@@ -0,0 +1,19 @@
+#ifndef PERFAWARE_THREAD_H_
+#define PERFAWARE_THREAD_H_
+
+const u32 kMaxThreads = 256;
+
+typedef void ThreadProc(void *data);
+
+// NOTE(chogan): Calls `proc` once per element of `data` (an array of `count`
+// elements that are `stride` bytes apart), each on its own thread, and waits
+// for all of them. Element 0 runs on the calling thread.
+void runOnThreads(ThreadProc *proc, void *data, size_t stride, u32 count);
+u32 getCoreCount();
+
+template<typename T>
+inline void runOnThreads(void (*proc)(T *), T *data, u32 count) {
+  runOnThreads((ThreadProc *)proc, data, sizeof(T), count);
+}
+
+#endif  // PERFAWARE_THREAD_H_
@@ -92,12 +92,12 @@ static void printTimeElapsed(u64 total_elapsed, ProfileEntry *entry) {
   printf("\n");
 }
 
-static void beginProfile() {
+[[maybe_unused]] static void beginProfile() {
   global_profiler_.cpu_freq = estimateCPUFrequency(100);
   global_profiler_.start = readCpuTimer();
 }
 
-static void endAndPrintProfile() {
+[[maybe_unused]] static void endAndPrintProfile() {
   u64 elapsed = readCpuTimer() - global_profiler_.start;
   f64 ms = elapsed / (f64)global_profiler_.cpu_freq * 1000.0;
   printf("Total time: %fms (CPU freq %llu)\n", ms, global_profiler_.cpu_freq);
@@ -111,11 +111,11 @@ static void endAndPrintProfile() {
 
 #elif defined(PERFAWARE_PROFILE_MAIN)
 
-static void beginProfile() {
+[[maybe_unused]] static void beginProfile() {
   global_profiler_start = readCpuTimer();
 }
 
-static void endAndPrintProfile() {
+[[maybe_unused]] static void endAndPrintProfile() {
   u64 elapsed = readCpuTimer() - global_profiler_start;
   u64 cpu_freq = estimateCPUFrequency(100);
   f64 ms = elapsed / (f64)cpu_freq * 1000.0;
@@ -31,8 +31,10 @@ struct Profiler {
   u64 start;
 };
 
-static Profiler global_profiler_;
-static u32 global_profiler_parent_;
+// NOTE(chogan): Each thread profiles into its own copy, so timed code can be
+// called from worker threads. Only the main thread's entries get printed.
+static thread_local Profiler global_profiler_;
+static thread_local u32 global_profiler_parent_;
 
 static u64 readCpuTimer();
 
@@ -78,6 +80,7 @@ static u64 global_profiler_start;
 
 #define TimeFunction
 #define TimeBlock(...)
+#define TimeBandwidth(...)
 #define TimeBlockHelper(...)
 #define BeginProfile beginProfile()
 #define EndAndPrintProfile endAndPrintProfile()
@@ -85,6 +88,7 @@ static u64 global_profiler_start;
 #else
 #define TimeFunction
 #define TimeBlock(...)
+#define TimeBandwidth(...)
 #define TimeBlockHelper(...)
 #define BeginProfile
 #define EndAndPrintProfile
@@ -4,114 +4,515 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
-#include <random>
 #include <string>
 
 typedef uint8_t u8;
+typedef uint16_t u16;
 typedef uint32_t u32;
 typedef uint64_t u64;
 typedef int32_t s32;
+typedef int64_t s64;
 typedef double f64;
 
 #define ArrayCount(arr) (sizeof(arr) / sizeof((arr)[0]))
 
 #include "perfaware_timer.h"
+#include "perfaware_cpu.h"
 #include "perfaware_haversine.h"
+#include "perfaware_math.h"
+#include "perfaware_thread.h"
 #include "perfaware_memory.h"
+#include "perfaware_file.h"
+#include "perfaware_hash.h"
+#include "perfaware_float_parser.h"
+#include "perfaware_float_format.h"
+#include "perfaware_point_file.h"
+#include "perfaware_answers.h"
+#include "perfaware_distribution.h"
+#include "perfaware_json_writer.h"
 #include "listing_0065_haversine_formula.cpp"
 #include "perfaware_haversine.cpp"
+#include "perfaware_cpu.cpp"
+#include "perfaware_math.cpp"
+#include "perfaware_thread.cpp"
 #include "perfaware_memory.cpp"
+#include "perfaware_file.cpp"
+#include "perfaware_hash.cpp"
+#include "perfaware_float_parser.cpp"
+#include "perfaware_float_format.cpp"
+#include "perfaware_point_file.cpp"
+#include "perfaware_answers.cpp"
+#include "perfaware_distribution.cpp"
+#include "perfaware_json_writer.cpp"
 #include "perfaware_timer.cpp"
 
 struct Arguments {
   u64 seed;
   u64 num_points;
+  bool binary;
+  u32 thread_count;
+  u64 memory_budget;
+  Distribution distribution;
+  PointOrder order;
+  f64 spread;
+  u32 cluster_count;
+  JsonStyle json_style;
 };
 
-Point *generatePoints(Arena *arena, Arguments *args) {
-  Point *points = pushArray<Point>(arena, args->num_points);
+bool parseArguments(int argc, char **argv, Arguments *args) {
+  bool result = true;
+  u32 positional_count = 0;
+  args->thread_count = getCoreCount();
+  args->cluster_count = kDefaultClusterCount;
+  args->spread = -1;
+  args->json_style.indent = kDefaultJsonIndent;
 
-  std::uniform_real_distribution<f64> unifX(-180, 180);
-  std::uniform_real_distribution<f64> unifY(-90, 90);
-  std::default_random_engine re((unsigned int)args->seed);
+  for (int i = 1; i < argc && result; ++i) {
+    const char *arg = argv[i];
 
-  u64 count = args->num_points;
-  u64 offset = 0;
-  while (count--) {
-    points[offset].x0 = unifX(re);
-    points[offset].y0 = unifY(re);
-    points[offset].x1 = unifX(re);
-    points[offset].y1 = unifY(re);
-    offset++;
+    if (strcmp(arg, "--binary") == 0) {
+      args->binary = true;
+    } else if (strcmp(arg, "--threads") == 0 && i + 1 < argc) {
+      args->thread_count = (u32)atoi(argv[++i]);
+    } else if (strcmp(arg, "--memory-mb") == 0 && i + 1 < argc) {
+      args->memory_budget = MEGABYTES((u64)atoll(argv[++i]));
+    } else if (strcmp(arg, "--distribution") == 0 && i + 1 < argc) {
+      if (!parseDistribution(argv[++i], &args->distribution)) {
+        fprintf(stderr, "ERROR: Unknown distribution %s\n", argv[i]);
+        result = false;
+      }
+    } else if (strcmp(arg, "--order") == 0 && i + 1 < argc) {
+      if (!parsePointOrder(argv[++i], &args->order)) {
+        fprintf(stderr, "ERROR: Unknown order %s\n", argv[i]);
+        result = false;
+      }
+    } else if (strcmp(arg, "--spread") == 0 && i + 1 < argc) {
+      char *end = NULL;
+      args->spread = strtod(argv[++i], &end);
+      if (end == argv[i] || *end != '\0' || !(args->spread >= 0 && args->spread <= kMaxSpread)) {
+        fprintf(stderr, "ERROR: --spread must be between 0 and %g degrees\n", kMaxSpread);
+        result = false;
+      }
+    } else if (strcmp(arg, "--clusters") == 0 && i + 1 < argc) {
+      args->cluster_count = (u32)atoi(argv[++i]);
+    } else if (strcmp(arg, "--layout") == 0 && i + 1 < argc) {
+      if (!parseJsonLayout(argv[++i], &args->json_style.layout)) {
+        fprintf(stderr, "ERROR: Unknown layout %s\n", argv[i]);
+        result = false;
+      }
+    } else if (strcmp(arg, "--numbers") == 0 && i + 1 < argc) {
+      if (!parseNumberStyle(argv[++i], &args->json_style.numbers)) {
+        fprintf(stderr, "ERROR: Unknown number style %s\n", argv[i]);
+        result = false;
+      }
+    } else if (strcmp(arg, "--indent") == 0 && i + 1 < argc) {
+      args->json_style.indent = (u32)atoi(argv[++i]);
+    } else if (strcmp(arg, "--shuffle-keys") == 0) {
+      args->json_style.shuffle_keys = true;
+    } else if (strcmp(arg, "--crlf") == 0) {
+      args->json_style.crlf = true;
+    } else if (strcmp(arg, "--whitespace") == 0) {
+      args->json_style.extra_whitespace = true;
+    } else if (arg[0] == '-' && arg[1] == '-') {
+      fprintf(stderr, "ERROR: Unknown option %s\n", arg);
+      result = false;
+    } else if (positional_count == 0) {
+      args->seed = atoll(arg);
+      positional_count++;
+    } else if (positional_count == 1) {
+      args->num_points = atoll(arg);
+      positional_count++;
+    } else {
+      result = false;
+    }
+  }
+
+  if (args->thread_count < 1 || args->thread_count > kMaxThreads) {
+    fprintf(stderr, "ERROR: --threads must be between 1 and %u\n", kMaxThreads);
+    result = false;
+  }
+  if (args->cluster_count < 1 || args->cluster_count > kMaxClusterCount) {
+    fprintf(stderr, "ERROR: --clusters must be between 1 and %u\n", kMaxClusterCount);
+    result = false;
+  }
+  if (args->json_style.indent > kMaxJsonIndent) {
+    fprintf(stderr, "ERROR: --indent can be at most %u\n", kMaxJsonIndent);
+    result = false;
   }
+  if (args->spread < 0) {
+    args->spread = kDefaultSpreads[args->distribution];
+  }
+  result = result && positional_count == 2 && args->num_points > 0;
+  args->json_style.key = mixBits(args->seed + 3);
 
-  return points;
+  return result;
 }
 
-void outputPointsToFile(Point *points, u64 num_points) {
-  std::string filename = "data_" + std::to_string(num_points) + ".json";
+// NOTE(chogan): Each thread generates, computes and formats one block of this
+// many points per round into its own buffers. Once a round's sizes are known
+// every block's file offsets are too, and the threads write their buffers in
+// parallel with positional writes. Nothing else grows with the number of
+// points (besides a few bytes per block), so any amount of data can be
+// generated in a fixed amount of memory.
+//
+// A block is exactly one point file checksum block, so binary output is
+// hashed as it's written.
+const u64 kGeneratorBlockSize = kPointFileChecksumBlockSize;
 
-  FILE *file = fopen(filename.c_str(), "w");
-  if (file) {
-    fprintf(file, "{\"pairs\":[\n");
-    const char *fmt_string = "\t{\"x0\":%.16f, \"y0\":%.16f, \"x1\":%.16f, \"y1\":%.16f}%s";
+struct GeneratorOutput {
+  OutputFile json;
+  OutputFile points;
+  OutputFile answers;
+  OutputFile text_answers;
+  PointFileHeader point_header;
+  u64 *block_hashes;
+  u64 block_count;
+  f64 average;
+};
+
+struct GeneratorWork {
+  Arguments *args;
+  GeneratorOutput *output;
+  PointDistribution *distribution;
+  u64 first;
+  u64 count;
+  // NOTE(chogan): Binary mode only
+  f64 *columns[kPointFileColumnCount];
+  f64 *answers;
+  char *json;
+  char *text_answers;
+  u64 json_size;
+  u64 text_answers_size;
+  u64 json_offset;
+  u64 text_answers_offset;
+  f64 sum;
+  bool write_ok;
+};
 
-    for (u64 i = 0; i < num_points; ++i) {
-      f64 x0 = points[i].x0;
-      f64 y0 = points[i].y0;
-      f64 x1 = points[i].x1;
-      f64 y1 = points[i].y1;
+static u64 getGeneratorThreadMemory(Arguments *args) {
+  u64 per_point = sizeof(f64) + kMaxFormattedF64Size + 1;
+  per_point += (args->binary ? kPointFileColumnCount * sizeof(f64) :
+                getMaxJsonRecordSize(&args->json_style));
+  u64 result = kGeneratorBlockSize * per_point;
 
-      const char *line_spearator = i == num_points - 1 ? "\n" : ",\n";
-      fprintf(file, fmt_string, x0, y0, x1, y1, line_spearator);
+  return result;
+}
+
+static u64 getGeneratorSharedMemory(Arguments *args) {
+  u64 block_count = (args->num_points + kGeneratorBlockSize - 1) / kGeneratorBlockSize;
+  u64 result = block_count * sizeof(f64) + args->cluster_count * sizeof(ClusterCenter) + MEGABYTES(1);
+  if (args->binary) {
+    result += kPointFileColumnCount * block_count * sizeof(u64);
+  }
+
+  return result;
+}
+
+static void generateBlock(GeneratorWork *work) {
+  TimeBandwidth(__func__, work->count * sizeof(Point));
+  Arguments *args = work->args;
+  char *json = work->json;
+  char *text_answers = work->text_answers;
+  f64 sum = 0;
+
+  for (u64 i = 0; i < work->count; ++i) {
+    u64 index = work->first + i;
+    Point point = generatePoint(work->distribution, index);
+    if (!args->binary) {
+      json += formatJsonRecord(json, &args->json_style, &point, index,
+                               index == args->num_points - 1);
     }
 
-    fprintf(file, "]}\n");
-    fclose(file);
+    f64 answer = ReferenceHaversine(point.x0, point.y0, point.x1, point.y1, kEarthRadius);
+    work->answers[i] = answer;
+    sum += answer;
+
+    if (args->binary) {
+      work->columns[0][i] = point.x0;
+      work->columns[1][i] = point.y0;
+      work->columns[2][i] = point.x1;
+      work->columns[3][i] = point.y1;
+    }
+    text_answers += formatF64Fixed16(text_answers, answer);
+    *text_answers++ = '\n';
+  }
+
+  work->sum = sum;
+  work->json_size = json - work->json;
+  work->text_answers_size = text_answers - work->text_answers;
+}
+
+static void writeBlock(GeneratorWork *work) {
+  GeneratorOutput *output = work->output;
+  u64 answers_offset = sizeof(AnswersFileHeader) + work->first * sizeof(f64);
+  bool result = writeFileAt(&output->answers, answers_offset, work->answers,
+                            work->count * sizeof(f64));
+  result = result && writeFileAt(&output->text_answers, work->text_answers_offset,
+                                 work->text_answers, work->text_answers_size);
+
+  if (work->args->binary) {
+    u64 block = work->first / kGeneratorBlockSize;
+    for (u32 i = 0; i < kPointFileColumnCount && result; ++i) {
+      u64 offset = output->point_header.column_offsets[i] + work->first * sizeof(f64);
+      u64 size = work->count * sizeof(f64);
+      output->block_hashes[i * output->block_count + block] = hashBytes(work->columns[i], size);
+      result = writeFileAt(&output->points, offset, work->columns[i], size);
+    }
   } else {
-    fprintf(stderr, "ERROR: Couldn't open file %s\n", filename.c_str());
+    result = result && writeFileAt(&output->json, work->json_offset, work->json,
+                                   work->json_size);
   }
+  work->write_ok = result;
 }
-void outputAnswersToFile(f64 *answers, u64 num_points) {
-  std::string filename = "answers_" + std::to_string(num_points) + ".f64";
 
-  FILE *file = fopen(filename.c_str(), "w");
-  if (file) {
-    u64 count = num_points + 1;
-    u64 offset = 0;
-    while (count--) {
-      fprintf(file, "%.16f\n", answers[offset++]);
+bool openGeneratorOutput(Arguments *args, GeneratorOutput *output) {
+  std::string suffix = std::to_string(args->num_points);
+  std::string answers_filename = "answers_" + suffix + ".f64";
+  // NOTE(chogan): The binary answers_N.f64 is what haversine_processor checks
+  // against. This is the same thing as text, for reading.
+  std::string text_answers_filename = "answers_" + suffix + ".txt";
+  bool result = (openOutputFile(answers_filename.c_str(), &output->answers) &&
+                 openOutputFile(text_answers_filename.c_str(), &output->text_answers));
+
+  if (result && args->binary) {
+    std::string points_filename = "data_" + suffix + ".pts";
+    result = openOutputFile(points_filename.c_str(), &output->points);
+  } else if (result) {
+    std::string json_filename = "data_" + suffix + ".json";
+    result = openOutputFile(json_filename.c_str(), &output->json);
+  }
+
+  return result;
+}
+
+// NOTE(chogan): The point file's header page and the gaps between columns are
+// left as holes, which read back as zeros, but the last column's padding has to
+// be written to get the file size right.
+static bool finishPointFile(GeneratorOutput *output, u64 num_points) {
+  static const u8 zeros[kPointFileAlignment] = {};
+  PointFileHeader *header = &output->point_header;
+  header->checksum = combineBlockHashes(output->block_hashes, num_points);
+
+  u64 columns_end = header->column_offsets[kPointFileColumnCount - 1] + num_points * sizeof(f64);
+  u64 padding = getPointFileSize(num_points) - columns_end;
+  bool result = writeFileAt(&output->points, 0, header, sizeof(*header));
+  result = result && writeFileAt(&output->points, columns_end, zeros, padding);
+
+  return result;
+}
+
+// NOTE(chogan): Produces data_N.json or data_N.pts, answers_N.f64 and
+// answers_N.txt.
+bool generateData(Arena *arena, Arguments *args, GeneratorOutput *output) {
+  TimeBandwidth(__func__, args->num_points * sizeof(Point));
+  u32 thread_count = args->thread_count;
+  u64 num_points = args->num_points;
+  u64 block_count = (num_points + kGeneratorBlockSize - 1) / kGeneratorBlockSize;
+  f64 *block_sums = pushArray<f64>(arena, block_count);
+  PointDistribution distribution = {};
+  initPointDistribution(arena, &distribution, args->distribution, args->order, args->seed,
+                        num_points, args->spread, args->cluster_count);
+
+  if (args->binary) {
+    output->point_header = initPointFileHeader(num_points);
+    output->block_count = block_count;
+    output->block_hashes = pushArray<u64>(arena, kPointFileColumnCount * block_count);
+  }
+  if (thread_count > block_count) {
+    thread_count = (u32)block_count;
+  }
+
+  GeneratorWork work[kMaxThreads] = {};
+  for (u32 i = 0; i < thread_count; ++i) {
+    work[i].args = args;
+    work[i].output = output;
+    work[i].distribution = &distribution;
+    work[i].answers = pushArray<f64>(arena, kGeneratorBlockSize);
+    work[i].text_answers = (char *)pushSize(arena, kGeneratorBlockSize *
+                                            (kMaxFormattedF64Size + 1));
+    if (args->binary) {
+      for (u32 column = 0; column < kPointFileColumnCount; ++column) {
+        work[i].columns[column] = pushArray<f64>(arena, kGeneratorBlockSize);
+      }
+    } else {
+      work[i].json = (char *)pushSize(arena, kGeneratorBlockSize *
+                                      getMaxJsonRecordSize(&args->json_style));
     }
-    fclose(file);
+  }
+
+  char json_header[kMaxJsonHeaderSize];
+  char json_footer[kMaxJsonHeaderSize];
+  u32 json_header_size = formatJsonHeader(json_header, &args->json_style);
+  u32 json_footer_size = formatJsonFooter(json_footer, &args->json_style);
+
+  bool result = true;
+  u64 json_offset = json_header_size;
+  u64 text_answers_offset = 0;
+
+  for (u64 first_block = 0; first_block < block_count && result; first_block += thread_count) {
+    u32 round_threads = (u32)(block_count - first_block < thread_count ? block_count - first_block
+                                                                       : thread_count);
+    for (u32 i = 0; i < round_threads; ++i) {
+      u64 first = (first_block + i) * kGeneratorBlockSize;
+      work[i].first = first;
+      work[i].count = num_points - first < kGeneratorBlockSize ? num_points - first
+                                                               : kGeneratorBlockSize;
+    }
+    runOnThreads(generateBlock, work, round_threads);
+
+    for (u32 i = 0; i < round_threads; ++i) {
+      block_sums[first_block + i] = work[i].sum;
+      work[i].json_offset = json_offset;
+      work[i].text_answers_offset = text_answers_offset;
+      json_offset += work[i].json_size;
+      text_answers_offset += work[i].text_answers_size;
+    }
+    runOnThreads(writeBlock, work, round_threads);
+
+    for (u32 i = 0; i < round_threads; ++i) {
+      result = result && work[i].write_ok;
+    }
+  }
+
+  // NOTE(chogan): Summed per block and then pairwise over the blocks, so the
+  // average doesn't depend on the thread count either
+  f64 average = pairwiseSum(block_sums, block_count) / (f64)num_points;
+  output->average = average;
+  char average_text[kMaxFormattedF64Size + 1];
+  u32 average_size = formatF64Fixed16(average_text, average);
+  average_text[average_size++] = '\n';
+  AnswersFileHeader header = initAnswersFileHeader(num_points);
+  u64 average_offset = sizeof(AnswersFileHeader) + num_points * sizeof(f64);
+
+  result = result && writeFileAt(&output->answers, 0, &header, sizeof(header));
+  result = result && writeFileAt(&output->answers, average_offset, &average, sizeof(average));
+  result = result && writeFileAt(&output->text_answers, text_answers_offset, average_text,
+                                 average_size);
+  if (args->binary) {
+    result = result && finishPointFile(output, num_points);
   } else {
-    fprintf(stderr, "ERROR: Couldn't open file %s\n", filename.c_str());
+    result = result && writeFileAt(&output->json, 0, json_header, json_header_size);
+    result = result && writeFileAt(&output->json, json_offset, json_footer, json_footer_size);
   }
+
+  return result;
 }
 
-int main(int argc, char **argv) {
+bool closeGeneratorOutput(Arguments *args, GeneratorOutput *output) {
+  bool result = closeOutputFile(&output->answers);
+  result = closeOutputFile(&output->text_answers) && result;
+  if (args->binary) {
+    result = closeOutputFile(&output->points) && result;
+  } else {
+    result = closeOutputFile(&output->json) && result;
+  }
+
+  return result;
+}
 
-  const int kNumArgs = 3;
+// NOTE(chogan): manifest_N.json records everything the data depends on, so a
+// dataset can be identified and regenerated. The thread count isn't in it
+// because the output doesn't depend on it.
+bool writeManifest(Arguments *args, GeneratorOutput *output) {
+  std::string suffix = std::to_string(args->num_points);
+  std::string manifest_filename = "manifest_" + suffix + ".json";
+  std::string data_filename = "data_" + suffix + (args->binary ? ".pts" : ".json");
+  bool result = false;
 
-  if (argc == kNumArgs) {
-    BeginProfile;
-    Arena arena = initArenaAndAllocate(MEGABYTES(512));
+  FILE *file = fopen(manifest_filename.c_str(), "w");
+  if (file) {
+    char average_text[kMaxFormattedF64Size + 1];
+    average_text[formatF64Fixed16(average_text, output->average)] = '\0';
+
+    fprintf(file, "{\n");
+    fprintf(file, "\t\"seed\": %llu,\n", (unsigned long long)args->seed);
+    fprintf(file, "\t\"num_points\": %llu,\n", (unsigned long long)args->num_points);
+    fprintf(file, "\t\"distribution\": \"%s\",\n", kDistributionNames[args->distribution]);
+    fprintf(file, "\t\"order\": \"%s\",\n", kPointOrderNames[args->order]);
+    fprintf(file, "\t\"spread\": %.17g,\n", args->spread);
+    if (args->distribution == Distribution_Clustered) {
+      fprintf(file, "\t\"clusters\": %u,\n", args->cluster_count);
+    }
+    fprintf(file, "\t\"format\": \"%s\",\n", args->binary ? "pts" : "json");
+    if (!args->binary) {
+      JsonStyle *style = &args->json_style;
+      fprintf(file, "\t\"layout\": \"%s\",\n", kJsonLayoutNames[style->layout]);
+      if (style->layout == JsonLayout_Pretty) {
+        fprintf(file, "\t\"indent\": %u,\n", style->indent);
+      }
+      fprintf(file, "\t\"numbers\": \"%s\",\n", kNumberStyleNames[style->numbers]);
+      fprintf(file, "\t\"shuffle_keys\": %s,\n", style->shuffle_keys ? "true" : "false");
+      fprintf(file, "\t\"crlf\": %s,\n", style->crlf ? "true" : "false");
+      fprintf(file, "\t\"whitespace\": %s,\n", style->extra_whitespace ? "true" : "false");
+    }
+    fprintf(file, "\t\"data\": \"%s\",\n", data_filename.c_str());
+    fprintf(file, "\t\"answers\": \"answers_%s.f64\",\n", suffix.c_str());
+    fprintf(file, "\t\"text_answers\": \"answers_%s.txt\",\n", suffix.c_str());
+    fprintf(file, "\t\"average\": %s\n", average_text);
+    fprintf(file, "}\n");
+    result = ferror(file) == 0;
+    result = fclose(file) == 0 && result;
+  }
 
-    Arguments args = {};
-    args.seed = atoll(argv[1]);
-    args.num_points = atoll(argv[2]);
+  return result;
+}
 
-    Point *points = generatePoints(&arena, &args);
-    f64 *answers = calculateHaversine(&arena, points, args.num_points);
+// NOTE(chogan): Fewer threads means fewer block buffers, so a memory budget
+// is met by giving up threads.
+bool fitMemoryBudget(Arguments *args) {
+  bool result = true;
 
-    outputPointsToFile(points, args.num_points);
-    outputAnswersToFile(answers, args.num_points);
+  if (args->memory_budget) {
+    u64 shared = getGeneratorSharedMemory(args);
+    u64 per_thread = getGeneratorThreadMemory(args);
+    u64 max_threads = args->memory_budget > shared ? (args->memory_budget - shared) / per_thread : 0;
+
+    if (max_threads == 0) {
+      fprintf(stderr, "ERROR: Generating %llu points needs at least %llumb\n",
+              (unsigned long long)args->num_points,
+              (unsigned long long)((shared + per_thread + MEGABYTES(1) - 1) / MEGABYTES(1)));
+      result = false;
+    } else if (max_threads < args->thread_count) {
+      args->thread_count = (u32)max_threads;
+    }
+  }
+
+  return result;
+}
+
+int main(int argc, char **argv) {
+
+  Arguments args = {};
+
+  if (parseArguments(argc, argv, &args) && fitMemoryBudget(&args)) {
+    BeginProfile;
+    u64 arena_size = (args.thread_count * getGeneratorThreadMemory(&args) +
+                      getGeneratorSharedMemory(&args));
+    Arena arena = initArenaAndAllocate(arena_size);
+
+    GeneratorOutput output = {};
+    bool result = openGeneratorOutput(&args, &output);
+    result = result && generateData(&arena, &args, &output);
+    result = closeGeneratorOutput(&args, &output) && result;
+    result = result && writeManifest(&args, &output);
 
     destroyArena(&arena);
 
     EndAndPrintProfile;
+
+    if (!result) {
+      fprintf(stderr, "ERROR: Failed writing the output\n");
+      return 1;
+    }
   } else {
-    fprintf(stdout, "USAGE: %s <seed> <num_points>\n", argv[0]);
+    fprintf(stdout, "USAGE: %s [--binary] [--threads N] [--memory-mb N] "
+            "[--distribution uniform|clustered|antipodal|tiny] [--order shuffled|sorted] "
+            "[--spread degrees] [--clusters N] [--layout lines|minified|pretty] [--indent N] "
+            "[--numbers fixed16|variable|exponent|mixed] [--shuffle-keys] [--crlf] "
+            "[--whitespace] <seed> <num_points>\n",
+            argv[0]);
   }
 
   return 0;
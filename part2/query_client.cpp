@@ -0,0 +1,560 @@
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef double f64;
+
+#define ArrayCount(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+#include "perfaware_timer.h"
+#include "perfaware_memory.h"
+#include "perfaware_haversine.h"
+#include "perfaware_thread.h"
+#include "perfaware_distance.h"
+#include "perfaware_spatial.h"
+#include "perfaware_distribution.h"
+#include "perfaware_query.h"
+
+#include "perfaware_memory.cpp"
+#include "perfaware_thread.cpp"
+#include "perfaware_distribution.cpp"
+#include "perfaware_timer.cpp"
+#include "perfaware_query.cpp"
+
+// NOTE(chogan): Client for query_server. Either sends one query and prints
+// the reply, or with `load` keeps --connections connections busy for
+// --seconds, each sending its next query as soon as the last reply is in,
+// and reports the queries per second and the latency percentiles per op.
+//
+// Latencies go in a log histogram with kLatencySubBuckets buckets per power of
+// two of cycles, so percentiles are within about 6% and cost nothing to keep.
+// They're reported as each bucket's upper end.
+
+const u32 kDefaultConnections = 4;
+const u32 kDefaultLoadSeconds = 5;
+const u64 kDefaultRange = 64;
+const f64 kDefaultRadius = 100.0;
+const u64 kDefaultNearest = 8;
+const u32 kLatencySubBuckets = 16;
+const u32 kLatencyBuckets = 64 * kLatencySubBuckets;
+
+struct Arguments {
+  const char *socket_path;
+  bool load;
+  QueryRequest request;
+  u32 connection_count;
+  u32 seconds;
+  bool ops[QueryOp_Count];
+  u64 range;
+  f64 radius;
+  u64 nearest;
+  u64 seed;
+};
+
+struct LoadDataset {
+  u64 num_points;
+};
+
+struct LatencyHistogram {
+  u64 buckets[kLatencyBuckets];
+  u64 count;
+  u64 max;
+};
+
+struct LoadWork {
+  Arguments *args;
+  LoadDataset *datasets;
+  u32 dataset_count;
+  QueryOp ops[QueryOp_Count];
+  u32 op_count;
+  u32 index;
+  u64 end_time;
+  Arena scratch;
+  LatencyHistogram latencies[QueryOp_Count];
+  u64 error_count;
+  QueryStatus last_error;
+  bool failed;
+};
+
+static bool parseU64(const char *text, u64 *value) {
+  char *end = NULL;
+  *value = strtoull(text, &end, 10);
+  bool result = end != text && *end == 0;
+
+  return result;
+}
+
+static bool parseF64(const char *text, f64 *value) {
+  char *end = NULL;
+  *value = strtod(text, &end);
+  bool result = end != text && *end == 0;
+
+  return result;
+}
+
+// NOTE(chogan): The positional arguments after a one shot op, in the order the
+// usage lists them
+static bool parseRequestArguments(QueryOp op, char **values, int count, QueryRequest *request) {
+  u64 dataset = 0;
+  bool result = true;
+  request->op = op;
+
+  switch (op) {
+    case QueryOp_Info: {
+      result = count == 1 && parseU64(values[0], &dataset);
+      break;
+    }
+    case QueryOp_Sum:
+    case QueryOp_Answers:
+    case QueryOp_Pairs: {
+      result = (count == 3 && parseU64(values[0], &dataset) &&
+                parseU64(values[1], &request->first) && parseU64(values[2], &request->count));
+      break;
+    }
+    case QueryOp_Within: {
+      request->count = kMaxQueryItems;
+      result = ((count == 4 || count == 5) && parseU64(values[0], &dataset) &&
+                parseF64(values[1], &request->x) && parseF64(values[2], &request->y) &&
+                parseF64(values[3], &request->radius) &&
+                (count == 4 || parseU64(values[4], &request->count)));
+      break;
+    }
+    case QueryOp_Nearest: {
+      result = (count == 4 && parseU64(values[0], &dataset) && parseF64(values[1], &request->x) &&
+                parseF64(values[2], &request->y) && parseU64(values[3], &request->count));
+      break;
+    }
+    case QueryOp_Shutdown: {
+      result = count == 0;
+      break;
+    }
+    default: {
+      result = false;
+      break;
+    }
+  }
+  request->dataset = (u32)dataset;
+
+  return result;
+}
+
+bool parseArguments(int argc, char **argv, Arguments *args) {
+  bool result = true;
+  bool op_given = false;
+  args->socket_path = kDefaultQuerySocketPath;
+  args->connection_count = kDefaultConnections;
+  args->seconds = kDefaultLoadSeconds;
+  args->range = kDefaultRange;
+  args->radius = kDefaultRadius;
+  args->nearest = kDefaultNearest;
+  args->seed = 1234;
+
+  int i = 1;
+  for (; i < argc && result; ++i) {
+    const char *arg = argv[i];
+
+    if (strcmp(arg, "--socket") == 0 && i + 1 < argc) {
+      args->socket_path = argv[++i];
+    } else if (strcmp(arg, "--connections") == 0 && i + 1 < argc) {
+      args->connection_count = (u32)atoi(argv[++i]);
+    } else if (strcmp(arg, "--seconds") == 0 && i + 1 < argc) {
+      args->seconds = (u32)atoi(argv[++i]);
+    } else if (strcmp(arg, "--query") == 0 && i + 1 < argc) {
+      QueryOp op = QueryOp_Count;
+      if (parseQueryOp(argv[++i], &op) && op != QueryOp_Shutdown) {
+        args->ops[op] = true;
+        op_given = true;
+      } else {
+        fprintf(stderr, "ERROR: Can't load test %s\n", argv[i]);
+        result = false;
+      }
+    } else if (strcmp(arg, "--range") == 0 && i + 1 < argc) {
+      args->range = (u64)atoll(argv[++i]);
+    } else if (strcmp(arg, "--radius") == 0 && i + 1 < argc) {
+      args->radius = atof(argv[++i]);
+    } else if (strcmp(arg, "--k") == 0 && i + 1 < argc) {
+      args->nearest = (u64)atoll(argv[++i]);
+    } else if (strcmp(arg, "--seed") == 0 && i + 1 < argc) {
+      args->seed = (u64)atoll(argv[++i]);
+    } else if (arg[0] == '-' && arg[1] == '-') {
+      fprintf(stderr, "ERROR: Unknown option %s\n", arg);
+      result = false;
+    } else {
+      break;
+    }
+  }
+
+  if (result && i < argc) {
+    QueryOp op = QueryOp_Count;
+    if (strcmp(argv[i], "load") == 0) {
+      args->load = true;
+      result = i + 1 == argc;
+    } else if (parseQueryOp(argv[i], &op)) {
+      result = parseRequestArguments(op, argv + i + 1, argc - i - 1, &args->request);
+    } else {
+      fprintf(stderr, "ERROR: Unknown query %s\n", argv[i]);
+      result = false;
+    }
+  } else {
+    result = false;
+  }
+
+  // NOTE(chogan): The range queries work on any server, the spatial ones need
+  // --index
+  if (!op_given) {
+    args->ops[QueryOp_Sum] = true;
+    args->ops[QueryOp_Answers] = true;
+    args->ops[QueryOp_Pairs] = true;
+  }
+  if (args->connection_count < 1 || args->connection_count > kMaxThreads) {
+    fprintf(stderr, "ERROR: --connections must be between 1 and %u\n", kMaxThreads);
+    result = false;
+  }
+  if (args->seconds < 1) {
+    fprintf(stderr, "ERROR: --seconds must be at least 1\n");
+    result = false;
+  }
+  if (args->range < 1 || args->range > kMaxQueryItems || args->nearest < 1 ||
+      args->nearest > kMaxQueryItems) {
+    fprintf(stderr, "ERROR: --range and --k must be between 1 and %llu\n",
+            (unsigned long long)kMaxQueryItems);
+    result = false;
+  }
+
+  return result;
+}
+
+static void printQueryResult(QueryRequest *request, QueryResponse *response, void *items) {
+  switch (request->op) {
+    case QueryOp_Info: {
+      printf("Dataset %u: %llu pairs, average %.16f\n", request->dataset,
+             (unsigned long long)response->total, response->value);
+      break;
+    }
+    case QueryOp_Sum: {
+      printf("Sum %.16f, average %.16f over %llu pairs\n", response->value,
+             response->total ? response->value / (f64)response->total : 0.0,
+             (unsigned long long)response->total);
+      break;
+    }
+    case QueryOp_Answers: {
+      f64 *answers = (f64 *)items;
+      for (u64 i = 0; i < response->count; ++i) {
+        printf("%llu %.16f\n", (unsigned long long)(request->first + i), answers[i]);
+      }
+      break;
+    }
+    case QueryOp_Pairs: {
+      Point *pairs = (Point *)items;
+      for (u64 i = 0; i < response->count; ++i) {
+        printf("%llu %.16f %.16f %.16f %.16f\n", (unsigned long long)(request->first + i),
+               pairs[i].x0, pairs[i].y0, pairs[i].x1, pairs[i].y1);
+      }
+      break;
+    }
+    case QueryOp_Within:
+    case QueryOp_Nearest: {
+      SpatialMatch *matches = (SpatialMatch *)items;
+      for (u64 i = 0; i < response->count; ++i) {
+        printf("%llu %.16f\n", (unsigned long long)matches[i].id, matches[i].distance);
+      }
+      if (request->op == QueryOp_Within) {
+        printf("%llu of %llu matches\n", (unsigned long long)response->count,
+               (unsigned long long)response->total);
+      }
+      break;
+    }
+    case QueryOp_Shutdown: {
+      printf("Server is stopping\n");
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+}
+
+bool runOneQuery(Arena *arena, Arguments *args) {
+  QuerySocket connection = {};
+  bool result = connectQuerySocket(args->socket_path, &connection);
+
+  if (result) {
+    QueryResponse response = {};
+    void *items = NULL;
+    result = runQuery(&connection, &args->request, arena, &response, &items);
+
+    if (!result) {
+      fprintf(stderr, "ERROR: Lost the connection to the server\n");
+    } else if (response.status != QueryStatus_Ok) {
+      fprintf(stderr, "ERROR: %s\n", response.status < QueryStatus_Count ?
+              kQueryStatusNames[response.status] : "unknown status");
+      result = false;
+    } else {
+      printQueryResult(&args->request, &response, items);
+    }
+    closeQuerySocket(&connection);
+  }
+
+  return result;
+}
+
+static u32 getLatencyBucket(u64 cycles) {
+  u32 shift = 0;
+  while ((cycles >> shift) >= 2 * kLatencySubBuckets) {
+    shift++;
+  }
+  u32 result = shift * kLatencySubBuckets + (u32)(cycles >> shift);
+
+  return result;
+}
+
+static u64 getLatencyBucketLimit(u32 bucket) {
+  u32 shift = 0;
+  if (bucket >= 2 * kLatencySubBuckets) {
+    shift = bucket / kLatencySubBuckets - 1;
+  }
+  u64 result = (((u64)(bucket - shift * kLatencySubBuckets) + 1) << shift) - 1;
+
+  return result;
+}
+
+static void addLatency(LatencyHistogram *histogram, u64 cycles) {
+  histogram->buckets[getLatencyBucket(cycles)]++;
+  histogram->count++;
+  histogram->max = cycles > histogram->max ? cycles : histogram->max;
+}
+
+static void mergeLatencies(LatencyHistogram *dest, LatencyHistogram *source) {
+  for (u32 i = 0; i < kLatencyBuckets; ++i) {
+    dest->buckets[i] += source->buckets[i];
+  }
+  dest->count += source->count;
+  dest->max = source->max > dest->max ? source->max : dest->max;
+}
+
+static u64 getLatencyPercentile(LatencyHistogram *histogram, f64 percentile) {
+  u64 rank = (u64)ceil(percentile / 100.0 * (f64)histogram->count);
+  u64 seen = 0;
+  u64 result = 0;
+
+  for (u32 i = 0; i < kLatencyBuckets; ++i) {
+    seen += histogram->buckets[i];
+    if (seen >= rank && histogram->buckets[i]) {
+      result = getLatencyBucketLimit(i);
+      break;
+    }
+  }
+  result = result < histogram->max ? result : histogram->max;
+
+  return result;
+}
+
+// NOTE(chogan): A random query of one of the ops being tested. Ranges are the
+// same size everywhere in the dataset, and the spatial queries are centered
+// anywhere on the globe.
+static void makeLoadRequest(LoadWork *work, u64 counter, QueryRequest *request) {
+  Arguments *args = work->args;
+  u64 key = mixBits(args->seed + work->index);
+  f64 u0 = randomUnit(key, 4 * counter + 0);
+  f64 u1 = randomUnit(key, 4 * counter + 1);
+  f64 u2 = randomUnit(key, 4 * counter + 2);
+  f64 u3 = randomUnit(key, 4 * counter + 3);
+
+  *request = {};
+  request->op = work->ops[(u32)(u0 * work->op_count)];
+  request->dataset = (u32)(u1 * work->dataset_count);
+  u64 num_points = work->datasets[request->dataset].num_points;
+
+  switch (request->op) {
+    case QueryOp_Sum:
+    case QueryOp_Answers:
+    case QueryOp_Pairs: {
+      request->count = args->range < num_points ? args->range : num_points;
+      request->first = (u64)(u2 * (f64)(num_points - request->count + 1));
+      request->first = request->first + request->count > num_points ? 0 : request->first;
+      break;
+    }
+    case QueryOp_Within:
+    case QueryOp_Nearest: {
+      request->x = -180.0 + 360.0 * u2;
+      request->y = -90.0 + 180.0 * u3;
+      request->radius = args->radius;
+      request->count = request->op == QueryOp_Within ? args->range : args->nearest;
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+}
+
+static void runLoad(LoadWork *work) {
+  QuerySocket connection = {};
+  work->failed = !connectQuerySocket(work->args->socket_path, &connection);
+
+  for (u64 counter = 0; !work->failed && readCpuTimer() < work->end_time; ++counter) {
+    ScopedTemporaryMemory scratch_memory(&work->scratch);
+    QueryRequest request = {};
+    makeLoadRequest(work, counter, &request);
+    QueryResponse response = {};
+    void *items = NULL;
+
+    u64 start = readCpuTimer();
+    work->failed = !runQuery(&connection, &request, scratch_memory, &response, &items);
+    u64 end = readCpuTimer();
+
+    if (!work->failed) {
+      addLatency(work->latencies + request.op, end - start);
+      if (response.status != QueryStatus_Ok) {
+        work->error_count++;
+        work->last_error = (QueryStatus)response.status;
+      }
+    }
+  }
+  closeQuerySocket(&connection);
+}
+
+static void printLatencyRow(const char *name, LatencyHistogram *histogram, u64 cpu_freq) {
+  f64 microseconds = 1000000.0 / (f64)cpu_freq;
+  printf("%-10s %10llu %9.2f %9.2f %9.2f %9.2f %9.2f\n", name,
+         (unsigned long long)histogram->count,
+         getLatencyPercentile(histogram, 50.0) * microseconds,
+         getLatencyPercentile(histogram, 90.0) * microseconds,
+         getLatencyPercentile(histogram, 99.0) * microseconds,
+         getLatencyPercentile(histogram, 99.9) * microseconds,
+         histogram->max * microseconds);
+}
+
+bool runLoadTest(Arena *arena, Arguments *args) {
+  // NOTE(chogan): Asks for info on datasets 0, 1, ... until the server says
+  // there are no more, so ranges can be picked inside each of them
+  QuerySocket connection = {};
+  bool result = connectQuerySocket(args->socket_path, &connection);
+  LoadDataset *datasets = pushClearedArray<LoadDataset>(arena, kMaxQueryDatasets);
+  u32 dataset_count = 0;
+
+  while (result && dataset_count < kMaxQueryDatasets) {
+    QueryRequest request = {};
+    request.op = QueryOp_Info;
+    request.dataset = dataset_count;
+    QueryResponse response = {};
+    void *items = NULL;
+    result = runQuery(&connection, &request, arena, &response, &items);
+    if (!result || response.status != QueryStatus_Ok) {
+      break;
+    }
+    datasets[dataset_count++].num_points = response.total;
+  }
+  closeQuerySocket(&connection);
+
+  if (result && dataset_count == 0) {
+    fprintf(stderr, "ERROR: The server has no datasets\n");
+    result = false;
+  }
+
+  if (result) {
+    u64 cpu_freq = estimateCPUFrequency();
+    u32 connection_count = args->connection_count;
+    u64 scratch_size = sizeof(QueryResponse) + kMaxQueryItems * sizeof(Point);
+    LoadWork *work = pushClearedArray<LoadWork>(arena, connection_count);
+
+    printf("Load: %u connections for %us, %u datasets, queries:", connection_count,
+           args->seconds, dataset_count);
+    u64 start = readCpuTimer();
+    for (u32 i = 0; i < connection_count; ++i) {
+      work[i].args = args;
+      work[i].datasets = datasets;
+      work[i].dataset_count = dataset_count;
+      for (u32 op = 0; op < QueryOp_Count; ++op) {
+        if (args->ops[op]) {
+          work[i].ops[work[i].op_count++] = (QueryOp)op;
+        }
+      }
+      work[i].index = i;
+      work[i].end_time = start + args->seconds * cpu_freq;
+      work[i].scratch = subArena(arena, scratch_size);
+    }
+    for (u32 i = 0; i < work[0].op_count; ++i) {
+      printf(" %s", kQueryOpNames[work[0].ops[i]]);
+    }
+    printf("\n");
+    fflush(stdout);
+
+    runOnThreads(runLoad, work, connection_count);
+    f64 seconds = (f64)(readCpuTimer() - start) / (f64)cpu_freq;
+
+    LatencyHistogram *totals = pushClearedArray<LatencyHistogram>(arena, QueryOp_Count + 1);
+    LatencyHistogram *all = totals + QueryOp_Count;
+    u64 error_count = 0;
+    for (u32 i = 0; i < connection_count; ++i) {
+      for (u32 op = 0; op < QueryOp_Count; ++op) {
+        mergeLatencies(totals + op, work[i].latencies + op);
+        mergeLatencies(all, work[i].latencies + op);
+      }
+      error_count += work[i].error_count;
+      if (work[i].error_count) {
+        fprintf(stderr, "ERROR: Connection %u got %llu errors, the last %s\n", i,
+                (unsigned long long)work[i].error_count, kQueryStatusNames[work[i].last_error]);
+      }
+      if (work[i].failed) {
+        fprintf(stderr, "ERROR: Connection %u lost the server\n", i);
+        result = false;
+      }
+    }
+
+    printf("\n%-10s %10s %9s %9s %9s %9s %9s\n", "latency", "queries", "p50 us", "p90 us",
+           "p99 us", "p99.9 us", "max us");
+    for (u32 op = 0; op < QueryOp_Count; ++op) {
+      if (totals[op].count) {
+        printLatencyRow(kQueryOpNames[op], totals + op, cpu_freq);
+      }
+    }
+    printLatencyRow("all", all, cpu_freq);
+    printf("\n%llu queries in %.2fs, %.0f queries/s, %llu errors\n",
+           (unsigned long long)all->count, seconds, (f64)all->count / seconds,
+           (unsigned long long)error_count);
+    result = result && error_count == 0;
+  }
+
+  return result;
+}
+
+int main(int argc, char **argv) {
+  Arguments args = {};
+
+  if (parseArguments(argc, argv, &args)) {
+    Arena arena = initArenaAndAllocate(args.connection_count * MEGABYTES(4) + MEGABYTES(16));
+    bool result = args.load ? runLoadTest(&arena, &args) : runOneQuery(&arena, &args);
+    destroyArena(&arena);
+
+    if (!result) {
+      exit(1);
+    }
+  } else {
+    fprintf(stderr, "USAGE: %s [--socket path] <query>\n"
+            "  info <dataset>\n"
+            "  sum|answers|pairs <dataset> <first> <count>\n"
+            "  within <dataset> <x> <y> <radius_km> [max_matches]\n"
+            "  nearest <dataset> <x> <y> <k>\n"
+            "  shutdown\n"
+            "  [--connections N] [--seconds N] [--query sum|answers|pairs|within|nearest]... "
+            "[--range N] [--radius km] [--k N] [--seed N] load\n",
+            argv[0]);
+  }
+
+  return 0;
+}
+
+ProfilerEndOfCompilationUnit;
@@ -0,0 +1,596 @@
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef double f64;
+
+#define ArrayCount(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+#include "perfaware_timer.h"
+#include "perfaware_memory.h"
+#include "perfaware_haversine.h"
+#include "perfaware_math.h"
+#include "perfaware_cpu.h"
+#include "perfaware_float_parser.h"
+#include "perfaware_thread.h"
+#include "perfaware_file.h"
+#include "perfaware_hash.h"
+#include "perfaware_point_file.h"
+#include "perfaware_json_parser.h"
+#include "perfaware_json_cursor.h"
+#include "perfaware_json_schema.h"
+#include "perfaware_distance.h"
+#include "perfaware_spatial.h"
+#include "perfaware_query.h"
+
+#include "listing_0065_haversine_formula.cpp"
+#include "perfaware_haversine.cpp"
+#include "perfaware_memory.cpp"
+#include "perfaware_cpu.cpp"
+#include "perfaware_math.cpp"
+#include "perfaware_float_parser.cpp"
+#include "perfaware_thread.cpp"
+#include "perfaware_file.cpp"
+#include "perfaware_hash.cpp"
+#include "perfaware_point_file.cpp"
+#include "perfaware_json_parser.cpp"
+#include "perfaware_json_cursor.cpp"
+#include "perfaware_timer.cpp"
+#include "perfaware_distance.cpp"
+#include "perfaware_spatial.cpp"
+#include "perfaware_query.cpp"
+
+// NOTE(chogan): Loads datasets (JSON or point files) once, computes every
+// pair's answer, and then answers queries about them over a Unix domain socket
+// (see perfaware_query.h) until it gets a shutdown request or SIGINT/SIGTERM.
+//
+// Point files are mapped by default, so only the answers and the index take
+// memory of their own. Range sums come from per block prefix sums over the
+// same kHaversineBlockSize blocks calculateHaversine uses, plus the partial
+// blocks at either end summed directly, so no query reads more than two blocks
+// of answers. With --index, each dataset also gets a SpatialIndex for within
+// and nearest queries.
+//
+// Every thread accepts connections and polls all of the ones it has, serving
+// one request at a time from whichever have one waiting. So a client that
+// sits on an open connection doesn't hold up anyone else, and there can be
+// more clients than --threads.
+
+const u64 kQueryArenaSlack = MEGABYTES(16);
+// NOTE(chogan): Per thread. A thread with this many clients stops accepting
+// and leaves new ones to the other threads.
+const u32 kMaxWorkerConnections = 64;
+static_assert(kMaxWorkerConnections + 2 <= kMaxQueryWaitCount, "See serveQueries");
+
+struct Arguments {
+  const char *socket_path;
+  const char *dataset_paths[kMaxQueryDatasets];
+  u32 dataset_count;
+  u32 thread_count;
+  FileReadOptions read_options;
+  bool read_backend_given;
+  bool verify_checksum;
+  HaversineKernel kernel;
+  bool index;
+  SpatialEndpoint endpoint;
+};
+
+struct QueryDataset {
+  const char *path;
+  PointFile point_file;
+  PointColumns points;
+  // NOTE(chogan): num_points + 1, with the average last
+  f64 *answers;
+  // NOTE(chogan): block_prefix[b] is the sum of blocks [0, b)
+  f64 *block_prefix;
+  SpatialIndex index;
+  bool has_index;
+};
+
+struct QueryServer {
+  QuerySocket listener;
+  // NOTE(chogan): Every thread waits on the receiver, and stopQueryServer
+  // shuts down the sender to wake them all
+  QuerySocket wake_receiver;
+  QuerySocket wake_sender;
+  QueryDataset datasets[kMaxQueryDatasets];
+  u32 dataset_count;
+  bool stopping;
+};
+
+struct QueryWorker {
+  QueryServer *server;
+  Arena scratch;
+  u64 query_count;
+};
+
+// NOTE(chogan): For the signal handler
+static QueryServer *global_query_server;
+
+bool parseArguments(int argc, char **argv, Arguments *args) {
+  bool result = true;
+  bool kernel_given = false;
+  bool isa_given = false;
+  CpuIsa isa = CpuIsa_Scalar;
+  args->socket_path = kDefaultQuerySocketPath;
+  args->thread_count = getCoreCount();
+  args->read_options = defaultFileReadOptions();
+
+  for (int i = 1; i < argc && result; ++i) {
+    const char *arg = argv[i];
+
+    if (strcmp(arg, "--socket") == 0 && i + 1 < argc) {
+      args->socket_path = argv[++i];
+    } else if (strcmp(arg, "--threads") == 0 && i + 1 < argc) {
+      args->thread_count = (u32)atoi(argv[++i]);
+    } else if (strcmp(arg, "--read") == 0 && i + 1 < argc) {
+      if (!parseFileBackend(argv[++i], &args->read_options.backend)) {
+        fprintf(stderr, "ERROR: Unknown read backend %s\n", argv[i]);
+        result = false;
+      }
+      args->read_backend_given = true;
+    } else if (strcmp(arg, "--verify-checksum") == 0) {
+      args->verify_checksum = true;
+    } else if (strcmp(arg, "--kernel") == 0 && i + 1 < argc) {
+      if (!parseHaversineKernel(argv[++i], &args->kernel)) {
+        fprintf(stderr, "ERROR: Unknown haversine kernel %s\n", argv[i]);
+        result = false;
+      }
+      kernel_given = true;
+    } else if (strcmp(arg, "--isa") == 0 && i + 1 < argc) {
+      if (!parseCpuIsa(argv[++i], &isa)) {
+        fprintf(stderr, "ERROR: Unknown instruction set %s\n", argv[i]);
+        result = false;
+      }
+      isa_given = true;
+    } else if (strcmp(arg, "--index") == 0 && i + 1 < argc) {
+      if (!parseSpatialEndpoint(argv[++i], &args->endpoint)) {
+        fprintf(stderr, "ERROR: Unknown endpoint %s\n", argv[i]);
+        result = false;
+      }
+      args->index = true;
+    } else if (arg[0] == '-' && arg[1] == '-') {
+      fprintf(stderr, "ERROR: Unknown option %s\n", arg);
+      result = false;
+    } else if (args->dataset_count < kMaxQueryDatasets) {
+      args->dataset_paths[args->dataset_count++] = arg;
+    } else {
+      fprintf(stderr, "ERROR: At most %u datasets\n", kMaxQueryDatasets);
+      result = false;
+    }
+  }
+
+  if (isa_given && !forceCpuIsa(isa)) {
+    fprintf(stderr, "ERROR: This CPU doesn't have %s\n", kCpuIsaNames[isa]);
+    result = false;
+  }
+  // NOTE(chogan): The default kernel follows --isa
+  if (!kernel_given) {
+    args->kernel = getBestHaversineKernel();
+  } else if (!isHaversineKernelSupported(args->kernel)) {
+    fprintf(stderr, "ERROR: Can't run the %s kernel on %s\n", kHaversineKernelNames[args->kernel],
+            kCpuIsaNames[getCpuIsa()]);
+    result = false;
+  }
+  if (args->thread_count < 1 || args->thread_count > kMaxThreads) {
+    fprintf(stderr, "ERROR: --threads must be between 1 and %u\n", kMaxThreads);
+    result = false;
+  }
+  result = result && args->dataset_count > 0;
+
+  return result;
+}
+
+static u64 getMaxDatasetPoints(const char *path) {
+  u64 result = 0;
+
+  if (isPointFile(path)) {
+    PointFileHeader header = {};
+    readPointFileHeader(path, &header);
+    result = header.num_points;
+  } else {
+    result = getMaxRecordCount(getFileSizeOrZero(path));
+  }
+
+  return result;
+}
+
+static u64 getIndexedCount(Arguments *args, u64 num_points) {
+  u64 result = 0;
+  if (args->index) {
+    result = (args->endpoint == SpatialEndpoint_Both ? 2 : 1) * num_points;
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Upper bounds from the file sizes, like haversine_processor's
+// planInMemoryRun. `arena` holds what's kept for every dataset, `scratch` what
+// loading the biggest one needs.
+static void planQueryServer(Arguments *args, u64 *arena_size, u64 *scratch_size,
+                            u64 *worker_scratch_size) {
+  u64 max_indexed = 0;
+  *arena_size = kQueryArenaSlack;
+  *scratch_size = 0;
+
+  for (u32 i = 0; i < args->dataset_count; ++i) {
+    const char *path = args->dataset_paths[i];
+    u64 file_size = getFileSizeOrZero(path);
+    u64 max_points = getMaxDatasetPoints(path);
+    u64 load_size = 0;
+
+    if (isPointFile(path)) {
+      FileReadOptions options = getInPlaceReadOptions(&args->read_options,
+                                                      args->read_backend_given);
+      if (options.backend != FileBackend_Mmap) {
+        *arena_size += file_size + 2 * kDirectAlignment;
+      }
+      if (args->verify_checksum) {
+        load_size += kPointFileColumnCount * getChecksumBlockCount(max_points) * sizeof(u64);
+      }
+    } else {
+      load_size += (file_size + 2 * kDirectAlignment + getMaxTokenBytes(file_size) +
+                    max_points * sizeof(Point));
+      // NOTE(chogan): The parsed points and their columns
+      *arena_size += 2 * max_points * sizeof(Point);
+    }
+
+    u64 block_count = max_points / kHaversineBlockSize + 2;
+    *arena_size += (max_points + 1) * sizeof(f64) + 2 * block_count * sizeof(f64);
+
+    u64 indexed = getIndexedCount(args, max_points);
+    if (indexed) {
+      *arena_size += (indexed * (3 + 5) * sizeof(f64) +
+                      (indexed / kSpatialPointsPerCell + 2) * sizeof(u64));
+      load_size += getSpatialBuildScratchSize(indexed, args->thread_count);
+    }
+    max_indexed = indexed > max_indexed ? indexed : max_indexed;
+    *scratch_size = load_size > *scratch_size ? load_size : *scratch_size;
+  }
+  *scratch_size += kQueryArenaSlack + args->thread_count * MEGABYTES(1);
+
+  // NOTE(chogan): A within query's matches hold every candidate looked at
+  u64 max_items = kMaxQueryItems * sizeof(Point);
+  u64 max_matches = max_indexed * sizeof(SpatialMatch);
+  *worker_scratch_size = (sizeof(QueryResponse) + (max_matches > max_items ? max_matches : max_items) +
+                          MEGABYTES(1));
+}
+
+bool loadQueryDataset(Arena *arena, Arena *scratch, Arguments *args, const char *path,
+                      QueryDataset *dataset) {
+  TimeFunction;
+  bool result = false;
+  dataset->path = path;
+
+  if (isPointFile(path)) {
+    FileReadOptions options = getInPlaceReadOptions(&args->read_options, args->read_backend_given);
+    result = openPointFile(arena, path, &options, args->verify_checksum, &dataset->point_file);
+    dataset->points = dataset->point_file.points;
+  } else {
+    PointArray points = parseJsonFile(arena, scratch, path, &args->read_options,
+                                      args->thread_count);
+    dataset->points = toPointColumns(arena, &points);
+    result = points.num_points > 0;
+    if (!result) {
+      fprintf(stderr, "ERROR: No pairs in %s\n", path);
+    }
+  }
+
+  if (result) {
+    u64 num_points = dataset->points.num_points;
+    dataset->answers = calculateHaversine(arena, &dataset->points, args->kernel,
+                                          args->thread_count);
+
+    u64 block_count = (num_points + kHaversineBlockSize - 1) / kHaversineBlockSize;
+    dataset->block_prefix = pushArray<f64>(arena, block_count + 1);
+    dataset->block_prefix[0] = 0;
+    for (u64 block = 0; block < block_count; ++block) {
+      u64 first = block * kHaversineBlockSize;
+      u64 count = num_points - first < kHaversineBlockSize ? num_points - first : kHaversineBlockSize;
+      dataset->block_prefix[block + 1] = (dataset->block_prefix[block] +
+                                          pairwiseSum(dataset->answers + first, count));
+    }
+
+    if (args->index) {
+      dataset->index = buildSpatialIndex(arena, scratch, &dataset->points, args->endpoint,
+                                         args->kernel, args->thread_count);
+      dataset->has_index = true;
+    }
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Whole blocks come from the prefix sums. Their rounding error is
+// relative to everything before the range, so ranges that don't cover a whole
+// block are always summed directly.
+static f64 sumAnswers(QueryDataset *dataset, u64 first, u64 count) {
+  u64 end = first + count;
+  u64 first_block = (first + kHaversineBlockSize - 1) / kHaversineBlockSize;
+  u64 end_block = end / kHaversineBlockSize;
+  f64 result = 0;
+
+  if (first_block >= end_block) {
+    result = pairwiseSum(dataset->answers + first, count);
+  } else {
+    u64 head = first_block * kHaversineBlockSize - first;
+    u64 tail = end - end_block * kHaversineBlockSize;
+    result = (pairwiseSum(dataset->answers + first, head) +
+              (dataset->block_prefix[end_block] - dataset->block_prefix[first_block]) +
+              pairwiseSum(dataset->answers + end_block * kHaversineBlockSize, tail));
+  }
+
+  return result;
+}
+
+static bool isRangeInDataset(QueryDataset *dataset, QueryRequest *request) {
+  u64 num_points = dataset->points.num_points;
+  bool result = request->first <= num_points && request->count <= num_points - request->first;
+
+  return result;
+}
+
+// NOTE(chogan): Fills in `response` and pushes its items into `arena` right
+// after it, so the reply goes out in one send.
+void answerQuery(Arena *arena, QueryServer *server, QueryRequest *request,
+                 QueryResponse *response) {
+  QueryDataset *dataset = NULL;
+  response->status = QueryStatus_Ok;
+
+  if (request->op >= QueryOp_Count) {
+    response->status = QueryStatus_UnknownOp;
+  } else if (request->op != QueryOp_Shutdown) {
+    if (request->dataset < server->dataset_count) {
+      dataset = server->datasets + request->dataset;
+    } else {
+      response->status = QueryStatus_UnknownDataset;
+    }
+  }
+
+  if (dataset) {
+    switch (request->op) {
+      case QueryOp_Info: {
+        response->total = dataset->points.num_points;
+        response->value = dataset->answers[dataset->points.num_points];
+        break;
+      }
+      case QueryOp_Sum: {
+        if (isRangeInDataset(dataset, request)) {
+          response->total = request->count;
+          response->value = sumAnswers(dataset, request->first, request->count);
+        } else {
+          response->status = QueryStatus_OutOfRange;
+        }
+        break;
+      }
+      case QueryOp_Answers:
+      case QueryOp_Pairs: {
+        if (!isRangeInDataset(dataset, request)) {
+          response->status = QueryStatus_OutOfRange;
+        } else if (request->count > kMaxQueryItems) {
+          response->status = QueryStatus_TooMany;
+        } else if (request->op == QueryOp_Answers) {
+          f64 *answers = pushArray<f64>(arena, request->count);
+          memcpy(answers, dataset->answers + request->first, request->count * sizeof(f64));
+          response->item_size = sizeof(f64);
+          response->count = response->total = request->count;
+        } else {
+          Point *pairs = pushArray<Point>(arena, request->count);
+          PointColumns *points = &dataset->points;
+          for (u64 i = 0; i < request->count; ++i) {
+            u64 at = request->first + i;
+            pairs[i] = {points->x0[at], points->y0[at], points->x1[at], points->y1[at]};
+          }
+          response->item_size = sizeof(Point);
+          response->count = response->total = request->count;
+        }
+        break;
+      }
+      case QueryOp_Within:
+      case QueryOp_Nearest: {
+        if (!dataset->has_index) {
+          response->status = QueryStatus_NoIndex;
+        } else if (request->count > kMaxQueryItems) {
+          response->status = QueryStatus_TooMany;
+        } else {
+          SpatialMatches matches = {};
+          if (request->op == QueryOp_Within) {
+            matches = findPointsWithin(arena, &dataset->index, request->x, request->y,
+                                       request->radius);
+          } else {
+            matches = findNearestPoints(arena, &dataset->index, request->x, request->y,
+                                        request->count);
+          }
+          response->item_size = sizeof(SpatialMatch);
+          response->total = matches.count;
+          response->count = matches.count < request->count ? matches.count : request->count;
+        }
+        break;
+      }
+      default: {
+        break;
+      }
+    }
+  }
+}
+
+// NOTE(chogan): Wakes every thread, since they all wait on the wake receiver,
+// and they check `stopping` before waiting again. A thread in the middle of a
+// request finishes it first.
+static void stopQueryServer(QueryServer *server) {
+  __atomic_store_n(&server->stopping, true, __ATOMIC_SEQ_CST);
+  shutdownQuerySocket(&server->listener);
+  shutdownQuerySocket(&server->wake_sender);
+}
+
+static void handleStopSignal(int signal_number) {
+  (void)signal_number;
+  if (global_query_server) {
+    stopQueryServer(global_query_server);
+  }
+}
+
+// NOTE(chogan): Fails if the client hung up or the reply couldn't be sent
+static bool serveQuery(QueryWorker *worker, QuerySocket *connection) {
+  QueryServer *server = worker->server;
+  QueryRequest request = {};
+  bool result = receiveQueryBytes(connection, &request, sizeof(request));
+
+  if (result) {
+    ScopedTemporaryMemory scratch_memory(&worker->scratch);
+    QueryResponse *response = pushClearedStruct<QueryResponse>(scratch_memory);
+    answerQuery(scratch_memory, server, &request, response);
+    worker->query_count++;
+
+    u64 size = sizeof(*response) + response->count * response->item_size;
+    result = sendQueryBytes(connection, response, size);
+    if (result && request.op == QueryOp_Shutdown) {
+      stopQueryServer(server);
+    }
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Each wakeup serves one request from every client that has one
+// waiting, so a busy client can't starve the others on the same thread.
+static void serveQueries(QueryWorker *worker) {
+  QueryServer *server = worker->server;
+  // NOTE(chogan): The wake receiver, the listener, then this thread's clients
+  QuerySocket sockets[2 + kMaxWorkerConnections];
+  bool ready[ArrayCount(sockets)];
+  sockets[0] = server->wake_receiver;
+  u32 count = 2;
+
+  while (!__atomic_load_n(&server->stopping, __ATOMIC_SEQ_CST)) {
+    sockets[1].fd = count < ArrayCount(sockets) ? server->listener.fd : -1;
+    if (!waitForQuerySockets(sockets, count, ready)) {
+      break;
+    }
+
+    // NOTE(chogan): Backwards, so a closed client can be swapped with the last
+    for (u32 i = count - 1; i >= 2; --i) {
+      if (ready[i] && !serveQuery(worker, sockets + i)) {
+        closeQuerySocket(sockets + i);
+        sockets[i] = sockets[--count];
+      }
+    }
+
+    QuerySocket connection = {};
+    if (ready[1] && acceptQueryConnection(&server->listener, &connection)) {
+      sockets[count++] = connection;
+    }
+  }
+
+  for (u32 i = 2; i < count; ++i) {
+    closeQuerySocket(sockets + i);
+  }
+}
+
+int main(int argc, char **argv) {
+  Arguments args = {};
+
+  if (parseArguments(argc, argv, &args)) {
+    BeginProfile;
+
+    u64 arena_size = 0;
+    u64 scratch_size = 0;
+    u64 worker_scratch_size = 0;
+    planQueryServer(&args, &arena_size, &scratch_size, &worker_scratch_size);
+    Arena arena = initArenaAndAllocate(arena_size);
+    Arena scratch = initArenaAndAllocate(scratch_size);
+    Arena worker_arena = initArenaAndAllocate(args.thread_count * worker_scratch_size);
+
+    printf("Haversine kernel: %s, instruction set: %s\n", kHaversineKernelNames[args.kernel],
+           kCpuIsaNames[getCpuIsa()]);
+
+    QueryServer server = {};
+    server.listener.fd = -1;
+    server.wake_receiver.fd = -1;
+    server.wake_sender.fd = -1;
+    bool result = true;
+
+    for (u32 i = 0; i < args.dataset_count && result; ++i) {
+      QueryDataset *dataset = server.datasets + i;
+      result = loadQueryDataset(&arena, &scratch, &args, args.dataset_paths[i], dataset);
+      if (result) {
+        server.dataset_count++;
+        printf("Dataset %u: %s, %llu pairs, average %.16f", i, dataset->path,
+               (unsigned long long)dataset->points.num_points,
+               dataset->answers[dataset->points.num_points]);
+        if (dataset->has_index) {
+          printf(", %s endpoint index of %ux%u cells", kSpatialEndpointNames[args.endpoint],
+                 dataset->index.rows, dataset->index.columns);
+        }
+        printf("\n");
+      }
+    }
+    destroyArena(&scratch);
+
+    result = (result && openQueryListener(args.socket_path, &server.listener) &&
+              openQuerySocketPair(&server.wake_receiver, &server.wake_sender));
+
+    if (result) {
+      QueryWorker workers[kMaxThreads] = {};
+      for (u32 i = 0; i < args.thread_count; ++i) {
+        workers[i].server = &server;
+        workers[i].scratch = subArena(&worker_arena, worker_scratch_size);
+      }
+
+      global_query_server = &server;
+      signal(SIGINT, handleStopSignal);
+      signal(SIGTERM, handleStopSignal);
+
+      printf("Listening on %s with %u threads\n", args.socket_path, args.thread_count);
+      fflush(stdout);
+      runOnThreads(serveQueries, workers, args.thread_count);
+
+      global_query_server = NULL;
+      unlink(args.socket_path);
+
+      u64 query_count = 0;
+      for (u32 i = 0; i < args.thread_count; ++i) {
+        query_count += workers[i].query_count;
+      }
+      printf("Served %llu queries\n", (unsigned long long)query_count);
+    }
+
+    closeQuerySocket(&server.listener);
+    closeQuerySocket(&server.wake_receiver);
+    closeQuerySocket(&server.wake_sender);
+    for (u32 i = 0; i < server.dataset_count; ++i) {
+      closePointFile(&server.datasets[i].point_file);
+    }
+    destroyArena(&worker_arena);
+    destroyArena(&arena);
+
+    EndAndPrintProfile;
+
+    if (!result) {
+      exit(1);
+    }
+  } else {
+    fprintf(stderr, "USAGE: %s [--socket path] [--threads N] "
+            "[--read fread|read|pread|mmap|direct|io_uring] [--verify-checksum] "
+            "[--kernel reference|avx2|avx512] [--isa scalar|sse4.2|avx2|avx512] "
+            "[--index first|second|both] <JSON_or_pts_path>...\n",
+            argv[0]);
+  }
+
+  return 0;
+}
+
+ProfilerEndOfCompilationUnit;
@@ -0,0 +1,595 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ArrayCount(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef double f64;
+typedef uint32_t b32;
+
+#include "perfaware_timer.h"
+#include "perfaware_memory.h"
+#include "perfaware_haversine.h"
+#include "perfaware_math.h"
+#include "perfaware_cpu.h"
+#include "perfaware_float_parser.h"
+#include "perfaware_float_format.h"
+#include "perfaware_thread.h"
+#include "perfaware_file.h"
+#include "perfaware_hash.h"
+#include "perfaware_point_file.h"
+#include "perfaware_json_parser.h"
+#include "perfaware_json_cursor.h"
+#include "perfaware_json_schema.h"
+#include "perfaware_answers.h"
+#include "perfaware_distribution.h"
+#include "perfaware_json_writer.h"
+#include "perfaware_distance.h"
+#include "perfaware_spatial.h"
+
+#include "listing_0065_haversine_formula.cpp"
+#include "perfaware_haversine.cpp"
+#include "perfaware_memory.cpp"
+#include "perfaware_cpu.cpp"
+#include "perfaware_math.cpp"
+#include "perfaware_float_parser.cpp"
+#include "perfaware_float_format.cpp"
+#include "perfaware_thread.cpp"
+#include "perfaware_file.cpp"
+#include "perfaware_hash.cpp"
+#include "perfaware_point_file.cpp"
+#include "perfaware_json_parser.cpp"
+#include "perfaware_json_cursor.cpp"
+#include "perfaware_answers.cpp"
+#include "perfaware_distribution.cpp"
+#include "perfaware_json_writer.cpp"
+#include "perfaware_distance.cpp"
+#include "perfaware_spatial.cpp"
+#include "perfaware_timer.cpp"
+#include "listing_0103_repetition_tester.cpp"
+
+// NOTE(chogan): Runs each stage of haversine_processor on its own in the
+// repetition tester, on inputs generated up front and kept in memory, at sizes
+// from a few kb of JSON (L1) up to hundreds of mb (DRAM). Every stage gets the
+// previous stage's output already computed, so only its own work is timed:
+//
+//   read       readEntireFile of the JSON, which is in the page cache
+//   tokenize   tokenize over the JSON text
+//   parse      parseTokens over the tokens
+//   haversine  calculateHaversine on one thread over the point columns
+//   verify     compareAnswers of the answers against the reference ones
+//   matrix     calculateDistanceMatrix on one thread, from the first points'
+//              (x0, y0) to the (x1, y1) of up to kMaxMatrixColumns of them,
+//              with as many rows as it takes to make about as many distances
+//              as there are pairs
+//   index      buildSpatialIndex on one thread over the first points
+//
+// The JSON stages count JSON bytes, haversine counts sizeof(Point) per pair
+// like its TimeBandwidth does, verify counts both answer arrays, matrix
+// counts the distances it writes and index counts the points it reads.
+
+enum Stage {
+  Stage_Read,
+  Stage_Tokenize,
+  Stage_Parse,
+  Stage_Haversine,
+  Stage_Verify,
+  Stage_Matrix,
+  Stage_Index,
+
+  Stage_Count
+};
+
+static const char *kStageNames[Stage_Count] = {
+  "read",
+  "tokenize",
+  "parse",
+  "haversine",
+  "verify",
+  "matrix",
+  "index",
+};
+
+// NOTE(chogan): Each size is kPairsStep times the last
+const u64 kDefaultMinPairs = 64;
+const u64 kDefaultMaxPairs = 1 << 21;
+const u64 kPairsStep = 8;
+const u32 kMaxSizes = 16;
+const u32 kDefaultSecondsToTry = 2;
+const u64 kMaxMatrixColumns = 1024;
+
+struct Arguments {
+  u64 seed;
+  u64 min_pairs;
+  u64 max_pairs;
+  u32 seconds_to_try;
+  HaversineKernel kernel;
+  FileReadOptions read_options;
+  bool stages[Stage_Count];
+  const char *temp_path;
+};
+
+struct StageInputs {
+  const char *path;
+  FileReadOptions *read_options;
+  HaversineKernel kernel;
+  EntireFile json;
+  TokenArray tokens;
+  PointColumns columns;
+  f64 *answers;
+  f64 *expected;
+  u64 num_points;
+  HaversineTerms matrix_rows;
+  HaversineTerms matrix_columns;
+  Arena *scratch;
+  f64 sink;
+};
+
+static bool parseStage(const char *name, Stage *stage) {
+  bool result = false;
+
+  for (u32 i = 0; i < Stage_Count; ++i) {
+    if (strcmp(name, kStageNames[i]) == 0) {
+      *stage = (Stage)i;
+      result = true;
+      break;
+    }
+  }
+
+  return result;
+}
+
+static u64 getStageBytes(Stage stage, StageInputs *inputs) {
+  u64 result = 0;
+
+  switch (stage) {
+    case Stage_Read:
+    case Stage_Tokenize:
+    case Stage_Parse: {
+      result = inputs->json.size;
+      break;
+    }
+    case Stage_Haversine: {
+      result = inputs->num_points * sizeof(Point);
+      break;
+    }
+    case Stage_Verify: {
+      result = 2 * inputs->num_points * sizeof(f64);
+      break;
+    }
+    case Stage_Matrix: {
+      result = inputs->matrix_rows.count * inputs->matrix_columns.count * sizeof(f64);
+      break;
+    }
+    case Stage_Index: {
+      result = inputs->num_points * 2 * sizeof(f64);
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+
+  return result;
+}
+
+void testRead(repetition_tester *tester, StageInputs *inputs) {
+  while (IsTesting(tester)) {
+    ScopedTemporaryMemory scratch_memory(inputs->scratch);
+
+    BeginTime(tester);
+    EntireFile file = readEntireFile(scratch_memory, inputs->path, inputs->read_options);
+    EndTime(tester);
+
+    if (file.data && file.size == inputs->json.size) {
+      CountBytes(tester, file.size);
+    } else {
+      Error(tester, "readEntireFile failed");
+    }
+    releaseEntireFile(&file);
+  }
+}
+
+void testTokenize(repetition_tester *tester, StageInputs *inputs) {
+  while (IsTesting(tester)) {
+    ScopedTemporaryMemory scratch_memory(inputs->scratch);
+
+    BeginTime(tester);
+    TokenArray tokens = tokenize(scratch_memory, &inputs->json);
+    EndTime(tester);
+
+    if (tokens.count == inputs->tokens.count) {
+      CountBytes(tester, inputs->json.size);
+    } else {
+      Error(tester, "tokenize found a different number of tokens");
+    }
+  }
+}
+
+void testParse(repetition_tester *tester, StageInputs *inputs) {
+  while (IsTesting(tester)) {
+    ScopedTemporaryMemory scratch_memory(inputs->scratch);
+
+    BeginTime(tester);
+    PointArray points = parseTokens(scratch_memory, &inputs->tokens);
+    EndTime(tester);
+
+    if (points.num_points == inputs->num_points) {
+      CountBytes(tester, inputs->json.size);
+    } else {
+      Error(tester, "parseTokens found a different number of pairs");
+    }
+  }
+}
+
+void testHaversine(repetition_tester *tester, StageInputs *inputs) {
+  while (IsTesting(tester)) {
+    ScopedTemporaryMemory scratch_memory(inputs->scratch);
+
+    BeginTime(tester);
+    f64 *answers = calculateHaversine(scratch_memory, &inputs->columns, inputs->kernel, 1);
+    EndTime(tester);
+
+    CountBytes(tester, inputs->num_points * sizeof(Point));
+    inputs->sink += answers[inputs->num_points];
+  }
+}
+
+void testVerify(repetition_tester *tester, StageInputs *inputs) {
+  AnswerTolerance tolerance = {};
+  tolerance.absolute = 0.00000001;
+  tolerance.kernel = inputs->kernel;
+
+  while (IsTesting(tester)) {
+    ScopedTemporaryMemory scratch_memory(inputs->scratch);
+    AnswerComparison comparison = {};
+
+    BeginTime(tester);
+    compareAnswers(scratch_memory, inputs->expected, inputs->answers, inputs->num_points,
+                   &tolerance, 0, 1, &comparison);
+    EndTime(tester);
+
+    if (comparison.mismatch_count == 0) {
+      CountBytes(tester, 2 * inputs->num_points * sizeof(f64));
+    } else {
+      Error(tester, "Answers don't match the reference");
+    }
+  }
+}
+
+void testMatrix(repetition_tester *tester, StageInputs *inputs) {
+  u64 bytes = inputs->matrix_rows.count * inputs->matrix_columns.count * sizeof(f64);
+
+  while (IsTesting(tester)) {
+    ScopedTemporaryMemory scratch_memory(inputs->scratch);
+
+    BeginTime(tester);
+    f64 *distances = calculateDistanceMatrix(scratch_memory, &inputs->matrix_rows,
+                                             &inputs->matrix_columns, inputs->kernel, 1);
+    EndTime(tester);
+
+    CountBytes(tester, bytes);
+    inputs->sink += distances[0];
+  }
+}
+
+void testIndex(repetition_tester *tester, StageInputs *inputs) {
+  while (IsTesting(tester)) {
+    ScopedTemporaryMemory scratch_memory(inputs->scratch);
+    Arena build_scratch = subArena(scratch_memory,
+                                   getSpatialBuildScratchSize(inputs->num_points, 1));
+
+    BeginTime(tester);
+    SpatialIndex index = buildSpatialIndex(scratch_memory, &build_scratch, &inputs->columns,
+                                           SpatialEndpoint_First, inputs->kernel, 1);
+    EndTime(tester);
+
+    if (index.count == inputs->num_points) {
+      CountBytes(tester, inputs->num_points * 2 * sizeof(f64));
+    } else {
+      Error(tester, "buildSpatialIndex indexed a different number of points");
+    }
+    inputs->sink += index.x[0];
+  }
+}
+
+typedef void StageTestFunc(repetition_tester *tester, StageInputs *inputs);
+
+static StageTestFunc *kStageTests[Stage_Count] = {
+  testRead,
+  testTokenize,
+  testParse,
+  testHaversine,
+  testVerify,
+  testMatrix,
+  testIndex,
+};
+
+// NOTE(chogan): The JSON is written the way point_generator writes it by
+// default, and the expected answers come from ReferenceHaversine.
+bool generateInputs(Arena *arena, Arguments *args, u64 num_points, StageInputs *inputs) {
+  JsonStyle style = {};
+  style.layout = JsonLayout_Lines;
+  style.numbers = NumberStyle_Fixed16;
+  style.indent = kDefaultJsonIndent;
+  style.key = args->seed;
+
+  PointDistribution distribution = {};
+  initPointDistribution(arena, &distribution, Distribution_Uniform, PointOrder_Shuffled,
+                        args->seed, num_points, kDefaultSpreads[Distribution_Uniform],
+                        kDefaultClusterCount);
+
+  u64 max_json_size = 2 * kMaxJsonHeaderSize + num_points * getMaxJsonRecordSize(&style);
+  char *json = (char *)pushSize(arena, max_json_size);
+  char *at = json + formatJsonHeader(json, &style);
+  inputs->expected = pushArray<f64>(arena, num_points + 1);
+  f64 sum = 0;
+
+  for (u64 i = 0; i < num_points; ++i) {
+    Point point = generatePoint(&distribution, i);
+    at += formatJsonRecord(at, &style, &point, i, i == num_points - 1);
+    inputs->expected[i] = ReferenceHaversine(point.x0, point.y0, point.x1, point.y1,
+                                             kEarthRadius);
+    sum += inputs->expected[i];
+  }
+  at += formatJsonFooter(at, &style);
+  inputs->expected[num_points] = sum / (f64)num_points;
+
+  inputs->json.data = (u8 *)json;
+  inputs->json.size = at - json;
+  inputs->num_points = num_points;
+
+  OutputFile file = {};
+  bool result = openOutputFile(inputs->path, &file);
+  if (result) {
+    result = writeFileAt(&file, 0, json, inputs->json.size);
+    result = closeOutputFile(&file) && result;
+  }
+
+  if (result) {
+    inputs->tokens = tokenize(arena, &inputs->json);
+    PointArray points = parseTokens(arena, &inputs->tokens);
+    result = points.num_points == num_points;
+    if (result) {
+      inputs->columns = toPointColumns(arena, &points);
+
+      u64 column_count = num_points < kMaxMatrixColumns ? num_points : kMaxMatrixColumns;
+      u64 row_count = num_points / column_count;
+      inputs->matrix_rows = prepareHaversineTerms(arena, inputs->columns.x0,
+                                                  inputs->columns.y0, row_count);
+      inputs->matrix_columns = prepareHaversineTerms(arena, inputs->columns.x1,
+                                                     inputs->columns.y1, column_count);
+      inputs->answers = calculateHaversine(arena, &inputs->columns, inputs->kernel, 1);
+    } else {
+      fprintf(stderr, "ERROR: Parsed %llu pairs out of %llu\n",
+              (unsigned long long)points.num_points, (unsigned long long)num_points);
+    }
+  }
+
+  return result;
+}
+
+// NOTE(chogan): Reserved, not committed, so the bounds can be loose
+static u64 getInputsArenaSize(u64 num_points) {
+  JsonStyle style = {};
+  style.indent = kDefaultJsonIndent;
+  u64 json_size = 2 * kMaxJsonHeaderSize + num_points * getMaxJsonRecordSize(&style);
+  u64 result = (json_size + getMaxTokenBytes(json_size) + getMaxRecordCount(json_size) *
+                sizeof(Point) + num_points * (4 + 3 + 5) * sizeof(f64) +
+                kMaxMatrixColumns * 5 * sizeof(f64) + kDefaultClusterCount * sizeof(ClusterCenter) + MEGABYTES(16));
+
+  return result;
+}
+
+static u64 getScratchArenaSize(u64 num_points) {
+  JsonStyle style = {};
+  style.indent = kDefaultJsonIndent;
+  u64 json_size = 2 * kMaxJsonHeaderSize + num_points * getMaxJsonRecordSize(&style);
+  u64 result = (json_size + 2 * kDirectAlignment + getMaxTokenBytes(json_size) +
+                getMaxRecordCount(json_size) * sizeof(Point) +
+                getSpatialBuildScratchSize(num_points, 1) +
+                num_points * (3 + 5) * sizeof(f64) + num_points / kSpatialPointsPerCell *
+                2 * sizeof(u64) + MEGABYTES(16));
+
+  return result;
+}
+
+static void printSize(u64 bytes) {
+  if (bytes < MEGABYTES(1)) {
+    printf("%.1fkb", bytes / 1024.0);
+  } else {
+    printf("%.1fmb", bytes / (1024.0 * 1024.0));
+  }
+}
+
+bool parseArguments(int argc, char **argv, Arguments *args) {
+  bool result = true;
+  bool stage_given = false;
+  bool kernel_given = false;
+  bool isa_given = false;
+  CpuIsa isa = CpuIsa_Scalar;
+  args->seed = 1234;
+  args->min_pairs = kDefaultMinPairs;
+  args->max_pairs = kDefaultMaxPairs;
+  args->seconds_to_try = kDefaultSecondsToTry;
+  args->read_options = defaultFileReadOptions();
+  args->temp_path = "stage_repetition_tester.json";
+
+  for (int i = 1; i < argc && result; ++i) {
+    const char *arg = argv[i];
+
+    if (strcmp(arg, "--stage") == 0 && i + 1 < argc) {
+      Stage stage = Stage_Count;
+      if (parseStage(argv[++i], &stage)) {
+        args->stages[stage] = true;
+        stage_given = true;
+      } else {
+        fprintf(stderr, "ERROR: Unknown stage %s\n", argv[i]);
+        result = false;
+      }
+    } else if (strcmp(arg, "--min-pairs") == 0 && i + 1 < argc) {
+      args->min_pairs = (u64)atoll(argv[++i]);
+    } else if (strcmp(arg, "--max-pairs") == 0 && i + 1 < argc) {
+      args->max_pairs = (u64)atoll(argv[++i]);
+    } else if (strcmp(arg, "--seconds") == 0 && i + 1 < argc) {
+      args->seconds_to_try = (u32)atoi(argv[++i]);
+    } else if (strcmp(arg, "--seed") == 0 && i + 1 < argc) {
+      args->seed = (u64)atoll(argv[++i]);
+    } else if (strcmp(arg, "--kernel") == 0 && i + 1 < argc) {
+      if (!parseHaversineKernel(argv[++i], &args->kernel)) {
+        fprintf(stderr, "ERROR: Unknown haversine kernel %s\n", argv[i]);
+        result = false;
+      }
+      kernel_given = true;
+    } else if (strcmp(arg, "--isa") == 0 && i + 1 < argc) {
+      if (!parseCpuIsa(argv[++i], &isa)) {
+        fprintf(stderr, "ERROR: Unknown instruction set %s\n", argv[i]);
+        result = false;
+      }
+      isa_given = true;
+    } else if (strcmp(arg, "--read") == 0 && i + 1 < argc) {
+      if (!parseFileBackend(argv[++i], &args->read_options.backend)) {
+        fprintf(stderr, "ERROR: Unknown read backend %s\n", argv[i]);
+        result = false;
+      }
+    } else if (strcmp(arg, "--temp") == 0 && i + 1 < argc) {
+      args->temp_path = argv[++i];
+    } else {
+      fprintf(stderr, "ERROR: Unknown option %s\n", arg);
+      result = false;
+    }
+  }
+
+  if (isa_given && !forceCpuIsa(isa)) {
+    fprintf(stderr, "ERROR: This CPU doesn't have %s\n", kCpuIsaNames[isa]);
+    result = false;
+  }
+  // NOTE(chogan): The default kernel follows --isa
+  if (!kernel_given) {
+    args->kernel = getBestHaversineKernel();
+  } else if (!isHaversineKernelSupported(args->kernel)) {
+    fprintf(stderr, "ERROR: Can't run the %s kernel on %s\n", kHaversineKernelNames[args->kernel],
+            kCpuIsaNames[getCpuIsa()]);
+    result = false;
+  }
+  if (!stage_given) {
+    for (u32 i = 0; i < Stage_Count; ++i) {
+      args->stages[i] = true;
+    }
+  }
+  if (args->min_pairs < 1 || args->max_pairs < args->min_pairs) {
+    fprintf(stderr, "ERROR: Need 1 <= --min-pairs <= --max-pairs\n");
+    result = false;
+  }
+  if (args->seconds_to_try < 1) {
+    fprintf(stderr, "ERROR: --seconds must be at least 1\n");
+    result = false;
+  }
+
+  return result;
+}
+
+int main(int argc, char **argv) {
+  Arguments args = {};
+
+  if (parseArguments(argc, argv, &args)) {
+    u64 sizes[kMaxSizes] = {};
+    u64 json_sizes[kMaxSizes] = {};
+    u32 size_count = 0;
+    for (u64 pairs = args.min_pairs; pairs <= args.max_pairs && size_count < kMaxSizes;
+         pairs *= kPairsStep) {
+      sizes[size_count++] = pairs;
+    }
+
+    u64 cpu_timer_freq = estimateCPUFrequency();
+    u64 max_pairs = sizes[size_count - 1];
+    Arena arena = initArenaAndAllocate(getInputsArenaSize(max_pairs));
+    Arena scratch = initArenaAndAllocate(getScratchArenaSize(max_pairs));
+    repetition_tester testers[kMaxSizes][Stage_Count] = {};
+    bool result = true;
+
+    printf("Haversine kernel: %s, instruction set: %s, read backend: %s\n",
+           kHaversineKernelNames[args.kernel], kCpuIsaNames[getCpuIsa()],
+           kFileBackendNames[args.read_options.backend]);
+
+    for (u32 size_index = 0; size_index < size_count && result; ++size_index) {
+      ScopedTemporaryMemory input_memory(&arena);
+      StageInputs inputs = {};
+      inputs.path = args.temp_path;
+      inputs.read_options = &args.read_options;
+      inputs.kernel = args.kernel;
+      inputs.scratch = &scratch;
+
+      result = generateInputs(input_memory, &args, sizes[size_index], &inputs);
+      json_sizes[size_index] = inputs.json.size;
+
+      for (u32 stage = 0; stage < Stage_Count && result; ++stage) {
+        if (!args.stages[stage]) {
+          continue;
+        }
+
+        repetition_tester *tester = &testers[size_index][stage];
+        u64 bytes = getStageBytes((Stage)stage, &inputs);
+        printf("\n--- %s, %llu pairs, ", kStageNames[stage],
+               (unsigned long long)inputs.num_points);
+        printSize(bytes);
+        printf(" ---\n");
+        NewTestWave(tester, bytes, cpu_timer_freq, args.seconds_to_try);
+        kStageTests[stage](tester, &inputs);
+        result = tester->Mode != TestMode_Error;
+      }
+    }
+    remove(args.temp_path);
+
+    // NOTE(chogan): Best case per pair, so the sizes line up against each other
+    if (result) {
+      printf("\n--- Best cycles per pair ---\n%-10s", "pairs");
+      for (u32 stage = 0; stage < Stage_Count; ++stage) {
+        if (args.stages[stage]) {
+          printf(" %10s", kStageNames[stage]);
+        }
+      }
+      printf("  json\n");
+      for (u32 size_index = 0; size_index < size_count; ++size_index) {
+        printf("%-10llu", (unsigned long long)sizes[size_index]);
+        for (u32 stage = 0; stage < Stage_Count; ++stage) {
+          if (args.stages[stage]) {
+            repetition_tester *tester = &testers[size_index][stage];
+            printf(" %10.2f", (f64)tester->Results.MinTime / (f64)sizes[size_index]);
+          }
+        }
+        printf("  ");
+        printSize(json_sizes[size_index]);
+        printf("\n");
+      }
+    }
+
+    destroyArena(&scratch);
+    destroyArena(&arena);
+
+    if (!result) {
+      return 1;
+    }
+  } else {
+    fprintf(stderr, "USAGE: %s [--stage read|tokenize|parse|haversine|verify|matrix|index]... "
+            "[--min-pairs N] [--max-pairs N] [--seconds N] [--seed N] "
+            "[--kernel reference|avx2|avx512] [--isa scalar|sse4.2|avx2|avx512] "
+            "[--read fread|read|pread|mmap|direct|io_uring] [--temp path]\n", argv[0]);
+  }
+
+  return 0;
+}
+
+ProfilerEndOfCompilationUnit;